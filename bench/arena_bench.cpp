@@ -0,0 +1,216 @@
+#include "bench.h"
+
+#include <cstdlib>
+#include <cstring>
+
+#include "../job_system.h"
+#include "../memory_arena.h"
+#include "../command_list.h"
+
+
+// the transient arrays of building a frame: culling results, a visibility mask and the sorted entities with their transforms
+struct transient_frame
+{
+	uint32* visibleObjects;
+	uint8* objectVisible;
+	uint32* entityOrder;
+	mat4* entityMVs;
+};
+
+static void fillTransientFrame(transient_frame& frame, uint32 count)
+{
+	memset(frame.objectVisible, 0, count);
+	for (uint32 i = 0; i < count; ++i)
+	{
+		frame.visibleObjects[i] = (i * 7) % count;
+		frame.objectVisible[frame.visibleObjects[i]] = 1;
+		frame.entityOrder[i] = count - 1 - i;
+		frame.entityMVs[i] = createTranslationMatrix(vec3((float)i, 0.f, 0.f));
+	}
+}
+
+static void vectorFrame(uint32 count)
+{
+	std::vector<uint32> visibleObjects(count);
+	std::vector<uint8> objectVisible(count);
+	std::vector<uint32> entityOrder(count);
+	std::vector<mat4> entityMVs(count);
+	transient_frame frame = { visibleObjects.data(), objectVisible.data(), entityOrder.data(), entityMVs.data() };
+	fillTransientFrame(frame, count);
+	benchSink += frame.entityOrder[count - 1] + (uint64)frame.entityMVs[count - 1].m03;
+}
+
+static void arenaFrame(memory_arena& arena, uint32 count)
+{
+	resetArena(arena);
+	transient_frame frame;
+	frame.visibleObjects = pushArray<uint32>(arena, count);
+	frame.objectVisible = pushArray<uint8>(arena, count);
+	frame.entityOrder = pushArray<uint32>(arena, count);
+	frame.entityMVs = pushArray<mat4>(arena, count);
+	fillTransientFrame(frame, count);
+	benchSink += frame.entityOrder[count - 1] + (uint64)frame.entityMVs[count - 1].m03;
+}
+
+#define DRAWS_PER_LIST 256
+
+struct recording
+{
+	std::vector<command_list>* lists;
+};
+
+static void recordDraws(void* data, uint32 begin, uint32 end)
+{
+	recording& rec = *(recording*)data;
+	command_list& list = (*rec.lists)[begin / DRAWS_PER_LIST];
+	for (uint32 i = begin; i < end; ++i)
+	{
+		draw_instance* instance = recordDraw(list, makeDrawKey(i % 16, i % 2, i % 128), 3, i * 3, 0, 1);
+		instance->MV = mat4();
+		instance->materialIndex = i % 128;
+		memset(instance->texCoordTransform, 0, sizeof(instance->texCoordTransform));
+	}
+}
+
+#define ALLOCATING_JOBS 64
+
+static void allocatingJob(void* data)
+{
+	std::atomic<uint64>& sink = *(std::atomic<uint64>*)data;
+	uint32* value = new uint32(7);
+	sink.fetch_add(*value, std::memory_order_relaxed);
+	delete value;
+}
+
+// the frame counts have to include the job workers. the jobs are queued on this thread, which does not help while
+// waiting, so the worker steals and runs all of them
+static bool checkJobAllocationsCounted()
+{
+	job_system system;
+	startJobSystem(system, 2);
+
+	std::atomic<uint64> sink(0);
+	job jobs[ALLOCATING_JOBS];
+	for (uint32 i = 0; i < ALLOCATING_JOBS; ++i)
+		jobs[i] = { allocatingJob, &sink };
+
+	job_counter counter;
+	uint64 before = getHeapAllocationCount();
+	submitJobs(system, jobs, ALLOCATING_JOBS, &counter);
+	while (counter.value.load(std::memory_order_acquire) > 0)
+		std::this_thread::yield();
+	uint64 allocations = getHeapAllocationCount() - before;
+
+	stopJobSystem(system);
+	benchSink += sink.load();
+	return allocations >= ALLOCATING_JOBS;
+}
+
+// heap allocations per frame of all threads, after the first frames. the update thread is not part of the job
+// system, so its jobs go through the shared queue
+static bool measureSteadyFrames(uint32 numberOfThreads, uint32 count, uint64& firstFrameAllocations, uint64& steadyAllocations)
+{
+	job_system system;
+	startJobSystem(system, numberOfThreads);
+
+	bool result = true;
+	std::thread updateThread([&]()
+	{
+		uint32 numberOfLists = (count + DRAWS_PER_LIST - 1) / DRAWS_PER_LIST;
+		std::vector<command_list> lists;
+		command_list merged;
+		std::vector<draw_elements_indirect_command> commands;
+		std::vector<draw_batch> batches;
+		memory_arena arena;
+
+		steadyAllocations = 0;
+		for (uint32 frame = 0; frame < 100; ++frame)
+		{
+			uint64 before = getHeapAllocationCount();
+
+			if (lists.size() < numberOfLists)
+				lists.resize(numberOfLists);
+			for (command_list& list : lists)
+				clearCommandList(list);
+			recording rec = { &lists };
+			parallelFor(system, count, DRAWS_PER_LIST, recordDraws, &rec);
+			mergeCommandLists(merged, lists.data(), numberOfLists);
+			buildDrawBatches(merged, commands, batches);
+			arenaFrame(arena, count);
+
+			uint64 allocations = getHeapAllocationCount() - before;
+			if (frame == 0)
+				firstFrameAllocations = allocations;
+			else if (frame >= 4)
+				steadyAllocations += allocations;
+		}
+		deleteArena(arena);
+		result = merged.draws.size() == count;
+	});
+	updateThread.join();
+
+	stopJobSystem(system);
+	return result;
+}
+
+// runs with 1 up to the given number of threads, by default one per hardware thread
+int main(int argc, char** argv)
+{
+	uint32 maxThreads = (argc > 1) ? (uint32)atoi(argv[1]) : std::thread::hardware_concurrency();
+	if (maxThreads == 0)
+		maxThreads = 1;
+
+#if !COUNT_HEAP_ALLOCATIONS
+	std::cerr << "memory_arena.h has to count heap allocations for this benchmark." << std::endl;
+	return 1;
+#endif
+
+	printf("%8s %12s %12s %14s %14s\n", "objects", "vector ms", "arena ms", "vector allocs", "arena allocs");
+	uint32 counts[] = { 1000, 10000, 100000 };
+	for (uint32 c = 0; c < arraysize(counts); ++c)
+	{
+		uint32 count = counts[c];
+		memory_arena arena;
+		createArena(arena, 0);
+
+		double vectorTime = measureMilliseconds([&]() { vectorFrame(count); });
+		double arenaTime = measureMilliseconds([&]() { arenaFrame(arena, count); });
+
+		uint64 before = getHeapAllocationCount();
+		vectorFrame(count);
+		uint64 vectorAllocations = getHeapAllocationCount() - before;
+		before = getHeapAllocationCount();
+		arenaFrame(arena, count);
+		uint64 arenaAllocations = getHeapAllocationCount() - before;
+
+		printf("%8u %12.3f %12.3f %14llu %14llu\n", count, vectorTime, arenaTime, (unsigned long long)vectorAllocations, (unsigned long long)arenaAllocations);
+		deleteArena(arena);
+	}
+
+	if (!checkJobAllocationsCounted())
+	{
+		std::cerr << "heap allocations of jobs on worker threads were not counted." << std::endl;
+		return 1;
+	}
+
+	printf("\n%8s %8s %14s %14s\n", "draws", "threads", "first frame", "steady frames");
+	for (uint32 threads = 1; threads <= maxThreads; ++threads)
+	{
+		uint32 count = 10000;
+		uint64 firstFrameAllocations = 0, steadyAllocations = 0;
+		if (!measureSteadyFrames(threads, count, firstFrameAllocations, steadyAllocations))
+		{
+			std::cerr << "the merged list of " << threads << " threads lost draws." << std::endl;
+			return 1;
+		}
+
+		printf("%8u %8u %14llu %14llu\n", count, threads, (unsigned long long)firstFrameAllocations, (unsigned long long)steadyAllocations);
+		if (steadyAllocations != 0)
+		{
+			std::cerr << "building a steady frame on " << threads << " threads allocated from the heap." << std::endl;
+			return 1;
+		}
+	}
+
+	return 0;
+}
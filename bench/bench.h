@@ -0,0 +1,36 @@
+#pragma once
+
+// small timing harness shared by the benchmarks in this directory. they only use the GL free parts of the
+// renderer, so they build and run on any platform, e.g.:
+//   g++ -std=c++11 -O2 -mavx2 -mfma bench/culling_bench.cpp culling.cpp -o culling_bench
+
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <cstdio>
+
+#include "../common.h"
+
+
+// runs func until both minIterations and minMilliseconds are reached, returns the fastest run in milliseconds
+template <typename func_t>
+static double measureMilliseconds(func_t func, uint32 minIterations = 10, double minMilliseconds = 200.)
+{
+	double best = 1e30;
+	double total = 0.;
+	for (uint32 i = 0; i < minIterations || total < minMilliseconds; ++i)
+	{
+		// time points are subtracted before converting, a double of the time since the epoch only resolves ~250 ns
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		func();
+		double time = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+		best = time < best ? time : best;
+		total += time;
+	}
+	return best;
+}
+
+// keeps the compiler from optimizing away results
+static volatile uint64 benchSink;
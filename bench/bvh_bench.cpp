@@ -0,0 +1,91 @@
+#include "bench.h"
+
+#include "../bvh.h"
+
+
+static void fillRandomBoxes(std::vector<bounding_box>& boxes, uint32 count, std::mt19937& rng)
+{
+	std::uniform_real_distribution<float> position(-500.f, 500.f);
+	std::uniform_real_distribution<float> size(0.5f, 5.f);
+
+	boxes.resize(count);
+	for (uint32 i = 0; i < count; ++i)
+	{
+		vec3 center(position(rng), position(rng), position(rng));
+		vec3 halfExtent(size(rng), size(rng), size(rng));
+		boxes[i].minCorner = center - halfExtent;
+		boxes[i].maxCorner = center + halfExtent;
+	}
+}
+
+int main()
+{
+	mat4 proj = createProjectionMatrix(degreesToRadians(70.f), 16.f / 9.f, 0.1f, 1000.f);
+	mat4 view = createViewMatrix(vec3(0.f, 2.f, 0.f), quat(vec3(0.f, 1.f, 0.f), degreesToRadians(30.f)));
+	camera_frustum frustum = getWorldSpaceFrustum(proj * view);
+
+	std::mt19937 rng(1234);
+	std::vector<bounding_box> boxes;
+	std::vector<uint32> result, reference;
+	bvh bvh;
+
+	const uint32 numberOfQueries = 1000;
+	std::vector<ray> rays(numberOfQueries);
+	std::vector<bounding_sphere> lights(numberOfQueries);
+	std::uniform_real_distribution<float> position(-500.f, 500.f);
+	for (uint32 i = 0; i < numberOfQueries; ++i)
+	{
+		rays[i].origin = vec3(position(rng), position(rng), position(rng));
+		rays[i].direction = normalized(vec3(position(rng), position(rng), position(rng)));
+		lights[i].center = vec3(position(rng), position(rng), position(rng));
+		lights[i].radius = 30.f;
+	}
+
+	printf("%10s %10s %10s %12s %12s %12s %12s\n", "objects", "build ms", "refit ms", "cull ms", "brute ms", "rays/ms", "lights/ms");
+
+	uint32 counts[] = { 10000, 100000, 1000000 };
+	for (uint32 c = 0; c < arraysize(counts); ++c)
+	{
+		uint32 count = counts[c];
+		fillRandomBoxes(boxes, count, rng);
+		result.resize(count);
+		reference.resize(count);
+
+		double buildTime = measureMilliseconds([&]() { buildBVH(bvh, boxes.data(), count); }, 3);
+		double refitTime = measureMilliseconds([&]() { refitBVH(bvh, boxes.data()); });
+
+		uint32 numberOfVisible = 0, numberOfReference = 0;
+		double cullTime = measureMilliseconds([&]() { numberOfVisible = cullBVH(bvh, frustum, result.data()); });
+		double bruteTime = measureMilliseconds([&]()
+		{
+			numberOfReference = 0;
+			for (uint32 i = 0; i < count; ++i)
+				if (isVisible(frustum, boxes[i]))
+					reference[numberOfReference++] = i;
+		});
+
+		std::sort(result.begin(), result.begin() + numberOfVisible);
+		if (numberOfVisible != numberOfReference || !std::equal(result.begin(), result.begin() + numberOfVisible, reference.begin()))
+		{
+			std::cerr << "BVH and brute force culling disagree for " << count << " objects." << std::endl;
+			return 1;
+		}
+
+		double rayTime = measureMilliseconds([&]()
+		{
+			bvh_hit hit;
+			for (uint32 i = 0; i < numberOfQueries; ++i)
+				benchSink += intersectBVH(bvh, rays[i], FLT_MAX, hit);
+		});
+		double lightTime = measureMilliseconds([&]()
+		{
+			for (uint32 i = 0; i < numberOfQueries; ++i)
+				benchSink += queryBVH(bvh, lights[i], result.data());
+		});
+
+		printf("%10u %10.2f %10.2f %12.3f %12.3f %12.0f %12.0f\n", count, buildTime, refitTime, cullTime, bruteTime,
+			numberOfQueries / rayTime, numberOfQueries / lightTime);
+	}
+
+	return 0;
+}
@@ -0,0 +1,151 @@
+#include "bench.h"
+
+#include <cstdlib>
+#include <cstring>
+
+#include "../job_system.h"
+#include "../command_list.h"
+
+
+// a frame worth of draws, generated once so every run records exactly the same frame
+struct recorded_draw
+{
+	uint32 program, vertexFormat, material;
+	uint32 indexCount, firstIndex;
+	int32 baseVertex;
+	uint32 instanceCount;
+	mat4 MV;
+};
+
+#define DRAWS_PER_LIST 256
+
+struct recording
+{
+	const std::vector<recorded_draw>* draws;
+	std::vector<command_list>* lists;
+};
+
+static void recordDraws(void* data, uint32 begin, uint32 end)
+{
+	recording& rec = *(recording*)data;
+	command_list& list = (*rec.lists)[begin / DRAWS_PER_LIST];
+	for (uint32 i = begin; i < end; ++i)
+	{
+		const recorded_draw& draw = (*rec.draws)[i];
+		draw_instance* instances = recordDraw(list, makeDrawKey(draw.program, draw.vertexFormat, draw.material),
+			draw.indexCount, draw.firstIndex, draw.baseVertex, draw.instanceCount);
+		for (uint32 j = 0; j < draw.instanceCount; ++j)
+		{
+			instances[j].MV = draw.MV;
+			instances[j].materialIndex = draw.material;
+			memset(instances[j].texCoordTransform, 0, sizeof(instances[j].texCoordTransform));
+		}
+	}
+}
+
+// field by field, the structs have padding
+static bool isSameCommandList(const command_list& a, const command_list& b)
+{
+	if (a.draws.size() != b.draws.size() || a.instances.size() != b.instances.size())
+		return false;
+
+	for (uint32 i = 0; i < a.draws.size(); ++i)
+	{
+		const draw_command& x = a.draws[i];
+		const draw_command& y = b.draws[i];
+		if (x.key != y.key || x.indexCount != y.indexCount || x.firstIndex != y.firstIndex || x.baseVertex != y.baseVertex
+			|| x.firstInstance != y.firstInstance || x.instanceCount != y.instanceCount)
+			return false;
+	}
+	for (uint32 i = 0; i < a.instances.size(); ++i)
+	{
+		const draw_instance& x = a.instances[i];
+		const draw_instance& y = b.instances[i];
+		if (memcmp(&x.MV, &y.MV, sizeof(mat4)) != 0 || x.materialIndex != y.materialIndex
+			|| memcmp(x.texCoordTransform, y.texCoordTransform, sizeof(x.texCoordTransform)) != 0)
+			return false;
+	}
+	return true;
+}
+
+// runs with 1 up to the given number of threads, by default one per hardware thread
+int main(int argc, char** argv)
+{
+	uint32 maxThreads = (argc > 1) ? (uint32)atoi(argv[1]) : std::thread::hardware_concurrency();
+	if (maxThreads == 0)
+		maxThreads = 1;
+
+	std::mt19937 rng(1234);
+	std::uniform_int_distribution<uint32> program(0, 15), vertexFormat(0, 1), material(0, 127), instances(1, 4);
+
+	printf("%8s %8s %10s %10s %10s %8s %10s\n", "draws", "threads", "record ms", "merge ms", "replay ms", "batches", "draws/ms");
+
+	uint32 counts[] = { 1000, 10000, 100000 };
+	for (uint32 c = 0; c < arraysize(counts); ++c)
+	{
+		uint32 count = counts[c];
+		std::vector<recorded_draw> draws(count);
+		for (uint32 i = 0; i < count; ++i)
+		{
+			recorded_draw& draw = draws[i];
+			draw.program = program(rng);
+			draw.vertexFormat = vertexFormat(rng);
+			draw.material = material(rng);
+			draw.indexCount = 3 * (1 + rng() % 1000);
+			draw.firstIndex = rng() % 1000000;
+			draw.baseVertex = (int32)(rng() % 100000);
+			draw.instanceCount = (i % 8 == 0) ? instances(rng) : 1;
+			draw.MV = createTranslationMatrix(vec3((float)i, 0.f, 0.f));
+		}
+
+		uint32 numberOfLists = (count + DRAWS_PER_LIST - 1) / DRAWS_PER_LIST;
+		std::vector<command_list> lists(numberOfLists);
+		recording rec = { &draws, &lists };
+
+		command_list merged, reference;
+		std::vector<draw_elements_indirect_command> commands;
+		std::vector<draw_batch> batches;
+
+		for (uint32 threads = 1; threads <= maxThreads; ++threads)
+		{
+			job_system system;
+			startJobSystem(system, threads);
+
+			double recordTime = measureMilliseconds([&]()
+			{
+				for (command_list& list : lists)
+					clearCommandList(list);
+				parallelFor(system, count, DRAWS_PER_LIST, recordDraws, &rec);
+			});
+			double mergeTime = measureMilliseconds([&]() { mergeCommandLists(merged, lists.data(), numberOfLists); });
+
+			// the same frame submitted again, only the executor's side of it
+			double replayTime = measureMilliseconds([&]() { buildDrawBatches(merged, commands, batches); });
+
+			stopJobSystem(system);
+
+			if (threads == 1)
+			{
+				for (uint32 i = 1; i < merged.draws.size(); ++i)
+				{
+					if (merged.draws[i - 1].key >= merged.draws[i].key)
+					{
+						std::cerr << "the merged list of " << count << " draws is not sorted." << std::endl;
+						return 1;
+					}
+				}
+				reference = merged;
+			}
+			else if (!isSameCommandList(merged, reference))
+			{
+				std::cerr << "the merged list of " << threads << " threads differs from the one of a single thread." << std::endl;
+				return 1;
+			}
+
+			printf("%8u %8u %10.3f %10.3f %10.3f %8u %10.0f\n", count, threads, recordTime, mergeTime, replayTime, (uint32)batches.size(),
+				count / (recordTime + mergeTime + replayTime));
+		}
+	}
+
+	return 0;
+}
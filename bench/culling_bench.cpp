@@ -0,0 +1,65 @@
+#include "bench.h"
+
+#include "../culling.h"
+
+
+static void fillRandomSpheres(bounding_sphere_soa& spheres, uint32 count, std::mt19937& rng)
+{
+	std::uniform_real_distribution<float> position(-500.f, 500.f);
+	std::uniform_real_distribution<float> radius(0.5f, 5.f);
+
+	clearBoundingSpheres(spheres);
+	for (uint32 i = 0; i < count; ++i)
+	{
+		bounding_sphere sphere;
+		sphere.center = vec3(position(rng), position(rng), position(rng));
+		sphere.radius = radius(rng);
+		pushBoundingSphere(spheres, sphere);
+	}
+}
+
+int main()
+{
+	mat4 proj = createProjectionMatrix(degreesToRadians(70.f), 16.f / 9.f, 0.1f, 1000.f);
+	mat4 view = createViewMatrix(vec3(0.f, 2.f, 0.f), quat(vec3(0.f, 1.f, 0.f), degreesToRadians(30.f)));
+	camera_frustum frustum = getWorldSpaceFrustum(proj * view);
+
+	std::mt19937 rng(1234);
+	bounding_sphere_soa spheres;
+	std::vector<uint32> visibleScalar, visibleSIMD;
+
+	printf("frustum culling, %u wide SIMD\n", CULLING_SIMD_WIDTH);
+	printf("%10s %10s %16s %16s %8s\n", "objects", "visible", "scalar obj/ms", "SIMD obj/ms", "speedup");
+
+	uint32 counts[] = { 10000, 100000, 1000000 };
+	for (uint32 c = 0; c < arraysize(counts); ++c)
+	{
+		uint32 count = counts[c];
+		fillRandomSpheres(spheres, count, rng);
+		visibleScalar.resize(count);
+		visibleSIMD.resize(count);
+
+		uint32 numberOfVisibleScalar = 0, numberOfVisibleSIMD = 0;
+		double scalarTime = measureMilliseconds([&]()
+		{
+			numberOfVisibleScalar = cullBoundingSpheresScalar(frustum, spheres, visibleScalar.data());
+			benchSink += numberOfVisibleScalar;
+		});
+		double simdTime = measureMilliseconds([&]()
+		{
+			numberOfVisibleSIMD = cullBoundingSpheres(frustum, spheres, visibleSIMD.data());
+			benchSink += numberOfVisibleSIMD;
+		});
+
+		if (numberOfVisibleScalar != numberOfVisibleSIMD
+			|| !std::equal(visibleScalar.begin(), visibleScalar.begin() + numberOfVisibleScalar, visibleSIMD.begin()))
+		{
+			std::cerr << "SIMD and scalar culling disagree for " << count << " objects." << std::endl;
+			return 1;
+		}
+
+		printf("%10u %10u %16.0f %16.0f %7.2fx\n", count, numberOfVisibleSIMD, count / scalarTime, count / simdTime, scalarTime / simdTime);
+	}
+
+	return 0;
+}
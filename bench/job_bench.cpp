@@ -0,0 +1,126 @@
+#include "bench.h"
+
+#include <cstdlib>
+#include <atomic>
+
+#include "../job_system.h"
+#include "../math.h"
+
+
+struct transform_data
+{
+	const vec4* input;
+	vec4* output;
+};
+
+// a few hundred nanoseconds of math per element, roughly what culling or skinning an object costs
+static void transformRange(void* data, uint32 begin, uint32 end)
+{
+	transform_data* transform = (transform_data*)data;
+	mat4 m = createModelMatrix(vec3(1.f, 2.f, 3.f), quat(vec3(0.f, 1.f, 0.f), 0.3f), 1.f);
+	for (uint32 i = begin; i < end; ++i)
+	{
+		vec4 p = transform->input[i];
+		for (uint32 r = 0; r < 16; ++r)
+			p = m * p;
+		transform->output[i] = p;
+	}
+}
+
+struct nested_data
+{
+	job_system* system;
+	transform_data* transform;
+	uint32 numberOfChildren;
+	uint32 childSize;
+};
+
+// a job which fans out into a parallel for and waits for it, like a loader processing the chunks of a mesh
+static void nestedJob(void* data)
+{
+	nested_data* nested = (nested_data*)data;
+	parallelFor(*nested->system, nested->numberOfChildren * nested->childSize, nested->childSize, transformRange, nested->transform);
+}
+
+// the jobs run on all threads at once, so they publish through an atomic instead of the plain benchSink
+static std::atomic<uint64> jobSink(0);
+
+static void emptyJob(void* data)
+{
+	jobSink.fetch_add((uint64)(uintptr_t)data, std::memory_order_relaxed);
+}
+
+// runs with 1 up to the given number of threads, by default one per hardware thread
+int main(int argc, char** argv)
+{
+	uint32 maxThreads = (argc > 1) ? (uint32)atoi(argv[1]) : std::thread::hardware_concurrency();
+	if (maxThreads == 0)
+		maxThreads = 1;
+
+	const uint32 numberOfPoints = 1 << 20;
+	std::vector<vec4> input(numberOfPoints, vec4(1.f, 2.f, 3.f, 1.f));
+	std::vector<vec4> output(numberOfPoints);
+	transform_data transform = { input.data(), output.data() };
+
+	uint32 grainSizes[] = { 64, 1024, 16384 };
+
+	printf("%8s", "threads");
+	for (uint32 g = 0; g < arraysize(grainSizes); ++g)
+		printf(" %9s%-5u %8s", "for ms g", grainSizes[g], "speedup");
+	printf(" %12s %8s %12s\n", "nested ms", "speedup", "ns/job");
+
+	double serialFor[arraysize(grainSizes)] = {};
+	double serialNested = 0.;
+
+	for (uint32 threads = 1; threads <= maxThreads; ++threads)
+	{
+		job_system system;
+		startJobSystem(system, threads);
+
+		printf("%8u", threads);
+		for (uint32 g = 0; g < arraysize(grainSizes); ++g)
+		{
+			double time = measureMilliseconds([&]() { parallelFor(system, numberOfPoints, grainSizes[g], transformRange, &transform); });
+			if (threads == 1)
+				serialFor[g] = time;
+			printf(" %14.2f %8.2f", time, serialFor[g] / time);
+		}
+
+		// 64 jobs of 16 ranges each, scheduled from inside jobs. every job transforms its own part of the points
+		std::vector<nested_data> nested(64);
+		std::vector<transform_data> nestedTransforms(nested.size());
+		std::vector<job> nestedJobs(nested.size());
+		for (uint32 i = 0; i < nested.size(); ++i)
+		{
+			nested[i] = { &system, &nestedTransforms[i], 16, 1024 };
+			uint32 offset = i * nested[i].numberOfChildren * nested[i].childSize;
+			nestedTransforms[i] = { input.data() + offset, output.data() + offset };
+			nestedJobs[i] = { nestedJob, &nested[i] };
+		}
+		double nestedTime = measureMilliseconds([&]()
+		{
+			job_counter counter;
+			submitJobs(system, nestedJobs.data(), (uint32)nestedJobs.size(), &counter);
+			waitForCounter(system, counter);
+		});
+		if (threads == 1)
+			serialNested = nestedTime;
+
+		// scheduling overhead, jobs which do nothing
+		const uint32 numberOfEmptyJobs = 4000;
+		std::vector<job> emptyJobs(numberOfEmptyJobs, job{ emptyJob, 0 });
+		double emptyTime = measureMilliseconds([&]()
+		{
+			job_counter counter;
+			submitJobs(system, emptyJobs.data(), numberOfEmptyJobs, &counter);
+			waitForCounter(system, counter);
+		});
+
+		printf(" %12.2f %8.2f %12.1f\n", nestedTime, serialNested / nestedTime, emptyTime * 1e6 / numberOfEmptyJobs);
+
+		stopJobSystem(system);
+	}
+
+	benchSink += jobSink.load();
+	return 0;
+}
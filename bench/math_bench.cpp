@@ -0,0 +1,167 @@
+#include "bench.h"
+
+#include <cstring>
+
+#include "../math_batch.h"
+
+
+// every benchmark processes this many independent inputs per run, so the loop overhead is amortized
+#define BATCH_SIZE 1024
+
+struct bench_result
+{
+	const char* name;
+	double nsPerOp;
+};
+
+static std::vector<bench_result> results;
+
+// the human readable table, stderr when the JSON goes to stdout
+static FILE* tableOutput = stdout;
+
+template <typename func_t>
+static void run(const char* name, func_t func)
+{
+	double milliseconds = measureMilliseconds(func, 20, 100.);
+	bench_result result = { name, milliseconds * 1e6 / BATCH_SIZE };
+	results.push_back(result);
+
+	fprintf(tableOutput, "%-32s %10.2f ns/op %16.0f ops/s\n", name, result.nsPerOp, 1e9 / result.nsPerOp);
+}
+
+static const char* getInstructionSet()
+{
+#if defined(__AVX2__) && defined(MATH_FMA)
+	return "AVX2+FMA";
+#elif defined(__AVX__)
+	return "AVX";
+#else
+	return "SSE2";
+#endif
+}
+
+static const char* getCompiler()
+{
+#if defined(__clang__)
+	return "clang " __clang_version__;
+#elif defined(__GNUC__)
+	return "gcc " __VERSION__;
+#elif defined(_MSC_VER)
+	return "msvc";
+#else
+	return "unknown";
+#endif
+}
+
+static bool writeJSON(const char* filename)
+{
+	FILE* file = strcmp(filename, "-") == 0 ? stdout : fopen(filename, "w");
+	if (!file)
+	{
+		std::cerr << "Could not open " << filename << " for writing." << std::endl;
+		return false;
+	}
+
+	fprintf(file, "{\n\t\"instruction_set\": \"%s\",\n\t\"compiler\": \"%s\",\n\t\"batch_size\": %u,\n\t\"results\": [\n",
+		getInstructionSet(), getCompiler(), BATCH_SIZE);
+	for (uint32 i = 0; i < results.size(); ++i)
+	{
+		fprintf(file, "\t\t{ \"name\": \"%s\", \"ns_per_op\": %.4f, \"ops_per_s\": %.0f }%s\n",
+			results[i].name, results[i].nsPerOp, 1e9 / results[i].nsPerOp, i + 1 < results.size() ? "," : "");
+	}
+	fprintf(file, "\t]\n}\n");
+
+	if (file != stdout)
+		fclose(file);
+	return true;
+}
+
+// usage: math_bench [--json <file or - for stdout>]
+int main(int argc, char** argv)
+{
+	const char* jsonFile = 0;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (strcmp(argv[i], "--json") == 0 && i + 1 < argc)
+			jsonFile = argv[++i];
+	}
+
+	std::mt19937 rng(1234);
+	std::uniform_real_distribution<float> random(-1.f, 1.f);
+
+	std::vector<mat4> matA(BATCH_SIZE), matB(BATCH_SIZE), matOut(BATCH_SIZE);
+	std::vector<mat3> mat3Out(BATCH_SIZE);
+	std::vector<vec4> vecA(BATCH_SIZE), vecOut4(BATCH_SIZE);
+	std::vector<vec3> vec3A(BATCH_SIZE), vec3Out(BATCH_SIZE);
+	std::vector<quat> quatA(BATCH_SIZE), quatB(BATCH_SIZE), quatOut(BATCH_SIZE);
+	std::vector<SQT> sqts(BATCH_SIZE);
+	std::vector<float> floats(BATCH_SIZE);
+	std::vector<float> x(BATCH_SIZE), y(BATCH_SIZE), z(BATCH_SIZE), outX(BATCH_SIZE), outY(BATCH_SIZE), outZ(BATCH_SIZE);
+	std::vector<float> qx(BATCH_SIZE), qy(BATCH_SIZE), qz(BATCH_SIZE), qw(BATCH_SIZE);
+
+	for (uint32 i = 0; i < BATCH_SIZE; ++i)
+	{
+		vec3A[i] = vec3(random(rng), random(rng), random(rng)) * 10.f;
+		vecA[i] = vec4(vec3A[i], 1.f);
+		quatA[i] = quat(normalized(vec3(random(rng), random(rng), random(rng))), random(rng) * M_PI);
+		quatB[i] = quat(normalized(vec3(random(rng), random(rng), random(rng))), random(rng) * M_PI);
+		sqts[i] = SQT(vec3A[i], quatA[i], 1.f + random(rng) * 0.5f);
+		floats[i] = random(rng) * 0.5f + 0.5f;
+
+		// well conditioned matrices, so inversion benchmarks the common case
+		matA[i] = sqtToMat4(sqts[i]);
+		matB[i] = createProjectionMatrix(degreesToRadians(70.f), 1.f + floats[i], 0.1f, 100.f) * matA[i];
+
+		x[i] = vec3A[i].x; y[i] = vec3A[i].y; z[i] = vec3A[i].z;
+		qx[i] = quatA[i].x; qy[i] = quatA[i].y; qz[i] = quatA[i].z; qw[i] = quatA[i].w;
+	}
+
+	if (jsonFile && strcmp(jsonFile, "-") == 0)
+		tableOutput = stderr;
+
+	fprintf(tableOutput, "math.h microbenchmarks, %s, %s\n\n", getInstructionSet(), getCompiler());
+
+	// mat4
+	run("mat4 * mat4", [&]() { for (uint32 i = 0; i < BATCH_SIZE; ++i) matOut[i] = matA[i] * matB[i]; });
+	run("mat4 * mat4 (scalar)", [&]() { for (uint32 i = 0; i < BATCH_SIZE; ++i) matOut[i] = mulScalar(matA[i], matB[i]); });
+	run("mat4 * vec4", [&]() { for (uint32 i = 0; i < BATCH_SIZE; ++i) vecOut4[i] = matB[i] * vecA[i]; });
+	run("mat4 * vec4 (scalar)", [&]() { for (uint32 i = 0; i < BATCH_SIZE; ++i) vecOut4[i] = mulScalar(matB[i], vecA[i]); });
+	run("inverted(mat4)", [&]() { for (uint32 i = 0; i < BATCH_SIZE; ++i) matOut[i] = inverted(matB[i]); });
+	run("inverted(mat4) (scalar)", [&]() { for (uint32 i = 0; i < BATCH_SIZE; ++i) matOut[i] = invertedScalar(matB[i]); });
+	run("invertedAffine(mat4)", [&]() { for (uint32 i = 0; i < BATCH_SIZE; ++i) matOut[i] = invertedAffine(matA[i]); });
+	run("transposed(mat4)", [&]() { for (uint32 i = 0; i < BATCH_SIZE; ++i) matOut[i] = transposed(matA[i]); });
+	run("createViewMatrix(pitch, yaw)", [&]() { for (uint32 i = 0; i < BATCH_SIZE; ++i) matOut[i] = createViewMatrix(vec3A[i], floats[i], -floats[i]); });
+	run("createViewMatrix(quat)", [&]() { for (uint32 i = 0; i < BATCH_SIZE; ++i) matOut[i] = createViewMatrix(vec3A[i], quatA[i]); });
+	run("createModelMatrix", [&]() { for (uint32 i = 0; i < BATCH_SIZE; ++i) matOut[i] = createModelMatrix(vec3A[i], quatA[i], floats[i]); });
+	run("sqtToMat4", [&]() { for (uint32 i = 0; i < BATCH_SIZE; ++i) matOut[i] = sqtToMat4(sqts[i]); });
+
+	// quat
+	run("quaternionToMat3", [&]() { for (uint32 i = 0; i < BATCH_SIZE; ++i) mat3Out[i] = quaternionToMat3(quatA[i]); });
+	run("quat * quat", [&]() { for (uint32 i = 0; i < BATCH_SIZE; ++i) quatOut[i] = quatA[i] * quatB[i]; });
+	run("quat * vec3", [&]() { for (uint32 i = 0; i < BATCH_SIZE; ++i) vec3Out[i] = quatA[i] * vec3A[i]; });
+	run("rotate(quat, vec3)", [&]() { for (uint32 i = 0; i < BATCH_SIZE; ++i) vec3Out[i] = rotate(quatA[i], vec3A[i]); });
+	run("slerp(quat)", [&]() { for (uint32 i = 0; i < BATCH_SIZE; ++i) quatOut[i] = slerp(quatA[i], quatB[i], floats[i]); });
+	run("slerp(SQT)", [&]() { for (uint32 i = 0; i < BATCH_SIZE; ++i) sqts[i] = slerp(sqts[i], sqts[BATCH_SIZE - 1 - i], 0.f); });
+
+	// batch kernels, per element
+	run("transformPoints AoS", [&]() { transformPoints(matB[0], vec3A.data(), vec3Out.data(), BATCH_SIZE); });
+	run("transformPoints AoS (scalar)", [&]() { transformPointsScalar(matB[0], vec3A.data(), vec3Out.data(), BATCH_SIZE); });
+	run("transformPoints SoA", [&]() { transformPoints(matB[0], x.data(), y.data(), z.data(), outX.data(), outY.data(), outZ.data(), BATCH_SIZE); });
+	run("transformPoints SoA (scalar)", [&]() { transformPointsScalar(matB[0], x.data(), y.data(), z.data(), outX.data(), outY.data(), outZ.data(), BATCH_SIZE); });
+	run("rotateVectors AoS", [&]() { rotateVectors(quatA.data(), vec3A.data(), vec3Out.data(), BATCH_SIZE); });
+	run("rotateVectors AoS (scalar)", [&]() { rotateVectorsScalar(quatA.data(), vec3A.data(), vec3Out.data(), BATCH_SIZE); });
+	run("rotateVectors SoA", [&]() { rotateVectors(qx.data(), qy.data(), qz.data(), qw.data(), x.data(), y.data(), z.data(), outX.data(), outY.data(), outZ.data(), BATCH_SIZE); });
+	run("sqtsToMat4s", [&]() { sqtsToMat4s(matA[0], sqts.data(), matOut.data(), BATCH_SIZE); });
+	run("sqtsToMat4s (scalar)", [&]() { sqtsToMat4sScalar(matA[0], sqts.data(), matOut.data(), BATCH_SIZE); });
+
+	// touch all outputs, so nothing above is optimized away
+	for (uint32 i = 0; i < BATCH_SIZE; ++i)
+	{
+		benchSink += (uint64)(matOut[i].m00 + mat3Out[i].m00 + vecOut4[i].x + vec3Out[i].x + quatOut[i].x + outX[i] + sqts[i].scale);
+	}
+
+	if (jsonFile && !writeJSON(jsonFile))
+		return 1;
+
+	return 0;
+}
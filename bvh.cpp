@@ -0,0 +1,395 @@
+#include "bvh.h"
+
+
+static inline void growBoundingBox(bounding_box& box, const bounding_box& other)
+{
+	growBoundingBox(box, other.minCorner);
+	growBoundingBox(box, other.maxCorner);
+}
+
+static inline float getSurfaceArea(const bounding_box& box)
+{
+	vec3 e = box.maxCorner - box.minCorner;
+	return 2.f * (e.x * e.y + e.y * e.z + e.z * e.x);
+}
+
+static inline float getCentroid(const bounding_box& box, uint32 axis)
+{
+	return (box.minCorner.xyz[axis] + box.maxCorner.xyz[axis]) * 0.5f;
+}
+
+struct bvh_bin
+{
+	bounding_box bounds;
+	uint32 count;
+};
+
+struct bvh_builder
+{
+	bvh* tree;
+	const bounding_box* primitiveBounds;
+};
+
+// returns the index of the created node
+static uint32 buildNode(bvh_builder& builder, uint32 first, uint32 count)
+{
+	bvh& bvh = *builder.tree;
+	uint32* indices = &bvh.primitiveIndices[first];
+
+	uint32 nodeIndex = (uint32)bvh.nodes.size();
+	bvh.nodes.push_back(bvh_node());
+
+	bounding_box bounds = emptyBoundingBox();
+	bounding_box centroidBounds = emptyBoundingBox();
+	for (uint32 i = 0; i < count; ++i)
+	{
+		const bounding_box& box = builder.primitiveBounds[indices[i]];
+		growBoundingBox(bounds, box);
+		growBoundingBox(centroidBounds, (box.minCorner + box.maxCorner) * 0.5f);
+	}
+	bvh.nodes[nodeIndex].bounds = bounds;
+
+	// find the cheapest binned split over all axes
+	float bestCost = FLT_MAX;
+	uint32 bestAxis = 0;
+	uint32 bestSplit = 0;
+	if (count > BVH_MAX_LEAF_SIZE)
+	{
+		for (uint32 axis = 0; axis < 3; ++axis)
+		{
+			float lower = centroidBounds.minCorner.xyz[axis];
+			float extent = centroidBounds.maxCorner.xyz[axis] - lower;
+			if (extent <= 0.f)
+				continue;
+
+			bvh_bin bins[BVH_NUMBER_OF_BINS];
+			for (uint32 b = 0; b < BVH_NUMBER_OF_BINS; ++b)
+			{
+				bins[b].bounds = emptyBoundingBox();
+				bins[b].count = 0;
+			}
+
+			float scale = BVH_NUMBER_OF_BINS / extent;
+			for (uint32 i = 0; i < count; ++i)
+			{
+				const bounding_box& box = builder.primitiveBounds[indices[i]];
+				uint32 b = min((uint32)((getCentroid(box, axis) - lower) * scale), BVH_NUMBER_OF_BINS - 1);
+				growBoundingBox(bins[b].bounds, box);
+				++bins[b].count;
+			}
+
+			// sweep from the right to get the cost of every right side, then from the left
+			float rightArea[BVH_NUMBER_OF_BINS];
+			uint32 rightCount[BVH_NUMBER_OF_BINS];
+			bounding_box rightBounds = emptyBoundingBox();
+			uint32 numberRight = 0;
+			for (uint32 b = BVH_NUMBER_OF_BINS - 1; b > 0; --b)
+			{
+				numberRight += bins[b].count;
+				if (bins[b].count > 0)
+					growBoundingBox(rightBounds, bins[b].bounds);
+				rightArea[b] = numberRight > 0 ? getSurfaceArea(rightBounds) : 0.f;
+				rightCount[b] = numberRight;
+			}
+
+			bounding_box leftBounds = emptyBoundingBox();
+			uint32 numberLeft = 0;
+			for (uint32 b = 0; b < BVH_NUMBER_OF_BINS - 1; ++b)
+			{
+				numberLeft += bins[b].count;
+				if (bins[b].count > 0)
+					growBoundingBox(leftBounds, bins[b].bounds);
+
+				if (numberLeft == 0 || rightCount[b + 1] == 0)
+					continue;
+
+				float cost = numberLeft * getSurfaceArea(leftBounds) + rightCount[b + 1] * rightArea[b + 1];
+				if (cost < bestCost)
+				{
+					bestCost = cost;
+					bestAxis = axis;
+					bestSplit = b + 1;
+				}
+			}
+		}
+	}
+
+	// stay a leaf if splitting is not cheaper than intersecting all primitives
+	float leafCost = count * getSurfaceArea(bounds);
+	if (count <= BVH_MAX_LEAF_SIZE || bestCost == FLT_MAX || (bestCost >= leafCost && count <= 4 * BVH_MAX_LEAF_SIZE))
+	{
+		bvh.nodes[nodeIndex].offset = first;
+		bvh.nodes[nodeIndex].count = count;
+		return nodeIndex;
+	}
+
+	float lower = centroidBounds.minCorner.xyz[bestAxis];
+	float scale = BVH_NUMBER_OF_BINS / (centroidBounds.maxCorner.xyz[bestAxis] - lower);
+	uint32* middle = std::partition(indices, indices + count, [&](uint32 index)
+	{
+		uint32 b = min((uint32)((getCentroid(builder.primitiveBounds[index], bestAxis) - lower) * scale), BVH_NUMBER_OF_BINS - 1);
+		return b < bestSplit;
+	});
+	uint32 leftCount = (uint32)(middle - indices);
+
+	buildNode(builder, first, leftCount);
+	uint32 rightChild = buildNode(builder, first + leftCount, count - leftCount);
+
+	bvh.nodes[nodeIndex].offset = rightChild;
+	bvh.nodes[nodeIndex].count = 0;
+	return nodeIndex;
+}
+
+void buildBVH(bvh& bvh, const bounding_box* primitiveBounds, uint32 numberOfPrimitives)
+{
+	bvh.nodes.clear();
+	bvh.primitiveBounds.clear();
+	bvh.primitiveIndices.resize(numberOfPrimitives);
+	for (uint32 i = 0; i < numberOfPrimitives; ++i)
+		bvh.primitiveIndices[i] = i;
+
+	if (numberOfPrimitives == 0)
+		return;
+
+	bvh.nodes.reserve(2 * numberOfPrimitives);
+
+	bvh_builder builder = { &bvh, primitiveBounds };
+	buildNode(builder, 0, numberOfPrimitives);
+
+	bvh.primitiveBounds.resize(numberOfPrimitives);
+	for (uint32 i = 0; i < numberOfPrimitives; ++i)
+		bvh.primitiveBounds[i] = primitiveBounds[bvh.primitiveIndices[i]];
+}
+
+void refitBVH(bvh& bvh, const bounding_box* primitiveBounds)
+{
+	for (uint32 i = 0; i < bvh.primitiveIndices.size(); ++i)
+		bvh.primitiveBounds[i] = primitiveBounds[bvh.primitiveIndices[i]];
+
+	// children always come after their parent, so walking backwards visits them first
+	for (uint32 i = (uint32)bvh.nodes.size(); i-- > 0;)
+	{
+		bvh_node& node = bvh.nodes[i];
+		node.bounds = emptyBoundingBox();
+		if (node.count > 0)
+		{
+			for (uint32 p = node.offset; p < node.offset + node.count; ++p)
+				growBoundingBox(node.bounds, bvh.primitiveBounds[p]);
+		}
+		else
+		{
+			growBoundingBox(node.bounds, bvh.nodes[i + 1].bounds);
+			growBoundingBox(node.bounds, bvh.nodes[node.offset].bounds);
+		}
+	}
+}
+
+enum frustum_test_result
+{
+	FRUSTUM_OUTSIDE,
+	FRUSTUM_INTERSECTING,
+	FRUSTUM_INSIDE,
+};
+
+static frustum_test_result testFrustum(const camera_frustum& frustum, const bounding_box& box)
+{
+	frustum_test_result result = FRUSTUM_INSIDE;
+	for (uint32 i = 0; i < 6; ++i)
+	{
+		const vec4& plane = frustum.planes[i];
+
+		// corners furthest along and against the plane normal
+		vec3 p(
+			plane.x > 0.f ? box.maxCorner.x : box.minCorner.x,
+			plane.y > 0.f ? box.maxCorner.y : box.minCorner.y,
+			plane.z > 0.f ? box.maxCorner.z : box.minCorner.z);
+		vec3 n(
+			plane.x > 0.f ? box.minCorner.x : box.maxCorner.x,
+			plane.y > 0.f ? box.minCorner.y : box.maxCorner.y,
+			plane.z > 0.f ? box.minCorner.z : box.maxCorner.z);
+
+		if (dot(plane.xyz, p) + plane.w < 0.f)
+			return FRUSTUM_OUTSIDE;
+		if (dot(plane.xyz, n) + plane.w < 0.f)
+			result = FRUSTUM_INTERSECTING;
+	}
+	return result;
+}
+
+#define BVH_STACK_SIZE 64
+
+static uint32 appendAllPrimitives(const bvh& bvh, uint32 nodeIndex, uint32* result, uint32 numberOfResults)
+{
+	// the primitives of a subtree are contiguous, from the first leaf to the last leaf
+	uint32 lastNode = nodeIndex;
+	while (bvh.nodes[lastNode].count == 0)
+		lastNode = bvh.nodes[lastNode].offset;
+	uint32 firstNode = nodeIndex;
+	while (bvh.nodes[firstNode].count == 0)
+		++firstNode;
+
+	uint32 begin = bvh.nodes[firstNode].offset;
+	uint32 end = bvh.nodes[lastNode].offset + bvh.nodes[lastNode].count;
+	for (uint32 i = begin; i < end; ++i)
+		result[numberOfResults++] = bvh.primitiveIndices[i];
+	return numberOfResults;
+}
+
+uint32 cullBVH(const bvh& bvh, const camera_frustum& frustum, uint32* result)
+{
+	if (bvh.nodes.size() == 0)
+		return 0;
+
+	uint32 numberOfResults = 0;
+	uint32 stack[BVH_STACK_SIZE];
+	uint32 stackSize = 0;
+	stack[stackSize++] = 0;
+
+	while (stackSize > 0)
+	{
+		uint32 nodeIndex = stack[--stackSize];
+		const bvh_node& node = bvh.nodes[nodeIndex];
+
+		frustum_test_result test = testFrustum(frustum, node.bounds);
+		if (test == FRUSTUM_OUTSIDE)
+			continue;
+
+		if (test == FRUSTUM_INSIDE)
+		{
+			numberOfResults = appendAllPrimitives(bvh, nodeIndex, result, numberOfResults);
+		}
+		else if (node.count > 0)
+		{
+			for (uint32 i = node.offset; i < node.offset + node.count; ++i)
+			{
+				if (isVisible(frustum, bvh.primitiveBounds[i]))
+					result[numberOfResults++] = bvh.primitiveIndices[i];
+			}
+		}
+		else
+		{
+			assert(stackSize + 2 <= BVH_STACK_SIZE);
+			stack[stackSize++] = node.offset;
+			stack[stackSize++] = nodeIndex + 1;
+		}
+	}
+	return numberOfResults;
+}
+
+static inline bool intersects(const bounding_box& box, const bounding_sphere& sphere)
+{
+	// squared distance from the sphere center to the closest point in the box
+	float distanceSquared = 0.f;
+	for (uint32 axis = 0; axis < 3; ++axis)
+	{
+		float c = sphere.center.xyz[axis];
+		float d = c - clamp(c, box.minCorner.xyz[axis], box.maxCorner.xyz[axis]);
+		distanceSquared += d * d;
+	}
+	return distanceSquared <= sphere.radius * sphere.radius;
+}
+
+uint32 queryBVH(const bvh& bvh, const bounding_sphere& sphere, uint32* result)
+{
+	if (bvh.nodes.size() == 0)
+		return 0;
+
+	uint32 numberOfResults = 0;
+	uint32 stack[BVH_STACK_SIZE];
+	uint32 stackSize = 0;
+	stack[stackSize++] = 0;
+
+	while (stackSize > 0)
+	{
+		uint32 nodeIndex = stack[--stackSize];
+		const bvh_node& node = bvh.nodes[nodeIndex];
+		if (!intersects(node.bounds, sphere))
+			continue;
+
+		if (node.count > 0)
+		{
+			for (uint32 i = node.offset; i < node.offset + node.count; ++i)
+			{
+				if (intersects(bvh.primitiveBounds[i], sphere))
+					result[numberOfResults++] = bvh.primitiveIndices[i];
+			}
+		}
+		else
+		{
+			assert(stackSize + 2 <= BVH_STACK_SIZE);
+			stack[stackSize++] = node.offset;
+			stack[stackSize++] = nodeIndex + 1;
+		}
+	}
+	return numberOfResults;
+}
+
+// slab test, returns the entry distance or FLT_MAX on a miss
+static inline float intersectRayBox(const vec3& origin, const vec3& invDirection, const bounding_box& box, float maxDistance)
+{
+	float tmin = 0.f;
+	float tmax = maxDistance;
+	for (uint32 axis = 0; axis < 3; ++axis)
+	{
+		float t0 = (box.minCorner.xyz[axis] - origin.xyz[axis]) * invDirection.xyz[axis];
+		float t1 = (box.maxCorner.xyz[axis] - origin.xyz[axis]) * invDirection.xyz[axis];
+		tmin = max(tmin, min(t0, t1));
+		tmax = min(tmax, max(t0, t1));
+	}
+	return tmin <= tmax ? tmin : FLT_MAX;
+}
+
+bool intersectBVH(const bvh& bvh, const ray& ray, float maxDistance, bvh_hit& hit)
+{
+	if (bvh.nodes.size() == 0)
+		return false;
+
+	vec3 invDirection(1.f / ray.direction.x, 1.f / ray.direction.y, 1.f / ray.direction.z);
+
+	hit.distance = maxDistance;
+	bool result = false;
+
+	uint32 stack[BVH_STACK_SIZE];
+	uint32 stackSize = 0;
+	if (intersectRayBox(ray.origin, invDirection, bvh.nodes[0].bounds, maxDistance) != FLT_MAX)
+		stack[stackSize++] = 0;
+
+	while (stackSize > 0)
+	{
+		uint32 nodeIndex = stack[--stackSize];
+		const bvh_node& node = bvh.nodes[nodeIndex];
+
+		if (node.count > 0)
+		{
+			for (uint32 i = node.offset; i < node.offset + node.count; ++i)
+			{
+				float distance = intersectRayBox(ray.origin, invDirection, bvh.primitiveBounds[i], hit.distance);
+				if (distance < hit.distance)
+				{
+					hit.distance = distance;
+					hit.primitive = bvh.primitiveIndices[i];
+					result = true;
+				}
+			}
+			continue;
+		}
+
+		// visit the closer child first, so hits there can cull the other one
+		uint32 left = nodeIndex + 1;
+		uint32 right = node.offset;
+		float leftDistance = intersectRayBox(ray.origin, invDirection, bvh.nodes[left].bounds, hit.distance);
+		float rightDistance = intersectRayBox(ray.origin, invDirection, bvh.nodes[right].bounds, hit.distance);
+		if (leftDistance > rightDistance)
+		{
+			std::swap(left, right);
+			std::swap(leftDistance, rightDistance);
+		}
+
+		assert(stackSize + 2 <= BVH_STACK_SIZE);
+		if (rightDistance != FLT_MAX)
+			stack[stackSize++] = right;
+		if (leftDistance != FLT_MAX)
+			stack[stackSize++] = left;
+	}
+	return result;
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+
+#include "common.h"
+#include "math.h"
+#include "culling.h"
+
+
+// nodes are stored depth first, so the left child of an inner node always directly follows it
+struct bvh_node
+{
+	bounding_box bounds;
+	uint32 offset; // leaf: first entry in primitiveIndices, inner node: index of the right child
+	uint32 count; // number of primitives, 0 for inner nodes
+};
+
+struct bvh
+{
+	std::vector<bvh_node> nodes;
+
+	// in leaf order, so the primitives of a leaf are contiguous in memory
+	std::vector<uint32> primitiveIndices;
+	std::vector<bounding_box> primitiveBounds;
+};
+
+struct ray
+{
+	vec3 origin;
+	vec3 direction;
+};
+
+struct bvh_hit
+{
+	uint32 primitive;
+	float distance;
+};
+
+#define BVH_MAX_LEAF_SIZE 4
+#define BVH_NUMBER_OF_BINS 12
+
+// builds the hierarchy with the surface area heuristic. primitives are identified by their index into primitiveBounds
+void buildBVH(bvh& bvh, const bounding_box* primitiveBounds, uint32 numberOfPrimitives);
+
+// updates the node bounds after primitives moved, keeping the topology. primitiveBounds is indexed as in buildBVH. this is much cheaper than a rebuild, but the
+// tree gets worse the further primitives move from where they were at build time
+void refitBVH(bvh& bvh, const bounding_box* primitiveBounds);
+
+// all queries return primitive indices. result needs room for one index per primitive
+uint32 cullBVH(const bvh& bvh, const camera_frustum& frustum, uint32* result);
+uint32 queryBVH(const bvh& bvh, const bounding_sphere& sphere, uint32* result);
+
+// closest primitive whose bounding box is hit by the ray, closer than maxDistance
+bool intersectBVH(const bvh& bvh, const ray& ray, float maxDistance, bvh_hit& hit);
+
+static inline bounding_box sphereToBoundingBox(const bounding_sphere& sphere)
+{
+	bounding_box result;
+	result.minCorner = sphere.center - vec3(sphere.radius);
+	result.maxCorner = sphere.center + vec3(sphere.radius);
+	return result;
+}
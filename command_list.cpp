@@ -0,0 +1,118 @@
+#include "command_list.h"
+
+#include <cstring>
+
+
+void clearCommandList(command_list& list)
+{
+	list.draws.clear();
+	list.instances.clear();
+}
+
+draw_instance* recordDraw(command_list& list, uint64 key, uint32 indexCount, uint32 firstIndex, int32 baseVertex, uint32 instanceCount)
+{
+	draw_command draw;
+	draw.key = key & DRAW_KEY_STATE_MASK;
+	draw.indexCount = indexCount;
+	draw.firstIndex = firstIndex;
+	draw.baseVertex = baseVertex;
+	draw.firstInstance = (uint32)list.instances.size();
+	draw.instanceCount = instanceCount;
+	list.draws.push_back(draw);
+
+	list.instances.resize(list.instances.size() + instanceCount);
+	return list.instances.data() + draw.firstInstance;
+}
+
+// least significant digit first, 8 bits per pass over the state bits. every pass is stable, so keys with the same
+// state keep their order. passes where all keys have the same digit are skipped
+static void radixSortKeys(std::vector<uint64>& keys, std::vector<uint64>& scratch)
+{
+	uint32 count = (uint32)keys.size();
+	scratch.resize(count);
+
+	for (uint32 shift = 32; shift < 64; shift += 8)
+	{
+		uint32 offsets[256] = { 0 };
+		for (uint32 i = 0; i < count; ++i)
+			++offsets[(keys[i] >> shift) & 0xFF];
+		if (count == 0 || offsets[(keys[0] >> shift) & 0xFF] == count)
+			continue;
+
+		uint32 sum = 0;
+		for (uint32 d = 0; d < 256; ++d)
+		{
+			uint32 digitCount = offsets[d];
+			offsets[d] = sum;
+			sum += digitCount;
+		}
+		for (uint32 i = 0; i < count; ++i)
+			scratch[offsets[(keys[i] >> shift) & 0xFF]++] = keys[i];
+		keys.swap(scratch);
+	}
+}
+
+void mergeCommandLists(command_list& result, const command_list* lists, uint32 numberOfLists)
+{
+	uint32 numberOfDraws = 0, numberOfInstances = 0;
+	for (uint32 l = 0; l < numberOfLists; ++l)
+	{
+		numberOfDraws += (uint32)lists[l].draws.size();
+		numberOfInstances += (uint32)lists[l].instances.size();
+	}
+
+	result.unsortedDraws.resize(numberOfDraws);
+	result.sortedKeys.resize(numberOfDraws);
+	result.instances.resize(numberOfInstances);
+
+	uint32 drawOffset = 0, instanceOffset = 0;
+	for (uint32 l = 0; l < numberOfLists; ++l)
+	{
+		const command_list& list = lists[l];
+		for (uint32 i = 0; i < list.draws.size(); ++i)
+		{
+			draw_command& draw = result.unsortedDraws[drawOffset + i];
+			draw = list.draws[i];
+			draw.key = (draw.key & DRAW_KEY_STATE_MASK) | (drawOffset + i);
+			draw.firstInstance += instanceOffset;
+			result.sortedKeys[drawOffset + i] = draw.key;
+		}
+		if (!list.instances.empty())
+			memcpy(&result.instances[instanceOffset], list.instances.data(), list.instances.size() * sizeof(draw_instance));
+
+		drawOffset += (uint32)list.draws.size();
+		instanceOffset += (uint32)list.instances.size();
+	}
+
+	// the low bits are the position the draw was merged at, which leads back to it
+	radixSortKeys(result.sortedKeys, result.sortScratch);
+	result.draws.resize(numberOfDraws);
+	for (uint32 i = 0; i < numberOfDraws; ++i)
+		result.draws[i] = result.unsortedDraws[result.sortedKeys[i] & ~DRAW_KEY_STATE_MASK];
+}
+
+void buildDrawBatches(const command_list& list, std::vector<draw_elements_indirect_command>& commands, std::vector<draw_batch>& batches)
+{
+	commands.resize(list.draws.size());
+	batches.clear();
+
+	for (uint32 i = 0; i < list.draws.size(); ++i)
+	{
+		const draw_command& draw = list.draws[i];
+		draw_elements_indirect_command& command = commands[i];
+		command.count = draw.indexCount;
+		command.instanceCount = draw.instanceCount;
+		command.firstIndex = draw.firstIndex;
+		command.baseVertex = draw.baseVertex;
+		command.baseInstance = draw.firstInstance;
+
+		uint32 program = getDrawKeyProgram(draw.key);
+		uint32 vertexFormat = getDrawKeyVertexFormat(draw.key);
+		if (batches.empty() || batches.back().program != program || batches.back().vertexFormat != vertexFormat)
+		{
+			draw_batch batch = { program, vertexFormat, i, 0 };
+			batches.push_back(batch);
+		}
+		++batches.back().numberOfCommands;
+	}
+}
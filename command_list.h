@@ -0,0 +1,84 @@
+#pragma once
+
+#include <vector>
+
+#include "common.h"
+#include "math.h"
+
+// layout matches the command struct expected by glMultiDrawElementsIndirect
+struct draw_elements_indirect_command
+{
+	uint32 count;
+	uint32 instanceCount;
+	uint32 firstIndex;
+	int32 baseVertex;
+	uint32 baseInstance;
+};
+
+// per draw data, read as instanced vertex attributes. baseInstance of the command selects the entry
+struct draw_instance
+{
+	mat4 MV;
+	uint32 materialIndex;
+	float texCoordTransform[4];
+};
+
+// the state a draw needs is packed into its sort key, most expensive to change first. the low bits are the position
+// in the merged list, so equal state keeps the order it was recorded in
+#define DRAW_KEY_PROGRAM_SHIFT 56
+#define DRAW_KEY_VERTEX_FORMAT_SHIFT 48
+#define DRAW_KEY_MATERIAL_SHIFT 32
+#define DRAW_KEY_STATE_MASK 0xFFFFFFFF00000000ull
+
+static inline uint64 makeDrawKey(uint32 program, uint32 vertexFormat, uint32 material)
+{
+	return ((uint64)(program & 0xFF) << DRAW_KEY_PROGRAM_SHIFT) | ((uint64)(vertexFormat & 0xFF) << DRAW_KEY_VERTEX_FORMAT_SHIFT)
+		| ((uint64)(material & 0xFFFF) << DRAW_KEY_MATERIAL_SHIFT);
+}
+
+static inline uint32 getDrawKeyProgram(uint64 key) { return (uint32)(key >> DRAW_KEY_PROGRAM_SHIFT) & 0xFF; }
+static inline uint32 getDrawKeyVertexFormat(uint64 key) { return (uint32)(key >> DRAW_KEY_VERTEX_FORMAT_SHIFT) & 0xFF; }
+
+// a recorded draw. program, vertex format and material are indices into whatever the executor binds for them, the
+// transforms are in the instances, so a list never touches gl and can be recorded on any thread
+struct draw_command
+{
+	uint64 key;
+	uint32 indexCount;
+	uint32 firstIndex;
+	int32 baseVertex;
+	uint32 firstInstance;	// in the instances of the list
+	uint32 instanceCount;
+};
+
+struct command_list
+{
+	std::vector<draw_command> draws;
+	std::vector<draw_instance> instances;
+
+	// scratch of mergeCommandLists, which radix sorts the keys and then gathers the draws
+	std::vector<draw_command> unsortedDraws;
+	std::vector<uint64> sortedKeys;
+	std::vector<uint64> sortScratch;
+};
+
+// consecutive draws of a sorted list with the same program and vertex format, submitted as one multi draw
+struct draw_batch
+{
+	uint32 program;
+	uint32 vertexFormat;
+	uint32 firstCommand;
+	uint32 numberOfCommands;
+};
+
+void clearCommandList(command_list& list);
+
+// returns the instanceCount instances of the draw, for the caller to fill in
+draw_instance* recordDraw(command_list& list, uint64 key, uint32 indexCount, uint32 firstIndex, int32 baseVertex, uint32 instanceCount);
+
+// appends the lists in order and sorts the result by state. the result only depends on the lists, not on which
+// thread recorded them when
+void mergeCommandLists(command_list& result, const command_list* lists, uint32 numberOfLists);
+
+// the indirect commands of a sorted list, in its order, and the batches they form
+void buildDrawBatches(const command_list& list, std::vector<draw_elements_indirect_command>& commands, std::vector<draw_batch>& batches);
@@ -140,19 +140,36 @@ inline bool buttonUpEvent(raw_input& input, char c)
 }
 
 
+// FNV-1a. pass the previous result as seed to hash several pieces of data as one
+#define HASH_SEED 14695981039346656037ull
+
+inline uint64 hashBytes(const void* data, uint64 size, uint64 hash = HASH_SEED)
+{
+	const uint8* bytes = (const uint8*)data;
+	for (uint64 i = 0; i < size; ++i)
+		hash = (hash ^ bytes[i]) * 1099511628211ull;
+	return hash;
+}
+
+
 // file IO
 struct input_file
 {
 	const char* filename;
 	uint64 size;
-	void* contents;
+	const void* contents; // mapped read only, valid until freeFile. 0 if the file could not be read, never for empty files
 };
 
 input_file readFile(const char* filename);
 void freeFile(input_file file);
+bool writeFile(const char* filename, const void* data, uint64 size);
 uint64 getFileWriteTime(const char* filename);
 
-#if 1
+// hints that a file or a range of a mapped file will be read soon. returns immediately, the os reads in the background
+void prefetchFile(const char* filename);
+void prefetchFile(const input_file& file, uint64 offset, uint64 size);
+
+#if defined(_WIN32)
 
 #include <Windows.h>
 
@@ -0,0 +1,219 @@
+#include "culling.h"
+
+#include <immintrin.h>
+
+
+static inline vec4 getRow(const mat4& m, uint32 row)
+{
+	// column major
+	return vec4(m.data[row], m.data[4 + row], m.data[8 + row], m.data[12 + row]);
+}
+
+static inline vec4 normalizePlane(const vec4& plane)
+{
+	float l = length(plane.xyz);
+	return plane / l;
+}
+
+camera_frustum getWorldSpaceFrustum(const mat4& viewProj)
+{
+	vec4 row0 = getRow(viewProj, 0);
+	vec4 row1 = getRow(viewProj, 1);
+	vec4 row2 = getRow(viewProj, 2);
+	vec4 row3 = getRow(viewProj, 3);
+
+	camera_frustum result;
+	result.planes[0] = normalizePlane(row3 + row0); // left
+	result.planes[1] = normalizePlane(row3 - row0); // right
+	result.planes[2] = normalizePlane(row3 + row1); // bottom
+	result.planes[3] = normalizePlane(row3 - row1); // top
+	result.planes[4] = normalizePlane(row3 + row2); // near
+	result.planes[5] = normalizePlane(row3 - row2); // far
+	return result;
+}
+
+bool isVisible(const camera_frustum& frustum, const bounding_box& box)
+{
+	for (uint32 i = 0; i < 6; ++i)
+	{
+		const vec4& plane = frustum.planes[i];
+
+		// corner which lies furthest in the direction of the plane normal
+		vec3 p(
+			plane.x > 0.f ? box.maxCorner.x : box.minCorner.x,
+			plane.y > 0.f ? box.maxCorner.y : box.minCorner.y,
+			plane.z > 0.f ? box.maxCorner.z : box.minCorner.z);
+
+		if (dot(plane.xyz, p) + plane.w < 0.f)
+			return false;
+	}
+	return true;
+}
+
+bool isVisible(const camera_frustum& frustum, const bounding_sphere& sphere)
+{
+	for (uint32 i = 0; i < 6; ++i)
+	{
+		const vec4& plane = frustum.planes[i];
+		if (dot(plane.xyz, sphere.center) + plane.w < -sphere.radius)
+			return false;
+	}
+	return true;
+}
+
+bounding_sphere transformBoundingSphere(const bounding_sphere& sphere, const SQT& transform)
+{
+	bounding_sphere result;
+	result.center = transform.position + rotate(transform.rotation, sphere.center * transform.scale);
+	result.radius = sphere.radius * transform.scale;
+	return result;
+}
+
+bounding_sphere mergeBoundingSpheres(const bounding_sphere& a, const bounding_sphere& b)
+{
+	vec3 d = b.center - a.center;
+	float dist = length(d);
+
+	if (dist + b.radius <= a.radius)
+		return a;
+	if (dist + a.radius <= b.radius)
+		return b;
+
+	bounding_sphere result;
+	result.radius = (dist + a.radius + b.radius) * 0.5f;
+	result.center = a.center + d * ((result.radius - a.radius) / dist);
+	return result;
+}
+
+void clearBoundingSpheres(bounding_sphere_soa& spheres)
+{
+	spheres.centerX.clear();
+	spheres.centerY.clear();
+	spheres.centerZ.clear();
+	spheres.radius.clear();
+	spheres.count = 0;
+}
+
+void pushBoundingSphere(bounding_sphere_soa& spheres, const bounding_sphere& sphere)
+{
+	spheres.centerX.push_back(sphere.center.x);
+	spheres.centerY.push_back(sphere.center.y);
+	spheres.centerZ.push_back(sphere.center.z);
+	spheres.radius.push_back(sphere.radius);
+	++spheres.count;
+}
+
+static uint32 cullBoundingSpheresScalar(const camera_frustum& frustum, const bounding_sphere_soa& spheres, uint32 first, uint32* visibleIndices, uint32 numberOfVisible)
+{
+	for (uint32 i = first; i < spheres.count; ++i)
+	{
+		bool visible = true;
+		for (uint32 p = 0; p < 6; ++p)
+		{
+			const vec4& plane = frustum.planes[p];
+			float d = plane.x * spheres.centerX[i] + plane.y * spheres.centerY[i] + plane.z * spheres.centerZ[i] + plane.w;
+			visible &= d >= -spheres.radius[i];
+		}
+
+		// branchless compaction: always write, only advance if visible
+		visibleIndices[numberOfVisible] = i;
+		numberOfVisible += visible;
+	}
+	return numberOfVisible;
+}
+
+uint32 cullBoundingSpheresScalar(const camera_frustum& frustum, const bounding_sphere_soa& spheres, uint32* visibleIndices)
+{
+	return cullBoundingSpheresScalar(frustum, spheres, 0, visibleIndices, 0);
+}
+
+#if defined(__AVX__)
+
+uint32 cullBoundingSpheres(const camera_frustum& frustum, const bounding_sphere_soa& spheres, uint32* visibleIndices)
+{
+	__m256 planeX[6], planeY[6], planeZ[6], planeW[6];
+	for (uint32 p = 0; p < 6; ++p)
+	{
+		planeX[p] = _mm256_broadcast_ss(&frustum.planes[p].x);
+		planeY[p] = _mm256_broadcast_ss(&frustum.planes[p].y);
+		planeZ[p] = _mm256_broadcast_ss(&frustum.planes[p].z);
+		planeW[p] = _mm256_broadcast_ss(&frustum.planes[p].w);
+	}
+
+	const __m256 zero = _mm256_setzero_ps();
+	uint32 numberOfVisible = 0;
+	uint32 i = 0;
+	for (; i + 8 <= spheres.count; i += 8)
+	{
+		__m256 x = _mm256_loadu_ps(&spheres.centerX[i]);
+		__m256 y = _mm256_loadu_ps(&spheres.centerY[i]);
+		__m256 z = _mm256_loadu_ps(&spheres.centerZ[i]);
+		__m256 negRadius = _mm256_sub_ps(zero, _mm256_loadu_ps(&spheres.radius[i]));
+
+		__m256 visible = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+		for (uint32 p = 0; p < 6; ++p)
+		{
+#if defined(__FMA__)
+			__m256 d = _mm256_fmadd_ps(planeX[p], x, _mm256_fmadd_ps(planeY[p], y, _mm256_fmadd_ps(planeZ[p], z, planeW[p])));
+#else
+			__m256 d = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(planeX[p], x), _mm256_mul_ps(planeY[p], y)),
+				_mm256_add_ps(_mm256_mul_ps(planeZ[p], z), planeW[p]));
+#endif
+			visible = _mm256_and_ps(visible, _mm256_cmp_ps(d, negRadius, _CMP_GE_OQ));
+		}
+
+		int mask = _mm256_movemask_ps(visible);
+		for (uint32 j = 0; j < 8; ++j)
+		{
+			visibleIndices[numberOfVisible] = i + j;
+			numberOfVisible += (mask >> j) & 1;
+		}
+	}
+
+	return cullBoundingSpheresScalar(frustum, spheres, i, visibleIndices, numberOfVisible);
+}
+
+#else
+
+uint32 cullBoundingSpheres(const camera_frustum& frustum, const bounding_sphere_soa& spheres, uint32* visibleIndices)
+{
+	__m128 planeX[6], planeY[6], planeZ[6], planeW[6];
+	for (uint32 p = 0; p < 6; ++p)
+	{
+		__m128 plane = frustum.planes[p].data;
+		planeX[p] = _mm_shuffle_ps(plane, plane, _MM_SHUFFLE(0, 0, 0, 0));
+		planeY[p] = _mm_shuffle_ps(plane, plane, _MM_SHUFFLE(1, 1, 1, 1));
+		planeZ[p] = _mm_shuffle_ps(plane, plane, _MM_SHUFFLE(2, 2, 2, 2));
+		planeW[p] = _mm_shuffle_ps(plane, plane, _MM_SHUFFLE(3, 3, 3, 3));
+	}
+
+	const __m128 zero = _mm_setzero_ps();
+	uint32 numberOfVisible = 0;
+	uint32 i = 0;
+	for (; i + 4 <= spheres.count; i += 4)
+	{
+		__m128 x = _mm_loadu_ps(&spheres.centerX[i]);
+		__m128 y = _mm_loadu_ps(&spheres.centerY[i]);
+		__m128 z = _mm_loadu_ps(&spheres.centerZ[i]);
+		__m128 negRadius = _mm_sub_ps(zero, _mm_loadu_ps(&spheres.radius[i]));
+
+		__m128 visible = _mm_castsi128_ps(_mm_set1_epi32(-1));
+		for (uint32 p = 0; p < 6; ++p)
+		{
+			__m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(planeX[p], x), _mm_mul_ps(planeY[p], y)),
+				_mm_add_ps(_mm_mul_ps(planeZ[p], z), planeW[p]));
+			visible = _mm_and_ps(visible, _mm_cmpge_ps(d, negRadius));
+		}
+
+		int mask = _mm_movemask_ps(visible);
+		for (uint32 j = 0; j < 4; ++j)
+		{
+			visibleIndices[numberOfVisible] = i + j;
+			numberOfVisible += (mask >> j) & 1;
+		}
+	}
+
+	return cullBoundingSpheresScalar(frustum, spheres, i, visibleIndices, numberOfVisible);
+}
+
+#endif
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <vector>
+#include <cfloat>
+
+#include "common.h"
+#include "math.h"
+
+
+struct bounding_box
+{
+	vec3 minCorner;
+	vec3 maxCorner;
+};
+
+struct bounding_sphere
+{
+	vec3 center;
+	float radius;
+};
+
+// planes point inwards: xyz is the normal, w the distance to the origin
+struct camera_frustum
+{
+	vec4 planes[6];
+};
+
+camera_frustum getWorldSpaceFrustum(const mat4& viewProj);
+
+bool isVisible(const camera_frustum& frustum, const bounding_box& box);
+bool isVisible(const camera_frustum& frustum, const bounding_sphere& sphere);
+
+// bounding spheres stored as structure of arrays, so the frustum test can run on 4 (SSE) or 8 (AVX) spheres at once
+struct bounding_sphere_soa
+{
+	std::vector<float> centerX;
+	std::vector<float> centerY;
+	std::vector<float> centerZ;
+	std::vector<float> radius;
+	uint32 count = 0;
+};
+
+#if defined(__AVX__)
+#define CULLING_SIMD_WIDTH 8
+#else
+#define CULLING_SIMD_WIDTH 4
+#endif
+
+void clearBoundingSpheres(bounding_sphere_soa& spheres);
+void pushBoundingSphere(bounding_sphere_soa& spheres, const bounding_sphere& sphere);
+
+// writes the indices of all spheres intersecting the frustum to visibleIndices, which must have room for spheres.count
+// entries. returns the number of visible spheres
+uint32 cullBoundingSpheres(const camera_frustum& frustum, const bounding_sphere_soa& spheres, uint32* visibleIndices);
+uint32 cullBoundingSpheresScalar(const camera_frustum& frustum, const bounding_sphere_soa& spheres, uint32* visibleIndices);
+
+bounding_sphere transformBoundingSphere(const bounding_sphere& sphere, const SQT& transform);
+bounding_sphere mergeBoundingSpheres(const bounding_sphere& a, const bounding_sphere& b);
+
+static inline bounding_box emptyBoundingBox()
+{
+	bounding_box result;
+	result.minCorner = vec3(FLT_MAX);
+	result.maxCorner = vec3(-FLT_MAX);
+	return result;
+}
+
+static inline void growBoundingBox(bounding_box& box, const vec3& point)
+{
+	box.minCorner = vec3(min(box.minCorner.x, point.x), min(box.minCorner.y, point.y), min(box.minCorner.z, point.z));
+	box.maxCorner = vec3(max(box.maxCorner.x, point.x), max(box.maxCorner.y, point.y), max(box.maxCorner.z, point.z));
+}
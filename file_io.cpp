@@ -0,0 +1,281 @@
+#include "common.h"
+
+#if defined(_WIN32)
+#include <mutex>
+#include <string>
+#include <vector>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// files are mapped into the address space instead of being copied into private memory. pages are read on first touch
+// and stay shared with the os file cache, so the contents are read only
+
+// empty files can not be mapped. they are still read successfully, with contents pointing here
+static const uint8 emptyFileContents[1] = { 0 };
+
+#if defined(_WIN32)
+
+// PrefetchVirtualMemory reads in the background into the view it is given, so prefetched files stay mapped until
+// readFile takes the view over. views which are never read are unmapped once there are too many
+#define MAX_PREFETCHED_FILES 64
+
+struct prefetched_file
+{
+	std::string filename;
+	input_file file;
+};
+
+static std::mutex prefetchMutex;
+static std::vector<prefetched_file> prefetchedFiles;
+
+static input_file mapFile(const char* filename)
+{
+	input_file result = {};
+	result.filename = filename;
+	HANDLE fileHandle = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, 0);
+	if (fileHandle != INVALID_HANDLE_VALUE)
+	{
+		LARGE_INTEGER fileSize;
+		bool sized = GetFileSizeEx(fileHandle, &fileSize) != 0;
+		if (sized && fileSize.QuadPart == 0)
+		{
+			result.contents = emptyFileContents;
+		}
+		else if (sized && fileSize.QuadPart > 0 && (uint64)fileSize.QuadPart <= (uint64)SIZE_MAX)
+		{
+			// the mapping object is kept alive by the view, so the handles can be closed right away
+			HANDLE mapping = CreateFileMappingA(fileHandle, 0, PAGE_READONLY, 0, 0, 0);
+			if (mapping)
+			{
+				result.contents = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+				if (result.contents)
+				{
+					result.size = (uint64)fileSize.QuadPart;
+				}
+				CloseHandle(mapping);
+			}
+		}
+
+		CloseHandle(fileHandle);
+	}
+
+	return result;
+}
+
+input_file readFile(const char* filename)
+{
+	{
+		std::lock_guard<std::mutex> lock(prefetchMutex);
+		for (uint32 i = 0; i < prefetchedFiles.size(); ++i)
+		{
+			if (prefetchedFiles[i].filename == filename)
+			{
+				input_file result = prefetchedFiles[i].file;
+				result.filename = filename;
+				prefetchedFiles.erase(prefetchedFiles.begin() + i);
+				return result;
+			}
+		}
+	}
+
+	return mapFile(filename);
+}
+
+void freeFile(input_file file)
+{
+	if (file.contents && file.contents != emptyFileContents)
+	{
+		UnmapViewOfFile(file.contents);
+	}
+}
+
+void prefetchFile(const input_file& file, uint64 offset, uint64 size)
+{
+#if _WIN32_WINNT >= 0x0602 // PrefetchVirtualMemory is only available since windows 8
+	if (!file.contents || offset >= file.size)
+		return;
+
+	WIN32_MEMORY_RANGE_ENTRY range;
+	range.VirtualAddress = (uint8*)file.contents + offset;
+	range.NumberOfBytes = (SIZE_T)((size < file.size - offset) ? size : file.size - offset);
+	PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+#endif
+}
+
+void prefetchFile(const char* filename)
+{
+	input_file file = mapFile(filename);
+	if (!file.contents)
+		return;
+	prefetchFile(file, 0, file.size);
+
+	std::lock_guard<std::mutex> lock(prefetchMutex);
+	for (const prefetched_file& prefetched : prefetchedFiles)
+	{
+		if (prefetched.filename == filename)
+		{
+			// already on its way
+			freeFile(file);
+			return;
+		}
+	}
+	if (prefetchedFiles.size() == MAX_PREFETCHED_FILES)
+	{
+		freeFile(prefetchedFiles.front().file);
+		prefetchedFiles.erase(prefetchedFiles.begin());
+	}
+
+	prefetched_file prefetched;
+	prefetched.filename = filename;
+	prefetched.file = file;
+	prefetchedFiles.push_back(prefetched);
+}
+
+bool writeFile(const char* filename, const void* data, uint64 size)
+{
+	bool result = false;
+	HANDLE fileHandle = CreateFileA(filename, GENERIC_WRITE, 0, 0, CREATE_ALWAYS, 0, 0);
+	if (fileHandle != INVALID_HANDLE_VALUE)
+	{
+		// WriteFile takes 32 bit sizes
+		const uint8* write = (const uint8*)data;
+		uint64 remaining = size;
+		result = true;
+		while (result && remaining > 0)
+		{
+			DWORD chunkSize = (DWORD)((remaining < 0x40000000) ? remaining : 0x40000000);
+			DWORD bytesWritten;
+			result = WriteFile(fileHandle, write, chunkSize, &bytesWritten, 0) && bytesWritten == chunkSize;
+			write += chunkSize;
+			remaining -= chunkSize;
+		}
+
+		CloseHandle(fileHandle);
+	}
+
+	return result;
+}
+
+uint64 getFileWriteTime(const char* filename)
+{
+	ULARGE_INTEGER create, access, write;
+	HANDLE fileHandle = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	write.QuadPart = 0;
+	if (fileHandle != INVALID_HANDLE_VALUE) {
+		GetFileTime(fileHandle, LPFILETIME(&create), LPFILETIME(&access), LPFILETIME(&write));
+	}
+	CloseHandle(fileHandle);
+	return (uint64)write.QuadPart;
+}
+
+#else
+
+input_file readFile(const char* filename)
+{
+	input_file result = {};
+	result.filename = filename;
+	int fileHandle = open(filename, O_RDONLY);
+	if (fileHandle != -1)
+	{
+		struct stat fileStat;
+		bool statted = fstat(fileHandle, &fileStat) == 0;
+		if (statted && fileStat.st_size == 0)
+		{
+			result.contents = emptyFileContents;
+		}
+		else if (statted && fileStat.st_size > 0 && (uint64)fileStat.st_size <= (uint64)SIZE_MAX)
+		{
+			void* contents = mmap(0, (size_t)fileStat.st_size, PROT_READ, MAP_PRIVATE, fileHandle, 0);
+			if (contents != MAP_FAILED)
+			{
+				// most files are parsed front to back, so aggressive read ahead pays off
+				madvise(contents, (size_t)fileStat.st_size, MADV_SEQUENTIAL);
+				result.contents = contents;
+				result.size = (uint64)fileStat.st_size;
+			}
+		}
+
+		// the mapping keeps its own reference to the file
+		close(fileHandle);
+	}
+
+	return result;
+}
+
+void freeFile(input_file file)
+{
+	if (file.contents && file.contents != emptyFileContents)
+	{
+		munmap((void*)file.contents, (size_t)file.size);
+	}
+}
+
+void prefetchFile(const input_file& file, uint64 offset, uint64 size)
+{
+	if (!file.contents || offset >= file.size)
+		return;
+
+	// madvise wants a page aligned start
+	uint64 pageSize = (uint64)sysconf(_SC_PAGESIZE);
+	uint64 alignedOffset = offset & ~(pageSize - 1);
+	uint64 end = (size < file.size - offset) ? offset + size : file.size;
+	madvise((uint8*)file.contents + alignedOffset, (size_t)(end - alignedOffset), MADV_WILLNEED);
+}
+
+void prefetchFile(const char* filename)
+{
+	// starts reading the file into the os file cache in the background, nothing is mapped
+	int fileHandle = open(filename, O_RDONLY);
+	if (fileHandle != -1)
+	{
+#if defined(POSIX_FADV_WILLNEED)
+		posix_fadvise(fileHandle, 0, 0, POSIX_FADV_WILLNEED);
+#endif
+		close(fileHandle);
+	}
+}
+
+bool writeFile(const char* filename, const void* data, uint64 size)
+{
+	bool result = false;
+	int fileHandle = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fileHandle != -1)
+	{
+		const uint8* write = (const uint8*)data;
+		uint64 remaining = size;
+		result = true;
+		while (result && remaining > 0)
+		{
+			ssize_t bytesWritten = ::write(fileHandle, write, (size_t)remaining);
+			result = bytesWritten > 0;
+			if (result)
+			{
+				write += bytesWritten;
+				remaining -= (uint64)bytesWritten;
+			}
+		}
+
+		result = (close(fileHandle) == 0) && result;
+	}
+
+	return result;
+}
+
+uint64 getFileWriteTime(const char* filename)
+{
+	struct stat fileStat;
+	if (stat(filename, &fileStat) != 0)
+		return 0;
+	// nanoseconds, st_mtime alone has a resolution of one second and misses edits within the same second
+#if defined(__APPLE__)
+	return (uint64)fileStat.st_mtimespec.tv_sec * 1000000000ull + (uint64)fileStat.st_mtimespec.tv_nsec;
+#else
+	return (uint64)fileStat.st_mtim.tv_sec * 1000000000ull + (uint64)fileStat.st_mtim.tv_nsec;
+#endif
+}
+
+#endif
@@ -0,0 +1,335 @@
+#include "job_system.h"
+
+
+// the system the current thread has a queue in, and that queue
+static thread_local job_system* threadSystem = 0;
+static thread_local job_queue* threadQueue = 0;
+static thread_local uint32 threadRandom = 0;
+
+struct queued_job
+{
+	job_function function;
+	void* data;
+	job_counter* counter;
+};
+
+static bool pushJob(job_queue& queue, const queued_job& job)
+{
+	int64 bottom = queue.bottom.load(std::memory_order_relaxed);
+	int64 top = queue.top.load(std::memory_order_acquire);
+	if (bottom - top >= JOB_QUEUE_SIZE)
+		return false;
+
+	job_slot& slot = queue.slots[bottom & (JOB_QUEUE_SIZE - 1)];
+	slot.function.store(job.function, std::memory_order_relaxed);
+	slot.data.store(job.data, std::memory_order_relaxed);
+	slot.counter.store(job.counter, std::memory_order_relaxed);
+
+	// the slot has to be visible before a thief can see the new bottom
+	queue.bottom.store(bottom + 1, std::memory_order_release);
+	return true;
+}
+
+static void readSlot(const job_slot& slot, queued_job& job)
+{
+	job.function = slot.function.load(std::memory_order_relaxed);
+	job.data = slot.data.load(std::memory_order_relaxed);
+	job.counter = slot.counter.load(std::memory_order_relaxed);
+}
+
+// owner only
+static bool popJob(job_queue& queue, queued_job& job)
+{
+	int64 bottom = queue.bottom.load(std::memory_order_relaxed) - 1;
+	queue.bottom.store(bottom, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	int64 top = queue.top.load(std::memory_order_relaxed);
+
+	if (top > bottom)
+	{
+		// empty
+		queue.bottom.store(bottom + 1, std::memory_order_relaxed);
+		return false;
+	}
+
+	readSlot(queue.slots[bottom & (JOB_QUEUE_SIZE - 1)], job);
+	if (top < bottom)
+		return true;
+
+	// the last job, a thief may be taking it at the same time. whoever moves top first gets it
+	bool taken = queue.top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+	queue.bottom.store(bottom + 1, std::memory_order_relaxed);
+	return taken;
+}
+
+// any thread. fails if the queue is empty or another thread took the job first
+static bool stealJob(job_queue& queue, queued_job& job)
+{
+	int64 top = queue.top.load(std::memory_order_acquire);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	int64 bottom = queue.bottom.load(std::memory_order_acquire);
+	if (top >= bottom)
+		return false;
+
+	readSlot(queue.slots[top & (JOB_QUEUE_SIZE - 1)], job);
+	return queue.top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+}
+
+// own queue first, then the submitted jobs, then the other queues starting at a random one
+static bool findJob(job_system& system, queued_job& job)
+{
+	job_queue* ownQueue = (threadSystem == &system) ? threadQueue : 0;
+	if (ownQueue && popJob(*ownQueue, job))
+	{
+		system.queuedJobs.fetch_sub(1, std::memory_order_relaxed);
+		return true;
+	}
+
+	if (system.numberOfSubmitted.load(std::memory_order_relaxed) > 0)
+	{
+		std::lock_guard<std::mutex> lock(system.submitMutex);
+		if (system.numberOfSubmitted.load(std::memory_order_relaxed) > 0)
+		{
+			uint32 index = system.firstSubmitted;
+			job.function = system.submitted[index].function;
+			job.data = system.submitted[index].data;
+			job.counter = system.submittedCounters[index];
+			system.firstSubmitted = (index + 1) % JOB_SUBMIT_QUEUE_SIZE;
+			system.numberOfSubmitted.fetch_sub(1, std::memory_order_relaxed);
+			system.queuedJobs.fetch_sub(1, std::memory_order_relaxed);
+			return true;
+		}
+	}
+
+	if (threadRandom == 0)
+		threadRandom = (uint32)(uintptr_t)&job | 1;
+	threadRandom ^= threadRandom << 13;
+	threadRandom ^= threadRandom >> 17;
+	threadRandom ^= threadRandom << 5;
+
+	uint32 start = threadRandom % system.numberOfQueues;
+	for (uint32 i = 0; i < system.numberOfQueues; ++i)
+	{
+		job_queue& victim = system.queues[(start + i) % system.numberOfQueues];
+		if (&victim != ownQueue && stealJob(victim, job))
+		{
+			system.queuedJobs.fetch_sub(1, std::memory_order_relaxed);
+			return true;
+		}
+	}
+	return false;
+}
+
+static void runJob(const queued_job& job)
+{
+	job.function(job.data);
+	if (job.counter)
+		job.counter->value.fetch_sub(1, std::memory_order_release);
+}
+
+static void workerProc(job_system* system, uint32 queueIndex)
+{
+	threadSystem = system;
+	threadQueue = &system->queues[queueIndex];
+
+	uint32 idleSpins = 0;
+	while (!system->quit.load(std::memory_order_acquire))
+	{
+		queued_job job;
+		if (findJob(*system, job))
+		{
+			runJob(job);
+			idleSpins = 0;
+			continue;
+		}
+
+		if (++idleSpins < JOB_IDLE_SPINS)
+		{
+			std::this_thread::yield();
+			continue;
+		}
+
+		// a submitter which pushed after the check below sees the sleeping worker and wakes it under the mutex
+		std::unique_lock<std::mutex> lock(system->sleepMutex);
+		system->sleepingWorkers.fetch_add(1);
+		system->wakeCondition.wait(lock, [system]() { return system->queuedJobs.load() > 0 || system->quit.load(); });
+		system->sleepingWorkers.fetch_sub(1);
+		idleSpins = 0;
+	}
+
+	threadSystem = 0;
+	threadQueue = 0;
+}
+
+void startJobSystem(job_system& system, uint32 numberOfThreads)
+{
+	if (numberOfThreads == 0)
+		numberOfThreads = std::thread::hardware_concurrency();
+	if (numberOfThreads == 0)
+		numberOfThreads = 1;
+
+	system.numberOfQueues = numberOfThreads;
+	system.queues = new job_queue[numberOfThreads];
+	for (uint32 i = 0; i < numberOfThreads; ++i)
+	{
+		system.queues[i].top = 0;
+		system.queues[i].bottom = 0;
+	}
+
+	system.firstSubmitted = 0;
+	system.numberOfSubmitted = 0;
+	system.queuedJobs = 0;
+	system.sleepingWorkers = 0;
+	system.quit = false;
+
+	threadSystem = &system;
+	threadQueue = &system.queues[0];
+
+	for (uint32 i = 1; i < numberOfThreads; ++i)
+		system.workers.push_back(std::thread(workerProc, &system, i));
+}
+
+void stopJobSystem(job_system& system)
+{
+	{
+		std::lock_guard<std::mutex> lock(system.sleepMutex);
+		system.quit = true;
+	}
+	system.wakeCondition.notify_all();
+
+	for (std::thread& worker : system.workers)
+		worker.join();
+	system.workers.clear();
+
+	system.firstSubmitted = 0;
+	system.numberOfSubmitted = 0;
+	delete[] system.queues;
+	system.queues = 0;
+	system.numberOfQueues = 0;
+
+	threadSystem = 0;
+	threadQueue = 0;
+}
+
+void submitJobs(job_system& system, const job* jobs, uint32 count, job_counter* counter)
+{
+	if (count == 0)
+		return;
+
+	if (counter)
+		counter->value.fetch_add((int32)count);
+
+	// counted before they are visible, so a worker never sleeps while jobs are queued
+	system.queuedJobs.fetch_add((int32)count);
+
+	if (threadSystem == &system)
+	{
+		for (uint32 i = 0; i < count; ++i)
+		{
+			queued_job job = { jobs[i].function, jobs[i].data, counter };
+			if (!pushJob(*threadQueue, job))
+			{
+				system.queuedJobs.fetch_sub(1);
+				runJob(job);
+			}
+		}
+	}
+	else
+	{
+		uint32 numberOfQueued = 0;
+		{
+			std::lock_guard<std::mutex> lock(system.submitMutex);
+			uint32 numberOfSubmitted = (uint32)system.numberOfSubmitted.load(std::memory_order_relaxed);
+			numberOfQueued = (count < JOB_SUBMIT_QUEUE_SIZE - numberOfSubmitted) ? count : JOB_SUBMIT_QUEUE_SIZE - numberOfSubmitted;
+			for (uint32 i = 0; i < numberOfQueued; ++i)
+			{
+				uint32 index = (system.firstSubmitted + numberOfSubmitted + i) % JOB_SUBMIT_QUEUE_SIZE;
+				system.submitted[index] = jobs[i];
+				system.submittedCounters[index] = counter;
+			}
+			system.numberOfSubmitted.fetch_add((int32)numberOfQueued);
+		}
+
+		for (uint32 i = numberOfQueued; i < count; ++i)
+		{
+			queued_job job = { jobs[i].function, jobs[i].data, counter };
+			system.queuedJobs.fetch_sub(1);
+			runJob(job);
+		}
+	}
+
+	if (system.sleepingWorkers.load() > 0)
+	{
+		std::lock_guard<std::mutex> lock(system.sleepMutex);
+		system.wakeCondition.notify_all();
+	}
+}
+
+void waitForCounter(job_system& system, job_counter& counter)
+{
+	while (counter.value.load(std::memory_order_acquire) > 0)
+	{
+		queued_job job;
+		if (findJob(system, job))
+			runJob(job);
+		else
+			std::this_thread::yield();
+	}
+}
+
+// the ranges [firstRange, endRange) of grainSize elements each
+struct parallel_for_split
+{
+	job_system* system;
+	parallel_for_function function;
+	void* data;
+	uint32 count, grainSize;
+	uint32 firstRange, endRange;
+};
+
+static void parallelForJob(void* data);
+
+// hands the upper half to another thread until a single range is left, runs that one and then waits for the halves
+// handed away. they live on this stack until then
+static void runParallelForSplit(const parallel_for_split& split)
+{
+	if (split.endRange - split.firstRange == 1)
+	{
+		uint32 begin = split.firstRange * split.grainSize;
+		uint32 end = (split.count - begin < split.grainSize) ? split.count : begin + split.grainSize;
+		split.function(split.data, begin, end);
+		return;
+	}
+
+	parallel_for_split lower = split;
+	parallel_for_split upper = split;
+	lower.endRange = upper.firstRange = split.firstRange + (split.endRange - split.firstRange) / 2;
+
+	job upperJob = { parallelForJob, &upper };
+	job_counter counter;
+	submitJobs(*split.system, &upperJob, 1, &counter);
+	runParallelForSplit(lower);
+	waitForCounter(*split.system, counter);
+}
+
+static void parallelForJob(void* data)
+{
+	runParallelForSplit(*(parallel_for_split*)data);
+}
+
+void parallelFor(job_system& system, uint32 count, uint32 grainSize, parallel_for_function function, void* data)
+{
+	if (grainSize == 0)
+		grainSize = 1;
+
+	uint32 numberOfRanges = (count + grainSize - 1) / grainSize;
+	if (numberOfRanges <= 1 || system.numberOfQueues <= 1)
+	{
+		if (count > 0)
+			function(data, 0, count);
+		return;
+	}
+
+	parallel_for_split split = { &system, function, data, count, grainSize, 0, numberOfRanges };
+	runParallelForSplit(split);
+}
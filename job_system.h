@@ -0,0 +1,100 @@
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+#include "common.h"
+
+// jobs one thread can have queued at once, a power of two. a job pushed to a full queue is run right away instead
+#define JOB_QUEUE_SIZE 4096
+
+// jobs threads without a queue can have submitted at once. a job submitted while it is full is run right away
+#define JOB_SUBMIT_QUEUE_SIZE 1024
+
+// tries to find a job before an idle worker goes to sleep
+#define JOB_IDLE_SPINS 64
+
+typedef void (*job_function)(void* data);
+
+struct job
+{
+	job_function function;
+	void* data;
+};
+
+// counts the unfinished jobs of the batches submitted with it. work which depends on a batch waits for its counter
+// to reach zero, from inside a job too
+struct job_counter
+{
+	std::atomic<int32> value;
+
+	job_counter() : value(0) {}
+};
+
+// the fields are atomic because a thief may read a slot the owner is overwriting. it then fails to claim it
+struct job_slot
+{
+	std::atomic<job_function> function;
+	std::atomic<void*> data;
+	std::atomic<job_counter*> counter;
+};
+
+// chase-lev deque of one thread. the owner pushes and pops at the bottom, every other thread steals from the top, so
+// the owner works on its newest jobs while the thieves take the oldest ones. top and bottom are on their own cache
+// lines, they are written by different threads
+struct job_queue
+{
+	std::atomic<int64> top;
+	uint8 topPadding[64 - sizeof(std::atomic<int64>)];
+	std::atomic<int64> bottom;
+	uint8 bottomPadding[64 - sizeof(std::atomic<int64>)];
+
+	job_slot slots[JOB_QUEUE_SIZE];
+};
+
+// a fixed set of worker threads, each with its own queue. the thread which started the system has a queue as well
+// and runs jobs while it waits. other threads (e.g. the update thread) submit to a shared queue instead
+struct job_system
+{
+	std::vector<std::thread> workers;
+	job_queue* queues = 0;		// the first one belongs to the thread which started the system
+	uint32 numberOfQueues = 0;
+
+	// ring of the jobs submitted by other threads, so submitting never allocates
+	std::mutex submitMutex;
+	job submitted[JOB_SUBMIT_QUEUE_SIZE];
+	job_counter* submittedCounters[JOB_SUBMIT_QUEUE_SIZE];
+	uint32 firstSubmitted = 0;
+	std::atomic<int32> numberOfSubmitted;
+
+	// idle workers sleep until there are jobs again
+	std::mutex sleepMutex;
+	std::condition_variable wakeCondition;
+	std::atomic<int32> queuedJobs;
+	std::atomic<int32> sleepingWorkers;
+	std::atomic<bool> quit;
+};
+
+// numberOfThreads includes the calling thread, 0 means one per hardware thread
+void startJobSystem(job_system& system, uint32 numberOfThreads = 0);
+
+// on the thread which started the system, once nothing waits for jobs anymore. jobs still queued are dropped
+void stopJobSystem(job_system& system);
+
+inline uint32 getJobThreadCount(const job_system& system) { return system.numberOfQueues; }
+
+// adds count to the counter (if any) before the jobs are queued, so it can be waited on right away
+void submitJobs(job_system& system, const job* jobs, uint32 count, job_counter* counter);
+
+// runs queued jobs until the counter reaches zero, so waiting never blocks a thread which could help
+void waitForCounter(job_system& system, job_counter& counter);
+
+typedef void (*parallel_for_function)(void* data, uint32 begin, uint32 end);
+
+// splits [0, count) into ranges of grainSize elements, calls function on them from all threads and returns once all
+// are done. the grain size should be large enough that a range takes a few microseconds at least. the ranges are
+// split in halves recursively, each job keeping its half on its stack, so this does not allocate
+void parallelFor(job_system& system, uint32 count, uint32 grainSize, parallel_for_function function, void* data);
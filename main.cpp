@@ -5,9 +5,18 @@
 #include <Windows.h>
 #include <Windowsx.h>
 
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
 #define SCREEN_WIDTH 1280
 #define SCREEN_HEIGHT 800 // window is resizable
 
+// breaks on every frame after the first few which allocates on any thread, job workers included. resizing the window or
+// switching to a larger scene grows the arenas and command lists once, so that is expected to trigger it
+#define ASSERT_NO_FRAME_ALLOCATIONS 0
+#define FRAME_ALLOCATION_WARMUP_FRAMES 8
+
 static uint32 clientWidth;
 static uint32 clientHeight;
 static bool running;
@@ -16,6 +25,71 @@ static bool debugRendering;
 
 timer globalTimer;
 
+// updates the scene and builds the next frame, while the main thread submits the current one. the cpu frame time is
+// then the longer of the two instead of their sum, at the cost of one frame of latency
+struct update_thread
+{
+	std::thread thread;
+	std::mutex mutex;
+	std::condition_variable condition;
+	bool busy = false;
+	bool quit = false;
+
+	// what to build, only changed while the thread is idle
+	scene_state* scene;
+	raw_input input;
+	float dt;
+	uint32 screenWidth, screenHeight;
+	bool debugRendering;
+	render_frame* frame;
+
+	frame_builder builder;
+};
+
+static void updateThreadProc(update_thread* update)
+{
+	for (;;)
+	{
+		{
+			std::unique_lock<std::mutex> lock(update->mutex);
+			update->condition.wait(lock, [update]() { return update->busy || update->quit; });
+			if (update->quit)
+				return;
+		}
+
+		updateScene(*update->scene, update->input, update->dt);
+		buildFrame(*update->frame, update->builder, *update->scene, update->screenWidth, update->screenHeight, update->debugRendering);
+
+		{
+			std::lock_guard<std::mutex> lock(update->mutex);
+			update->busy = false;
+		}
+		update->condition.notify_all();
+	}
+}
+
+static void startUpdate(update_thread& update, scene_state& scene, const raw_input& input, float dt, render_frame& frame)
+{
+	{
+		std::lock_guard<std::mutex> lock(update.mutex);
+		update.scene = &scene;
+		update.input = input;
+		update.dt = dt;
+		update.screenWidth = clientWidth;
+		update.screenHeight = clientHeight;
+		update.debugRendering = debugRendering;
+		update.frame = &frame;
+		update.busy = true;
+	}
+	update.condition.notify_all();
+}
+
+static void waitForUpdate(update_thread& update)
+{
+	std::unique_lock<std::mutex> lock(update.mutex);
+	update.condition.wait(lock, [&update]() { return !update.busy; });
+}
+
 static LRESULT CALLBACK windowCallBack(
 	_In_ HWND   hwnd,
 	_In_ UINT   msg,
@@ -252,9 +326,13 @@ int main(int argc, char* argv[])
 	opengl_renderer renderer;
 	initializeRenderer(renderer, clientWidth, clientHeight);
 
+	// one worker per hardware thread, the main thread helps while it waits for jobs
+	job_system jobSystem;
+	startJobSystem(jobSystem);
+
 	scene_state scenes[SCENE_COUNT];
 	for (uint32 i = 0; i < SCENE_COUNT; ++i)
-		initializeScene(scenes[i], (scene_name)i, clientWidth, clientHeight);
+		initializeScene(scenes[i], (scene_name)i, clientWidth, clientHeight, jobSystem);
 
 	LARGE_INTEGER perfFreqResult;
 	QueryPerformanceFrequency(&perfFreqResult);
@@ -265,6 +343,15 @@ int main(int argc, char* argv[])
 	raw_input* lastInput = &input[0];
 	raw_input* curInput = &input[1];
 
+	// one frame is built while the other one is rendered
+	update_thread update;
+	createArena(update.builder.frameArena, FRAME_ARENA_SIZE);
+	update.thread = std::thread(updateThreadProc, &update);
+	render_frame frames[2];
+	uint32 buildIndex = 0;
+	bool frameBuilt = false;
+	uint32 frameIndex = 0;
+
 
 	LARGE_INTEGER lastTime;
 	QueryPerformanceCounter(&lastTime);
@@ -274,6 +361,10 @@ int main(int argc, char* argv[])
 	running = true;
 	while (running)
 	{
+		// the count is shared by all threads. the update and its jobs run between here and waitForUpdate, so the
+		// difference covers the whole frame
+		uint64 allocationsBefore = getHeapAllocationCount();
+
 		{	//TIMED_BLOCK("input")
 			*curInput = {};
 			for (int buttonIndex = 0; buttonIndex < KB_BUTTONCOUNT; ++buttonIndex)
@@ -309,15 +400,24 @@ int main(int argc, char* argv[])
 			{
 				debugRendering = !debugRendering;
 			}
+
+			if (buttonDownEvent(*curInput, KB_ESC))
+			{
+				running = false;
+			}
 		}
 
 		{	//TIMED_BLOCK("update and render")
-			updateScene(scenes[currentScene], *curInput, secondsElapsed);
-			renderScene(renderer, scenes[currentScene], clientWidth, clientHeight, debugRendering);
+			startUpdate(update, scenes[currentScene], *curInput, secondsElapsed, frames[buildIndex]);
+			if (frameBuilt)
+				renderScene(renderer, frames[1 - buildIndex], clientWidth, clientHeight);
 		}
 
 		{	//TIMED_BLOCK("rest")
 			SwapBuffers(windowDC);
+			waitForUpdate(update);
+			frameBuilt = true;
+			buildIndex = 1 - buildIndex;
 			std::swap(lastInput, curInput);
 
 			LARGE_INTEGER currentTime;
@@ -326,80 +426,34 @@ int main(int argc, char* argv[])
 			lastTime = currentTime;
 			float fps = 1.f / secondsElapsed;
 
-			char titleBuffer[50];
-			sprintf(titleBuffer, "SSR --- FPS: %f, %fms", fps, secondsElapsed * 1000.f);
+			// a steady frame should not touch the heap on any thread
+			uint64 frameAllocations = getHeapAllocationCount() - allocationsBefore;
+#if ASSERT_NO_FRAME_ALLOCATIONS
+			assert(frameIndex < FRAME_ALLOCATION_WARMUP_FRAMES || frameAllocations == 0);
+#endif
+			++frameIndex;
+
+			char titleBuffer[128];
+			sprintf(titleBuffer, "SSR --- FPS: %f, %fms, allocations: %llu", fps, secondsElapsed * 1000.f,
+				(unsigned long long)frameAllocations);
 			SetWindowTextA(windowHandle, titleBuffer);
 		}
 		globalTimer.printTimedBlocks();
 	}
 
-	for (uint32 i = 0; i < SCENE_COUNT; ++i)
-		cleanupScene(scenes[i]);
-
-	cleanupRenderer(renderer);
-}
-
-uint64 getFileWriteTime(const char* filename)
-{
-	ULARGE_INTEGER create, access, write;
-	HANDLE fileHandle = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
-	write.QuadPart = 0;
-	if (fileHandle != INVALID_HANDLE_VALUE) {
-		GetFileTime(fileHandle, LPFILETIME(&create), LPFILETIME(&access), LPFILETIME(&write));
-	}
-	CloseHandle(fileHandle);
-	return (uint64)write.QuadPart;
-}
-
-input_file readFile(const char* filename)
-{
-	input_file result = { 0 };
-	result.filename = filename;
-	HANDLE fileHandle = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, 0, 0);
-	if (fileHandle != INVALID_HANDLE_VALUE)
-	{
-		LARGE_INTEGER fileSize;
-		if (GetFileSizeEx(fileHandle, &fileSize))
-		{
-			uint32 fileSize32 = (uint32)(fileSize.QuadPart);
-			result.contents = VirtualAlloc(0, fileSize32, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
-			if (result.contents)
-			{
-				DWORD bytesRead;
-				if (ReadFile(fileHandle, result.contents, fileSize32, &bytesRead, 0) &&
-					(fileSize32 == bytesRead))
-				{
-					result.size = fileSize32;
-				}
-				else
-				{
-					freeFile(result);
-					result.contents = nullptr;
-				}
-			}
-			else
-			{
-			}
-		}
-		else
-		{
-		}
-
-		CloseHandle(fileHandle);
-	}
-	else
 	{
+		std::lock_guard<std::mutex> lock(update.mutex);
+		update.quit = true;
 	}
+	update.condition.notify_all();
+	update.thread.join();
+	deleteArena(update.builder.frameArena);
 
-	return result;
-}
+	for (uint32 i = 0; i < SCENE_COUNT; ++i)
+		cleanupScene(scenes[i]);
 
-void freeFile(input_file file)
-{
-	if (file.contents)
-	{
-		VirtualFree(file.contents, 0, MEM_RELEASE);
-	}
+	cleanupRenderer(renderer);
+	stopJobSystem(jobSystem);
 }
 
 timer::timer()
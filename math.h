@@ -3,10 +3,14 @@
 #include "common.h"
 
 #include <emmintrin.h>
+#if defined(__AVX__)
+#include <immintrin.h>
+#endif
 #include <cmath>
 #include <ostream>
 
 
+#undef M_PI // some math headers define it as double
 #define M_PI 3.14159265359f
 #define M_PI_OVER_180 (M_PI / 180.f)
 #define M_180_OVER_PI (180.f / M_PI)
@@ -17,6 +21,11 @@
 #define max(a, b) (((a) > (b)) ? (a) : (b))
 #define min(a, b) (((a) < (b)) ? (a) : (b))
 
+// fused multiply add is part of every AVX2 capable CPU, MSVC does not define __FMA__ for /arch:AVX2
+#if defined(__FMA__) || defined(__AVX2__)
+#define MATH_FMA
+#endif
+
 static inline float clamp(float t, float lower, float upper)
 {
 	return max(lower, min(t, upper));
@@ -72,11 +81,16 @@ struct vec4
 			float w;
 		};
 
+#if defined(_MSC_VER)
 		struct
 		{
 			vec3 xyz;
 			float w;
 		};
+#else
+		// other compilers do not allow members with constructors in anonymous structs
+		vec3 xyz;
+#endif
 
 		__m128 data;
 
@@ -104,6 +118,7 @@ struct quat
 
 		__m128 data;
 
+#if defined(_MSC_VER)
 		struct
 		{
 			vec4 v4;
@@ -114,6 +129,10 @@ struct quat
 			vec3 v;
 			float cosHalfAngle;
 		};
+#else
+		vec4 v4;
+		vec3 v;
+#endif
 	};
 
 	inline quat();
@@ -583,6 +602,14 @@ static quat operator*(const quat& a, const quat& b)
 	return normalized(result);
 }
 
+// rotates v by the unit quaternion q, keeping its length. q * v below returns a unit vector, since the
+// quaternion product normalizes
+static inline vec3 rotate(const quat& q, const vec3& v)
+{
+	vec3 t = 2.f * cross(q.v, v);
+	return v + q.w * t + cross(q.v, t);
+}
+
 static inline vec3 operator*(const quat& q, const vec3& v)
 {
 	if (sqlength(v) == 0.f)
@@ -703,7 +730,77 @@ static inline std::ostream& operator<<(std::ostream& s, const mat3& m)
 ////////////////////////////// MAT 4 ///////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////////////
 
+#define SPLAT(v, i) _mm_shuffle_ps(v, v, _MM_SHUFFLE(i, i, i, i))
+
+// a * b + c
+static inline __m128 mulAdd(__m128 a, __m128 b, __m128 c)
+{
+#if defined(MATH_FMA)
+	return _mm_fmadd_ps(a, b, c);
+#else
+	return _mm_add_ps(_mm_mul_ps(a, b), c);
+#endif
+}
+
+#if defined(__AVX__)
+static inline __m256 mulAdd(__m256 a, __m256 b, __m256 c)
+{
+#if defined(MATH_FMA)
+	return _mm256_fmadd_ps(a, b, c);
+#else
+	return _mm256_add_ps(_mm256_mul_ps(a, b), c);
+#endif
+}
+#endif
+
 static mat4 operator*(const mat4& a, const mat4& b)
+{
+	// every column of the result is a linear combination of the columns of a
+	mat4 result;
+#if defined(__AVX__)
+	// two result columns at once
+	__m256 a0 = _mm256_broadcast_ps((const __m128*)&a.data[0]);
+	__m256 a1 = _mm256_broadcast_ps((const __m128*)&a.data[4]);
+	__m256 a2 = _mm256_broadcast_ps((const __m128*)&a.data[8]);
+	__m256 a3 = _mm256_broadcast_ps((const __m128*)&a.data[12]);
+	for (uint32 i = 0; i < 16; i += 8)
+	{
+		__m256 b01 = _mm256_loadu_ps(&b.data[i]);
+		__m256 r = _mm256_mul_ps(a0, _mm256_shuffle_ps(b01, b01, _MM_SHUFFLE(0, 0, 0, 0)));
+		r = mulAdd(a1, _mm256_shuffle_ps(b01, b01, _MM_SHUFFLE(1, 1, 1, 1)), r);
+		r = mulAdd(a2, _mm256_shuffle_ps(b01, b01, _MM_SHUFFLE(2, 2, 2, 2)), r);
+		r = mulAdd(a3, _mm256_shuffle_ps(b01, b01, _MM_SHUFFLE(3, 3, 3, 3)), r);
+		_mm256_storeu_ps(&result.data[i], r);
+	}
+#else
+	__m128 a0 = _mm_loadu_ps(&a.data[0]);
+	__m128 a1 = _mm_loadu_ps(&a.data[4]);
+	__m128 a2 = _mm_loadu_ps(&a.data[8]);
+	__m128 a3 = _mm_loadu_ps(&a.data[12]);
+	for (uint32 i = 0; i < 16; i += 4)
+	{
+		__m128 bCol = _mm_loadu_ps(&b.data[i]);
+		__m128 r = _mm_mul_ps(a0, SPLAT(bCol, 0));
+		r = mulAdd(a1, SPLAT(bCol, 1), r);
+		r = mulAdd(a2, SPLAT(bCol, 2), r);
+		r = mulAdd(a3, SPLAT(bCol, 3), r);
+		_mm_storeu_ps(&result.data[i], r);
+	}
+#endif
+	return result;
+}
+
+static vec4 operator*(const mat4& m, const vec4& v)
+{
+	__m128 r = _mm_mul_ps(_mm_loadu_ps(&m.data[0]), SPLAT(v.data, 0));
+	r = mulAdd(_mm_loadu_ps(&m.data[4]), SPLAT(v.data, 1), r);
+	r = mulAdd(_mm_loadu_ps(&m.data[8]), SPLAT(v.data, 2), r);
+	r = mulAdd(_mm_loadu_ps(&m.data[12]), SPLAT(v.data, 3), r);
+	return vec4(r);
+}
+
+// scalar reference implementations of the operators above
+static mat4 mulScalar(const mat4& a, const mat4& b)
 {
 	mat4 result;
 	for (uint32 y = 0; y < 4; ++y)
@@ -725,7 +822,7 @@ static mat4 operator*(const mat4& a, const mat4& b)
 	return result;
 }
 
-static vec4 operator*(const mat4& m, const vec4& v)
+static vec4 mulScalar(const mat4& m, const vec4& v)
 {
 	vec4 result;
 	result.x = m.m00 * v.x + m.m10 * v.y + m.m20 * v.z + m.m30 * v.w;
@@ -851,7 +948,7 @@ static inline mat4 transposed(const mat4& m)
 	return result;
 }
 
-static mat4 inverted(const mat4& m)
+static mat4 invertedScalar(const mat4& m)
 {
 	mat4 inv;
 
@@ -982,6 +1079,119 @@ static mat4 inverted(const mat4& m)
 	return inv;
 }
 
+// 2x2 matrix helpers for the block wise inverse below, each 2x2 matrix is stored as (m00, m01, m10, m11)
+static inline __m128 mat2Mul(__m128 a, __m128 b)
+{
+	return _mm_add_ps(_mm_mul_ps(a, _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 3, 0))),
+		_mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 3, 0, 1)), _mm_shuffle_ps(b, b, _MM_SHUFFLE(1, 2, 1, 2))));
+}
+
+// adjugate(a) * b
+static inline __m128 mat2AdjMul(__m128 a, __m128 b)
+{
+	return _mm_sub_ps(_mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(0, 0, 3, 3)), b),
+		_mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 2, 1, 1)), _mm_shuffle_ps(b, b, _MM_SHUFFLE(1, 0, 3, 2))));
+}
+
+// a * adjugate(b)
+static inline __m128 mat2MulAdj(__m128 a, __m128 b)
+{
+	return _mm_sub_ps(_mm_mul_ps(a, _mm_shuffle_ps(b, b, _MM_SHUFFLE(0, 3, 0, 3))),
+		_mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 3, 0, 1)), _mm_shuffle_ps(b, b, _MM_SHUFFLE(1, 2, 1, 2))));
+}
+
+// general inverse via 2x2 blocks. works on the columns just as well as on rows, since inverting the transposed
+// matrix gives the transposed inverse
+static mat4 inverted(const mat4& m)
+{
+	__m128 c0 = _mm_loadu_ps(&m.data[0]);
+	__m128 c1 = _mm_loadu_ps(&m.data[4]);
+	__m128 c2 = _mm_loadu_ps(&m.data[8]);
+	__m128 c3 = _mm_loadu_ps(&m.data[12]);
+
+	__m128 A = _mm_movelh_ps(c0, c1);
+	__m128 B = _mm_movehl_ps(c1, c0);
+	__m128 C = _mm_movelh_ps(c2, c3);
+	__m128 D = _mm_movehl_ps(c3, c2);
+
+	// determinants of the blocks as (|A|, |B|, |C|, |D|)
+	__m128 detSub = _mm_sub_ps(
+		_mm_mul_ps(_mm_shuffle_ps(c0, c2, _MM_SHUFFLE(2, 0, 2, 0)), _mm_shuffle_ps(c1, c3, _MM_SHUFFLE(3, 1, 3, 1))),
+		_mm_mul_ps(_mm_shuffle_ps(c0, c2, _MM_SHUFFLE(3, 1, 3, 1)), _mm_shuffle_ps(c1, c3, _MM_SHUFFLE(2, 0, 2, 0))));
+	__m128 detA = SPLAT(detSub, 0);
+	__m128 detB = SPLAT(detSub, 1);
+	__m128 detC = SPLAT(detSub, 2);
+	__m128 detD = SPLAT(detSub, 3);
+
+	__m128 D_C = mat2AdjMul(D, C);
+	__m128 A_B = mat2AdjMul(A, B);
+	__m128 X_ = _mm_sub_ps(_mm_mul_ps(detD, A), mat2Mul(B, D_C));
+	__m128 W_ = _mm_sub_ps(_mm_mul_ps(detA, D), mat2Mul(C, A_B));
+	__m128 Y_ = _mm_sub_ps(_mm_mul_ps(detB, C), mat2MulAdj(D, A_B));
+	__m128 Z_ = _mm_sub_ps(_mm_mul_ps(detC, B), mat2MulAdj(A, D_C));
+
+	// |M| = |A| |D| + |B| |C| - tr((A#B)(D#C))
+	__m128 tr = _mm_mul_ps(A_B, _mm_shuffle_ps(D_C, D_C, _MM_SHUFFLE(3, 1, 2, 0)));
+	tr = _mm_add_ps(tr, _mm_shuffle_ps(tr, tr, _MM_SHUFFLE(2, 3, 0, 1)));
+	tr = _mm_add_ps(tr, _mm_shuffle_ps(tr, tr, _MM_SHUFFLE(1, 0, 3, 2)));
+	__m128 detM = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(detA, detD), _mm_mul_ps(detB, detC)), tr);
+
+	if (_mm_cvtss_f32(detM) == 0.f)
+	{
+		std::cout << "could not invert matrix" << std::endl;
+		return mat4();
+	}
+
+	__m128 rDetM = _mm_div_ps(_mm_setr_ps(1.f, -1.f, -1.f, 1.f), detM);
+	X_ = _mm_mul_ps(X_, rDetM);
+	Y_ = _mm_mul_ps(Y_, rDetM);
+	Z_ = _mm_mul_ps(Z_, rDetM);
+	W_ = _mm_mul_ps(W_, rDetM);
+
+	mat4 result;
+	_mm_storeu_ps(&result.data[0], _mm_shuffle_ps(X_, Y_, _MM_SHUFFLE(1, 3, 1, 3)));
+	_mm_storeu_ps(&result.data[4], _mm_shuffle_ps(X_, Y_, _MM_SHUFFLE(0, 2, 0, 2)));
+	_mm_storeu_ps(&result.data[8], _mm_shuffle_ps(Z_, W_, _MM_SHUFFLE(1, 3, 1, 3)));
+	_mm_storeu_ps(&result.data[12], _mm_shuffle_ps(Z_, W_, _MM_SHUFFLE(0, 2, 0, 2)));
+	return result;
+}
+
+// inverse of a matrix made of rotation, scale and translation only, e.g. view and model matrices
+static mat4 invertedAffine(const mat4& m)
+{
+	__m128 c0 = _mm_loadu_ps(&m.data[0]);
+	__m128 c1 = _mm_loadu_ps(&m.data[4]);
+	__m128 c2 = _mm_loadu_ps(&m.data[8]);
+	__m128 c3 = _mm_setzero_ps();
+	__m128 t = _mm_loadu_ps(&m.data[12]);
+
+	// the inverse of the 3x3 part is its transpose, with every row divided by the squared length of the
+	// corresponding column. after transposing, the squared lengths are just the sum of the squared rows
+	_MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+	__m128 sizeSquared = _mm_mul_ps(c0, c0);
+	sizeSquared = mulAdd(c1, c1, sizeSquared);
+	sizeSquared = mulAdd(c2, c2, sizeSquared);
+	sizeSquared = _mm_add_ps(sizeSquared, _mm_setr_ps(0.f, 0.f, 0.f, 1.f));
+
+	__m128 rSizeSquared = _mm_div_ps(_mm_set1_ps(1.f), sizeSquared);
+	c0 = _mm_mul_ps(c0, rSizeSquared);
+	c1 = _mm_mul_ps(c1, rSizeSquared);
+	c2 = _mm_mul_ps(c2, rSizeSquared);
+
+	// translation is -inverse(3x3) * t
+	__m128 r3 = _mm_mul_ps(c0, SPLAT(t, 0));
+	r3 = mulAdd(c1, SPLAT(t, 1), r3);
+	r3 = mulAdd(c2, SPLAT(t, 2), r3);
+	r3 = _mm_sub_ps(_mm_setr_ps(0.f, 0.f, 0.f, 1.f), r3);
+
+	mat4 result;
+	_mm_storeu_ps(&result.data[0], c0);
+	_mm_storeu_ps(&result.data[4], c1);
+	_mm_storeu_ps(&result.data[8], c2);
+	_mm_storeu_ps(&result.data[12], r3);
+	return result;
+}
+
 static inline std::ostream& operator<<(std::ostream& s, const mat4& m)
 {
 	for (uint32 y = 0; y < 4; ++y)
@@ -1001,9 +1211,43 @@ static inline std::ostream& operator<<(std::ostream& s, const mat4& m)
 /////////////////////////////// SQT ////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////////////
 
+// same as createModelMatrix(position, rotation, scale), without building and multiplying three matrices
 static inline mat4 sqtToMat4(const SQT& sqt)
 {
-	return createModelMatrix(sqt.position, sqt.rotation, sqt.scale);
+	const quat& q = sqt.rotation;
+	float s2 = 2.f * sqt.scale;
+
+	float qxx(q.x * q.x);
+	float qyy(q.y * q.y);
+	float qzz(q.z * q.z);
+	float qxz(q.x * q.z);
+	float qxy(q.x * q.y);
+	float qyz(q.y * q.z);
+	float qwx(q.w * q.x);
+	float qwy(q.w * q.y);
+	float qwz(q.w * q.z);
+
+	mat4 result;
+	result.m00 = sqt.scale - s2 * (qyy + qzz);
+	result.m01 = s2 * (qxy + qwz);
+	result.m02 = s2 * (qxz - qwy);
+	result.m03 = 0.f;
+
+	result.m10 = s2 * (qxy - qwz);
+	result.m11 = sqt.scale - s2 * (qxx + qzz);
+	result.m12 = s2 * (qyz + qwx);
+	result.m13 = 0.f;
+
+	result.m20 = s2 * (qxz + qwy);
+	result.m21 = s2 * (qyz - qwx);
+	result.m22 = sqt.scale - s2 * (qxx + qyy);
+	result.m23 = 0.f;
+
+	result.m30 = sqt.position.x;
+	result.m31 = sqt.position.y;
+	result.m32 = sqt.position.z;
+	result.m33 = 1.f;
+	return result;
 }
 
 static inline SQT slerp(const SQT& from, const SQT& to, float t)
@@ -0,0 +1,322 @@
+#include "math_batch.h"
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#endif
+
+
+// four vec3 in three registers (x0 y0 z0 x1, y1 z1 x2 y2, z2 x3 y3 z3) to one register per component
+static inline void loadVec3x4(const vec3* v, __m128& x, __m128& y, __m128& z)
+{
+	const float* p = &v->x;
+	__m128 a = _mm_loadu_ps(p);
+	__m128 b = _mm_loadu_ps(p + 4);
+	__m128 c = _mm_loadu_ps(p + 8);
+
+	x = _mm_shuffle_ps(a, _mm_shuffle_ps(b, c, _MM_SHUFFLE(1, 1, 2, 2)), _MM_SHUFFLE(2, 0, 3, 0));
+	y = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(0, 0, 1, 1)), _mm_shuffle_ps(b, c, _MM_SHUFFLE(2, 2, 3, 3)), _MM_SHUFFLE(2, 0, 2, 0));
+	z = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(1, 1, 2, 2)), _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 3, 0, 0)), _MM_SHUFFLE(2, 0, 2, 0));
+}
+
+static inline void storeVec3x4(vec3* v, __m128 x, __m128 y, __m128 z)
+{
+	float* p = &v->x;
+	__m128 a = _mm_shuffle_ps(_mm_unpacklo_ps(x, y), _mm_shuffle_ps(z, x, _MM_SHUFFLE(1, 1, 0, 0)), _MM_SHUFFLE(2, 0, 1, 0));
+	__m128 b = _mm_shuffle_ps(_mm_shuffle_ps(y, z, _MM_SHUFFLE(1, 1, 1, 1)), _mm_unpackhi_ps(x, y), _MM_SHUFFLE(1, 0, 2, 0));
+	__m128 c = _mm_shuffle_ps(_mm_shuffle_ps(z, x, _MM_SHUFFLE(3, 3, 2, 2)), _mm_shuffle_ps(y, z, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(2, 0, 2, 0));
+	_mm_storeu_ps(p, a);
+	_mm_storeu_ps(p + 4, b);
+	_mm_storeu_ps(p + 8, c);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////
+/////////////////////////// POINTS AND VECTORS /////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////
+
+static inline vec3 transformScalar(const mat4& m, const vec3& v, float w)
+{
+	return vec3(
+		m.m00 * v.x + m.m10 * v.y + m.m20 * v.z + m.m30 * w,
+		m.m01 * v.x + m.m11 * v.y + m.m21 * v.z + m.m31 * w,
+		m.m02 * v.x + m.m12 * v.y + m.m22 * v.z + m.m32 * w);
+}
+
+void transformPointsScalar(const mat4& m, const vec3* in, vec3* out, uint32 count)
+{
+	for (uint32 i = 0; i < count; ++i)
+		out[i] = transformScalar(m, in[i], 1.f);
+}
+
+void transformVectorsScalar(const mat4& m, const vec3* in, vec3* out, uint32 count)
+{
+	for (uint32 i = 0; i < count; ++i)
+		out[i] = transformScalar(m, in[i], 0.f);
+}
+
+void transformPointsScalar(const mat4& m, const float* inX, const float* inY, const float* inZ, float* outX, float* outY, float* outZ, uint32 count)
+{
+	for (uint32 i = 0; i < count; ++i)
+	{
+		vec3 r = transformScalar(m, vec3(inX[i], inY[i], inZ[i]), 1.f);
+		outX[i] = r.x;
+		outY[i] = r.y;
+		outZ[i] = r.z;
+	}
+}
+
+// SoA: out.x = m00 * x + m10 * y + m20 * z + m30 * w, same for y and z
+static void transformAoS(const mat4& m, const vec3* in, vec3* out, uint32 count, float w)
+{
+	__m128 m00 = _mm_set1_ps(m.m00), m10 = _mm_set1_ps(m.m10), m20 = _mm_set1_ps(m.m20), m30 = _mm_set1_ps(m.m30 * w);
+	__m128 m01 = _mm_set1_ps(m.m01), m11 = _mm_set1_ps(m.m11), m21 = _mm_set1_ps(m.m21), m31 = _mm_set1_ps(m.m31 * w);
+	__m128 m02 = _mm_set1_ps(m.m02), m12 = _mm_set1_ps(m.m12), m22 = _mm_set1_ps(m.m22), m32 = _mm_set1_ps(m.m32 * w);
+
+	uint32 i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128 x, y, z;
+		loadVec3x4(in + i, x, y, z);
+
+		__m128 rx = mulAdd(m00, x, mulAdd(m10, y, mulAdd(m20, z, m30)));
+		__m128 ry = mulAdd(m01, x, mulAdd(m11, y, mulAdd(m21, z, m31)));
+		__m128 rz = mulAdd(m02, x, mulAdd(m12, y, mulAdd(m22, z, m32)));
+
+		storeVec3x4(out + i, rx, ry, rz);
+	}
+
+	for (; i < count; ++i)
+		out[i] = transformScalar(m, in[i], w);
+}
+
+void transformPoints(const mat4& m, const vec3* in, vec3* out, uint32 count)
+{
+	transformAoS(m, in, out, count, 1.f);
+}
+
+void transformVectors(const mat4& m, const vec3* in, vec3* out, uint32 count)
+{
+	transformAoS(m, in, out, count, 0.f);
+}
+
+void transformPoints(const mat4& m, const float* inX, const float* inY, const float* inZ, float* outX, float* outY, float* outZ, uint32 count)
+{
+	uint32 i = 0;
+#if defined(__AVX__)
+	{
+		__m256 m00 = _mm256_set1_ps(m.m00), m10 = _mm256_set1_ps(m.m10), m20 = _mm256_set1_ps(m.m20), m30 = _mm256_set1_ps(m.m30);
+		__m256 m01 = _mm256_set1_ps(m.m01), m11 = _mm256_set1_ps(m.m11), m21 = _mm256_set1_ps(m.m21), m31 = _mm256_set1_ps(m.m31);
+		__m256 m02 = _mm256_set1_ps(m.m02), m12 = _mm256_set1_ps(m.m12), m22 = _mm256_set1_ps(m.m22), m32 = _mm256_set1_ps(m.m32);
+
+		for (; i + 8 <= count; i += 8)
+		{
+			__m256 x = _mm256_loadu_ps(inX + i);
+			__m256 y = _mm256_loadu_ps(inY + i);
+			__m256 z = _mm256_loadu_ps(inZ + i);
+
+			_mm256_storeu_ps(outX + i, mulAdd(m00, x, mulAdd(m10, y, mulAdd(m20, z, m30))));
+			_mm256_storeu_ps(outY + i, mulAdd(m01, x, mulAdd(m11, y, mulAdd(m21, z, m31))));
+			_mm256_storeu_ps(outZ + i, mulAdd(m02, x, mulAdd(m12, y, mulAdd(m22, z, m32))));
+		}
+	}
+#endif
+	{
+		__m128 m00 = _mm_set1_ps(m.m00), m10 = _mm_set1_ps(m.m10), m20 = _mm_set1_ps(m.m20), m30 = _mm_set1_ps(m.m30);
+		__m128 m01 = _mm_set1_ps(m.m01), m11 = _mm_set1_ps(m.m11), m21 = _mm_set1_ps(m.m21), m31 = _mm_set1_ps(m.m31);
+		__m128 m02 = _mm_set1_ps(m.m02), m12 = _mm_set1_ps(m.m12), m22 = _mm_set1_ps(m.m22), m32 = _mm_set1_ps(m.m32);
+
+		for (; i + 4 <= count; i += 4)
+		{
+			__m128 x = _mm_loadu_ps(inX + i);
+			__m128 y = _mm_loadu_ps(inY + i);
+			__m128 z = _mm_loadu_ps(inZ + i);
+
+			_mm_storeu_ps(outX + i, mulAdd(m00, x, mulAdd(m10, y, mulAdd(m20, z, m30))));
+			_mm_storeu_ps(outY + i, mulAdd(m01, x, mulAdd(m11, y, mulAdd(m21, z, m31))));
+			_mm_storeu_ps(outZ + i, mulAdd(m02, x, mulAdd(m12, y, mulAdd(m22, z, m32))));
+		}
+	}
+
+	transformPointsScalar(m, inX + i, inY + i, inZ + i, outX + i, outY + i, outZ + i, count - i);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////// ROTATIONS //////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////
+
+// v' = v + w * t + cross(q, t), with t = 2 * cross(q, v). only valid for unit quaternions
+static inline vec3 rotateScalar(float qx, float qy, float qz, float qw, const vec3& v)
+{
+	float tx = 2.f * (qy * v.z - qz * v.y);
+	float ty = 2.f * (qz * v.x - qx * v.z);
+	float tz = 2.f * (qx * v.y - qy * v.x);
+
+	return vec3(
+		v.x + qw * tx + (qy * tz - qz * ty),
+		v.y + qw * ty + (qz * tx - qx * tz),
+		v.z + qw * tz + (qx * ty - qy * tx));
+}
+
+void rotateVectorsScalar(const quat* q, const vec3* in, vec3* out, uint32 count)
+{
+	for (uint32 i = 0; i < count; ++i)
+		out[i] = rotateScalar(q[i].x, q[i].y, q[i].z, q[i].w, in[i]);
+}
+
+void rotateVectorsScalar(const float* qX, const float* qY, const float* qZ, const float* qW,
+	const float* inX, const float* inY, const float* inZ, float* outX, float* outY, float* outZ, uint32 count)
+{
+	for (uint32 i = 0; i < count; ++i)
+	{
+		vec3 r = rotateScalar(qX[i], qY[i], qZ[i], qW[i], vec3(inX[i], inY[i], inZ[i]));
+		outX[i] = r.x;
+		outY[i] = r.y;
+		outZ[i] = r.z;
+	}
+}
+
+#define DEFINE_ROTATE(type, mul, sub, add, set1)																	\
+static inline void rotateSoA(type qx, type qy, type qz, type qw, type& x, type& y, type& z)							\
+{																													\
+	type two = set1(2.f);																							\
+	type tx = mul(two, sub(mul(qy, z), mul(qz, y)));																\
+	type ty = mul(two, sub(mul(qz, x), mul(qx, z)));																\
+	type tz = mul(two, sub(mul(qx, y), mul(qy, x)));																\
+	x = add(mulAdd(qw, tx, x), sub(mul(qy, tz), mul(qz, ty)));														\
+	y = add(mulAdd(qw, ty, y), sub(mul(qz, tx), mul(qx, tz)));														\
+	z = add(mulAdd(qw, tz, z), sub(mul(qx, ty), mul(qy, tx)));														\
+}
+
+DEFINE_ROTATE(__m128, _mm_mul_ps, _mm_sub_ps, _mm_add_ps, _mm_set1_ps)
+#if defined(__AVX__)
+DEFINE_ROTATE(__m256, _mm256_mul_ps, _mm256_sub_ps, _mm256_add_ps, _mm256_set1_ps)
+#endif
+
+void rotateVectors(const quat* q, const vec3* in, vec3* out, uint32 count)
+{
+	uint32 i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128 qx = q[i + 0].data;
+		__m128 qy = q[i + 1].data;
+		__m128 qz = q[i + 2].data;
+		__m128 qw = q[i + 3].data;
+		_MM_TRANSPOSE4_PS(qx, qy, qz, qw);
+
+		__m128 x, y, z;
+		loadVec3x4(in + i, x, y, z);
+		rotateSoA(qx, qy, qz, qw, x, y, z);
+		storeVec3x4(out + i, x, y, z);
+	}
+
+	rotateVectorsScalar(q + i, in + i, out + i, count - i);
+}
+
+void rotateVectors(const float* qX, const float* qY, const float* qZ, const float* qW,
+	const float* inX, const float* inY, const float* inZ, float* outX, float* outY, float* outZ, uint32 count)
+{
+	uint32 i = 0;
+#if defined(__AVX__)
+	for (; i + 8 <= count; i += 8)
+	{
+		__m256 x = _mm256_loadu_ps(inX + i);
+		__m256 y = _mm256_loadu_ps(inY + i);
+		__m256 z = _mm256_loadu_ps(inZ + i);
+		rotateSoA(_mm256_loadu_ps(qX + i), _mm256_loadu_ps(qY + i), _mm256_loadu_ps(qZ + i), _mm256_loadu_ps(qW + i), x, y, z);
+		_mm256_storeu_ps(outX + i, x);
+		_mm256_storeu_ps(outY + i, y);
+		_mm256_storeu_ps(outZ + i, z);
+	}
+#endif
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128 x = _mm_loadu_ps(inX + i);
+		__m128 y = _mm_loadu_ps(inY + i);
+		__m128 z = _mm_loadu_ps(inZ + i);
+		rotateSoA(_mm_loadu_ps(qX + i), _mm_loadu_ps(qY + i), _mm_loadu_ps(qZ + i), _mm_loadu_ps(qW + i), x, y, z);
+		_mm_storeu_ps(outX + i, x);
+		_mm_storeu_ps(outY + i, y);
+		_mm_storeu_ps(outZ + i, z);
+	}
+
+	rotateVectorsScalar(qX + i, qY + i, qZ + i, qW + i, inX + i, inY + i, inZ + i, outX + i, outY + i, outZ + i, count - i);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////// MATRICES ///////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////
+
+void sqtsToMat4sScalar(const mat4& parent, const SQT* sqts, mat4* out, uint32 count)
+{
+	for (uint32 i = 0; i < count; ++i)
+		out[i] = mulScalar(parent, sqtToMat4(sqts[i]));
+}
+
+void sqtsToMat4s(const mat4& parent, const SQT* sqts, mat4* out, uint32 count)
+{
+	// parent elements, p[row][column]
+	__m128 p[4][4];
+	for (uint32 row = 0; row < 4; ++row)
+		for (uint32 column = 0; column < 4; ++column)
+			p[row][column] = _mm_set1_ps(parent.data[column * 4 + row]);
+
+	const __m128 two = _mm_set1_ps(2.f);
+
+	uint32 i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		// four SQTs to one register per component
+		__m128 qx = sqts[i + 0].rotation.data;
+		__m128 qy = sqts[i + 1].rotation.data;
+		__m128 qz = sqts[i + 2].rotation.data;
+		__m128 qw = sqts[i + 3].rotation.data;
+		_MM_TRANSPOSE4_PS(qx, qy, qz, qw);
+
+		// position and scale are contiguous
+		__m128 px = _mm_loadu_ps(&sqts[i + 0].position.x);
+		__m128 py = _mm_loadu_ps(&sqts[i + 1].position.x);
+		__m128 pz = _mm_loadu_ps(&sqts[i + 2].position.x);
+		__m128 s = _mm_loadu_ps(&sqts[i + 3].position.x);
+		_MM_TRANSPOSE4_PS(px, py, pz, s);
+
+		__m128 s2 = _mm_mul_ps(two, s);
+		__m128 qxx = _mm_mul_ps(qx, qx), qyy = _mm_mul_ps(qy, qy), qzz = _mm_mul_ps(qz, qz);
+		__m128 qxz = _mm_mul_ps(qx, qz), qxy = _mm_mul_ps(qx, qy), qyz = _mm_mul_ps(qy, qz);
+		__m128 qwx = _mm_mul_ps(qw, qx), qwy = _mm_mul_ps(qw, qy), qwz = _mm_mul_ps(qw, qz);
+
+		// model matrix elements m[row][column], the last row is (0, 0, 0, 1)
+		__m128 m[3][4];
+		m[0][0] = _mm_sub_ps(s, _mm_mul_ps(s2, _mm_add_ps(qyy, qzz)));
+		m[1][0] = _mm_mul_ps(s2, _mm_add_ps(qxy, qwz));
+		m[2][0] = _mm_mul_ps(s2, _mm_sub_ps(qxz, qwy));
+		m[0][1] = _mm_mul_ps(s2, _mm_sub_ps(qxy, qwz));
+		m[1][1] = _mm_sub_ps(s, _mm_mul_ps(s2, _mm_add_ps(qxx, qzz)));
+		m[2][1] = _mm_mul_ps(s2, _mm_add_ps(qyz, qwx));
+		m[0][2] = _mm_mul_ps(s2, _mm_add_ps(qxz, qwy));
+		m[1][2] = _mm_mul_ps(s2, _mm_sub_ps(qyz, qwx));
+		m[2][2] = _mm_sub_ps(s, _mm_mul_ps(s2, _mm_add_ps(qxx, qyy)));
+		m[0][3] = px;
+		m[1][3] = py;
+		m[2][3] = pz;
+
+		for (uint32 column = 0; column < 4; ++column)
+		{
+			// parent * model, one result column of all four matrices
+			__m128 r[4];
+			for (uint32 row = 0; row < 4; ++row)
+			{
+				r[row] = mulAdd(p[row][0], m[0][column], mulAdd(p[row][1], m[1][column], _mm_mul_ps(p[row][2], m[2][column])));
+				if (column == 3)
+					r[row] = _mm_add_ps(r[row], p[row][3]);
+			}
+
+			_MM_TRANSPOSE4_PS(r[0], r[1], r[2], r[3]);
+			_mm_storeu_ps(&out[i + 0].data[column * 4], r[0]);
+			_mm_storeu_ps(&out[i + 1].data[column * 4], r[1]);
+			_mm_storeu_ps(&out[i + 2].data[column * 4], r[2]);
+			_mm_storeu_ps(&out[i + 3].data[column * 4], r[3]);
+		}
+	}
+
+	for (; i < count; ++i)
+		out[i] = parent * sqtToMat4(sqts[i]);
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include "common.h"
+#include "math.h"
+
+// batch versions of the math.h operators, for transforming many points, vectors and matrices at once.
+// inputs are either arrays of structures (vec3*, SQT*) or structures of arrays (one float array per component).
+// every function has a scalar reference implementation with the same signature and a "Scalar" suffix
+
+// out = m * vec4(in, 1)
+void transformPoints(const mat4& m, const vec3* in, vec3* out, uint32 count);
+void transformPoints(const mat4& m, const float* inX, const float* inY, const float* inZ, float* outX, float* outY, float* outZ, uint32 count);
+void transformPointsScalar(const mat4& m, const vec3* in, vec3* out, uint32 count);
+void transformPointsScalar(const mat4& m, const float* inX, const float* inY, const float* inZ, float* outX, float* outY, float* outZ, uint32 count);
+
+// out = m * vec4(in, 0). for normals, pass the inverse transpose of the point transform
+void transformVectors(const mat4& m, const vec3* in, vec3* out, uint32 count);
+void transformVectorsScalar(const mat4& m, const vec3* in, vec3* out, uint32 count);
+
+// out[i] = q[i] * in[i]
+void rotateVectors(const quat* q, const vec3* in, vec3* out, uint32 count);
+void rotateVectors(const float* qX, const float* qY, const float* qZ, const float* qW,
+	const float* inX, const float* inY, const float* inZ, float* outX, float* outY, float* outZ, uint32 count);
+void rotateVectorsScalar(const quat* q, const vec3* in, vec3* out, uint32 count);
+void rotateVectorsScalar(const float* qX, const float* qY, const float* qZ, const float* qW,
+	const float* inX, const float* inY, const float* inZ, float* outX, float* outY, float* outZ, uint32 count);
+
+// out[i] = parent * sqtToMat4(sqts[i]), e.g. view * model for instance matrices
+void sqtsToMat4s(const mat4& parent, const SQT* sqts, mat4* out, uint32 count);
+void sqtsToMat4sScalar(const mat4& parent, const SQT* sqts, mat4* out, uint32 count);
@@ -0,0 +1,161 @@
+#include "memory_arena.h"
+
+#include <cstdlib>
+#include <new>
+#include <atomic>
+
+
+#if COUNT_HEAP_ALLOCATIONS
+
+// shared by all threads, so allocations on the job workers count for the frame which ran them
+static std::atomic<uint64> heapAllocations(0);
+
+// replaces the global new of the whole program, everything which allocates through it is counted
+void* operator new(size_t size)
+{
+	heapAllocations.fetch_add(1, std::memory_order_relaxed);
+	void* result = malloc(size ? size : 1);
+	if (!result)
+		throw std::bad_alloc();
+	return result;
+}
+
+void* operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+	heapAllocations.fetch_add(1, std::memory_order_relaxed);
+	return malloc(size ? size : 1);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+	return operator new(size, std::nothrow);
+}
+
+void operator delete(void* memory) noexcept
+{
+	free(memory);
+}
+
+void operator delete[](void* memory) noexcept
+{
+	free(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept
+{
+	free(memory);
+}
+
+void operator delete[](void* memory, size_t) noexcept
+{
+	free(memory);
+}
+
+void operator delete(void* memory, const std::nothrow_t&) noexcept
+{
+	free(memory);
+}
+
+void operator delete[](void* memory, const std::nothrow_t&) noexcept
+{
+	free(memory);
+}
+
+uint64 getHeapAllocationCount()
+{
+	return heapAllocations.load(std::memory_order_relaxed);
+}
+
+#else
+
+uint64 getHeapAllocationCount()
+{
+	return 0;
+}
+
+#endif
+
+static uint8* allocateBlock(uint64 size)
+{
+	return (uint8*)operator new((size_t)size);
+}
+
+static void freeBlock(uint8* block)
+{
+	operator delete(block);
+}
+
+void createArena(memory_arena& arena, uint64 size)
+{
+	arena.memory = size ? allocateBlock(size) : 0;
+	arena.size = size;
+	arena.used = 0;
+	arena.overflowSize = 0;
+	arena.peakUsed = 0;
+}
+
+void deleteArena(memory_arena& arena)
+{
+	for (uint8* block : arena.overflowBlocks)
+		freeBlock(block);
+	arena.overflowBlocks.clear();
+	arena.overflowSize = 0;
+
+	if (arena.memory)
+		freeBlock(arena.memory);
+	arena.memory = 0;
+	arena.size = 0;
+	arena.used = 0;
+}
+
+static uint64 alignOffset(uint64 offset, uint64 alignment)
+{
+	return (offset + alignment - 1) & ~(alignment - 1);
+}
+
+void* pushSize(memory_arena& arena, uint64 size, uint64 alignment)
+{
+	// new returns memory aligned for any fundamental type, block offsets are aligned relative to that
+	uint64 offset = alignOffset(arena.used, alignment);
+	if (offset + size <= arena.size)
+	{
+		arena.used = offset + size;
+		if (arena.used + arena.overflowSize > arena.peakUsed)
+			arena.peakUsed = arena.used + arena.overflowSize;
+		return arena.memory + offset;
+	}
+
+	// a block of its own, padded so it can be aligned
+	uint64 blockSize = size + alignment;
+	uint8* block = allocateBlock(blockSize);
+	arena.overflowBlocks.push_back(block);
+	arena.overflowSize += blockSize;
+	if (arena.used + arena.overflowSize > arena.peakUsed)
+		arena.peakUsed = arena.used + arena.overflowSize;
+
+	return (void*)alignOffset((uint64)(uintptr_t)block, alignment);
+}
+
+void resetArena(memory_arena& arena)
+{
+	if (!arena.overflowBlocks.empty())
+	{
+		for (uint8* block : arena.overflowBlocks)
+			freeBlock(block);
+		arena.overflowBlocks.clear();
+		arena.overflowSize = 0;
+
+		// large enough for the peak so far, plus some room
+		uint64 size = arena.peakUsed + arena.peakUsed / 4;
+		if (arena.memory)
+			freeBlock(arena.memory);
+		arena.memory = allocateBlock(size);
+		arena.size = size;
+	}
+	arena.used = 0;
+}
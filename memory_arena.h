@@ -0,0 +1,46 @@
+#pragma once
+
+#include <vector>
+
+#include "common.h"
+
+// counts every operator new of the program on all threads, so a frame can check that neither it nor its jobs touched
+// the heap
+#define COUNT_HEAP_ALLOCATIONS 1
+
+// heap allocations of all threads so far, take snapshots before and after the work to count. always 0 without
+// COUNT_HEAP_ALLOCATIONS
+uint64 getHeapAllocationCount();
+
+// bump allocator for transient data, everything is freed at once by resetting it. one thread only.
+// if the block runs out, further allocations come from extra blocks until the next reset, which replaces the block
+// by one large enough for all of them. after the first few uses an arena never allocates from the heap again
+struct memory_arena
+{
+	uint8* memory = 0;
+	uint64 size = 0;
+	uint64 used = 0;
+
+	std::vector<uint8*> overflowBlocks;
+	uint64 overflowSize = 0;
+
+	uint64 peakUsed = 0;	// including the overflow
+};
+
+void createArena(memory_arena& arena, uint64 size);
+void deleteArena(memory_arena& arena);
+
+// never fails. the memory is not cleared
+void* pushSize(memory_arena& arena, uint64 size, uint64 alignment = 16);
+
+template <typename T>
+static inline T* pushArray(memory_arena& arena, uint64 count)
+{
+	return (T*)pushSize(arena, count * sizeof(T), alignof(T) > 16 ? alignof(T) : 16);
+}
+
+void resetArena(memory_arena& arena);
+
+// frees what was pushed after the marker was taken. overflow blocks are only freed by a full reset
+static inline uint64 getArenaMarker(const memory_arena& arena) { return arena.used; }
+static inline void resetArenaToMarker(memory_arena& arena, uint64 marker) { if (marker < arena.used) arena.used = marker; }
@@ -0,0 +1,416 @@
+#include "mesh_lod.h"
+#include "mesh_optimizer.h"
+
+
+#define LOD_CACHE_MAGIC 0x31444F4C // "LOD1"
+
+// area weighted quadric of the squared distance to a set of planes, stored as the upper triangle of a symmetric 4x4
+// matrix. evaluating it gives the weighted mean squared distance, so errors do not grow with the number of planes
+struct quadric
+{
+	double a00, a01, a02, a03;
+	double a11, a12, a13;
+	double a22, a23;
+	double a33;
+	double weight;
+};
+
+static inline void addPlane(quadric& q, double a, double b, double c, double d, double w)
+{
+	q.a00 += w * a * a; q.a01 += w * a * b; q.a02 += w * a * c; q.a03 += w * a * d;
+	q.a11 += w * b * b; q.a12 += w * b * c; q.a13 += w * b * d;
+	q.a22 += w * c * c; q.a23 += w * c * d;
+	q.a33 += w * d * d;
+	q.weight += w;
+}
+
+static inline void addQuadric(quadric& q, const quadric& other)
+{
+	q.a00 += other.a00; q.a01 += other.a01; q.a02 += other.a02; q.a03 += other.a03;
+	q.a11 += other.a11; q.a12 += other.a12; q.a13 += other.a13;
+	q.a22 += other.a22; q.a23 += other.a23;
+	q.a33 += other.a33;
+	q.weight += other.weight;
+}
+
+static inline float evaluateQuadric(const quadric& q, const vec3& p)
+{
+	double x = p.x, y = p.y, z = p.z;
+	double result = q.a00 * x * x + 2.0 * q.a01 * x * y + 2.0 * q.a02 * x * z + 2.0 * q.a03 * x
+		+ q.a11 * y * y + 2.0 * q.a12 * y * z + 2.0 * q.a13 * y
+		+ q.a22 * z * z + 2.0 * q.a23 * z
+		+ q.a33;
+	return q.weight > 0.0 ? (float)max(result / q.weight, 0.0) : 0.f;
+}
+
+static inline const vec3& getPosition(const uint8* vertices, uint32 vertexSize, uint32 index)
+{
+	return *(const vec3*)(vertices + index * vertexSize);
+}
+
+struct collapse
+{
+	uint32 from;
+	uint32 to;
+	float cost;
+
+	bool operator<(const collapse& other) const { return cost < other.cost; }
+};
+
+static inline uint64 edgeKey(uint32 a, uint32 b)
+{
+	return a < b ? ((uint64)a << 32) | b : ((uint64)b << 32) | a;
+}
+
+// true if moving vertex from onto to keeps all triangles around from facing the same way
+static bool keepsOrientation(const uint8* vertices, uint32 vertexSize, const std::vector<uint32>& indices,
+	const std::vector<uint32>& adjacencyOffsets, const std::vector<uint32>& adjacency, uint32 from, uint32 to)
+{
+	const vec3& target = getPosition(vertices, vertexSize, to);
+	for (uint32 i = adjacencyOffsets[from]; i < adjacencyOffsets[from + 1]; ++i)
+	{
+		const uint32* triangle = &indices[adjacency[i] * 3];
+		if (triangle[0] == to || triangle[1] == to || triangle[2] == to)
+			continue; // this one collapses
+
+		vec3 p[3], q[3];
+		for (uint32 k = 0; k < 3; ++k)
+		{
+			p[k] = getPosition(vertices, vertexSize, triangle[k]);
+			q[k] = triangle[k] == from ? target : p[k];
+		}
+
+		vec3 before = cross(p[1] - p[0], p[2] - p[0]);
+		vec3 after = cross(q[1] - q[0], q[2] - q[0]);
+		if (dot(before, after) <= 0.f)
+			return false;
+	}
+	return true;
+}
+
+std::vector<uint32> simplifyMesh(const uint8* vertices, uint32 vertexCount, uint32 vertexSize, const uint32* inputIndices, uint32 indexCount,
+	uint32 targetIndexCount, float& error)
+{
+	std::vector<uint32> indices(inputIndices, inputIndices + indexCount);
+	error = 0.f;
+
+	// vertices sharing a position (at uv or normal seams) are kept in place, so seams do not tear open
+	std::vector<uint32> positionGroup(vertexCount);
+	std::vector<uint32> groupSize(vertexCount, 0);
+	{
+		struct position_hash
+		{
+			size_t operator()(const vec3& p) const
+			{
+				uint32 h[3];
+				memcpy(h, &p.x, sizeof(h));
+				return (size_t)(h[0] * 73856093u ^ h[1] * 19349663u ^ h[2] * 83492791u);
+			}
+		};
+		struct position_equal
+		{
+			bool operator()(const vec3& a, const vec3& b) const { return a.x == b.x && a.y == b.y && a.z == b.z; }
+		};
+
+		std::unordered_map<vec3, uint32, position_hash, position_equal> groups;
+		groups.reserve(vertexCount);
+		for (uint32 v = 0; v < vertexCount; ++v)
+		{
+			uint32 group = groups.insert(std::make_pair(getPosition(vertices, vertexSize, v), v)).first->second;
+			positionGroup[v] = group;
+			++groupSize[group];
+		}
+	}
+
+	std::vector<uint8> locked(vertexCount, 0);
+	for (uint32 v = 0; v < vertexCount; ++v)
+		locked[v] = groupSize[positionGroup[v]] > 1;
+
+	// border edges belong to only one triangle, their vertices are kept in place as well
+	{
+		std::unordered_map<uint64, uint32> edgeCount;
+		edgeCount.reserve(indices.size());
+		for (uint32 i = 0; i < indices.size(); i += 3)
+		{
+			for (uint32 k = 0; k < 3; ++k)
+			{
+				uint32 a = positionGroup[indices[i + k]], b = positionGroup[indices[i + (k + 1) % 3]];
+				++edgeCount[edgeKey(a, b)];
+			}
+		}
+		for (uint32 i = 0; i < indices.size(); i += 3)
+		{
+			for (uint32 k = 0; k < 3; ++k)
+			{
+				uint32 a = indices[i + k], b = indices[i + (k + 1) % 3];
+				if (edgeCount[edgeKey(positionGroup[a], positionGroup[b])] == 1)
+					locked[a] = locked[b] = 1;
+			}
+		}
+	}
+
+	std::vector<quadric> quadrics(vertexCount);
+	memset(quadrics.data(), 0, vertexCount * sizeof(quadric));
+	for (uint32 i = 0; i < indices.size(); i += 3)
+	{
+		const vec3& p0 = getPosition(vertices, vertexSize, indices[i + 0]);
+		const vec3& p1 = getPosition(vertices, vertexSize, indices[i + 1]);
+		const vec3& p2 = getPosition(vertices, vertexSize, indices[i + 2]);
+
+		vec3 n = cross(p1 - p0, p2 - p0);
+		float l = length(n);
+		if (l == 0.f)
+			continue;
+		n = n / l;
+
+		for (uint32 k = 0; k < 3; ++k)
+			addPlane(quadrics[positionGroup[indices[i + k]]], n.x, n.y, n.z, -dot(n, p0), 0.5f * l);
+	}
+
+	std::vector<collapse> collapses;
+	std::vector<uint32> adjacencyOffsets(vertexCount + 1);
+	std::vector<uint32> adjacency;
+	std::vector<uint32> remap(vertexCount);
+	std::vector<uint8> touched(vertexCount);
+
+	while (indices.size() > targetIndexCount)
+	{
+		// vertex to triangle adjacency of the current mesh
+		std::fill(adjacencyOffsets.begin(), adjacencyOffsets.end(), 0);
+		for (uint32 i = 0; i < indices.size(); ++i)
+			++adjacencyOffsets[indices[i] + 1];
+		for (uint32 v = 0; v < vertexCount; ++v)
+			adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+		adjacency.resize(indices.size());
+		{
+			std::vector<uint32> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+			for (uint32 i = 0; i < indices.size(); ++i)
+				adjacency[fill[indices[i]]++] = i / 3;
+		}
+
+		collapses.clear();
+		for (uint32 i = 0; i < indices.size(); i += 3)
+		{
+			for (uint32 k = 0; k < 3; ++k)
+			{
+				uint32 a = indices[i + k], b = indices[i + (k + 1) % 3];
+				quadric q = quadrics[positionGroup[a]];
+				addQuadric(q, quadrics[positionGroup[b]]);
+
+				if (!locked[a])
+				{
+					collapse c = { a, b, evaluateQuadric(q, getPosition(vertices, vertexSize, b)) };
+					collapses.push_back(c);
+				}
+				if (!locked[b])
+				{
+					collapse c = { b, a, evaluateQuadric(q, getPosition(vertices, vertexSize, a)) };
+					collapses.push_back(c);
+				}
+			}
+		}
+		std::sort(collapses.begin(), collapses.end());
+
+		for (uint32 v = 0; v < vertexCount; ++v)
+			remap[v] = v;
+		std::fill(touched.begin(), touched.end(), 0);
+
+		// every collapse removes about two triangles
+		uint32 trianglesToRemove = (uint32)(indices.size() - targetIndexCount) / 3;
+		uint32 numberOfCollapses = 0;
+		for (const collapse& c : collapses)
+		{
+			if (numberOfCollapses * 2 >= trianglesToRemove)
+				break;
+			if (touched[c.from] || touched[c.to])
+				continue;
+			if (!keepsOrientation(vertices, vertexSize, indices, adjacencyOffsets, adjacency, c.from, c.to))
+				continue;
+
+			remap[c.from] = c.to;
+			addQuadric(quadrics[positionGroup[c.to]], quadrics[positionGroup[c.from]]);
+			error = max(error, c.cost);
+			++numberOfCollapses;
+
+			// the neighborhood changes shape, so no other collapse may rely on it in this pass
+			for (uint32 i = adjacencyOffsets[c.from]; i < adjacencyOffsets[c.from + 1]; ++i)
+			{
+				const uint32* triangle = &indices[adjacency[i] * 3];
+				touched[triangle[0]] = touched[triangle[1]] = touched[triangle[2]] = 1;
+			}
+		}
+
+		if (numberOfCollapses == 0)
+			break;
+
+		// apply and drop the collapsed triangles
+		uint32 writeIndex = 0;
+		for (uint32 i = 0; i < indices.size(); i += 3)
+		{
+			uint32 a = remap[indices[i + 0]], b = remap[indices[i + 1]], c = remap[indices[i + 2]];
+			if (a == b || b == c || c == a)
+				continue;
+			indices[writeIndex++] = a;
+			indices[writeIndex++] = b;
+			indices[writeIndex++] = c;
+		}
+		indices.resize(writeIndex);
+	}
+
+	error = sqrtf(error);
+	return indices;
+}
+
+void generateLods(const uint8* vertices, uint32 vertexCount, uint32 vertexSize, const uint32* indices, uint32 indexCount,
+	std::vector<mesh_lod_level>& lods)
+{
+	lods.clear();
+
+	uint32 previousIndexCount = indexCount;
+	for (uint32 level = 1; level < MAX_MESH_LODS; ++level)
+	{
+		uint32 targetIndexCount = (indexCount >> level) / 3 * 3;
+		if (targetIndexCount < 3 * 8)
+			break;
+
+		mesh_lod_level lod;
+		lod.indices = simplifyMesh(vertices, vertexCount, vertexSize, indices, indexCount, targetIndexCount, lod.error);
+
+		// not worth the extra index data
+		if (lod.indices.size() == 0 || lod.indices.size() > previousIndexCount * 3 / 4)
+			break;
+
+		// collapses leave the triangles in their original order, which no longer reuses vertices well
+		std::vector<uint32> simplifiedIndices = lod.indices;
+		optimizeVertexCache(lod.indices.data(), simplifiedIndices.data(), (uint32)simplifiedIndices.size(), vertexCount);
+
+		previousIndexCount = (uint32)lod.indices.size();
+		lods.push_back(lod);
+	}
+}
+
+uint64 hashMeshData(const void* vertices, uint32 vertexCount, uint32 vertexSize, const uint32* indices, uint32 indexCount)
+{
+	uint64 hash = hashBytes(vertices, (uint64)vertexCount * vertexSize);
+	return hashBytes(indices, (uint64)indexCount * sizeof(uint32), hash);
+}
+
+// file layout: magic, number of entries, then per entry the hash, the number of levels and per level the error, the
+// number of indices and the indices
+bool loadLodCache(mesh_lod_cache& cache, const std::string& filename)
+{
+	input_file file = readFile(filename.c_str());
+	if (!file.contents)
+		return false;
+
+	const uint8* read = (const uint8*)file.contents;
+	const uint8* end = read + file.size;
+
+	bool result = false;
+	uint32 header[2];
+	if (file.size >= sizeof(header))
+	{
+		memcpy(header, read, sizeof(header));
+		read += sizeof(header);
+		result = header[0] == LOD_CACHE_MAGIC;
+
+		for (uint32 e = 0; result && e < header[1]; ++e)
+		{
+			uint64 hash;
+			uint32 numberOfLevels;
+			if (end - read < (int64)(sizeof(hash) + sizeof(numberOfLevels)))
+			{
+				result = false;
+				break;
+			}
+			memcpy(&hash, read, sizeof(hash)); read += sizeof(hash);
+			memcpy(&numberOfLevels, read, sizeof(numberOfLevels)); read += sizeof(numberOfLevels);
+
+			// a corrupt count would allocate without bound
+			if (numberOfLevels > MAX_MESH_LODS - 1)
+			{
+				result = false;
+				break;
+			}
+
+			std::vector<mesh_lod_level>& lods = cache.entries[hash];
+			lods.resize(numberOfLevels);
+			for (uint32 l = 0; l < numberOfLevels; ++l)
+			{
+				uint32 indexCount;
+				if (end - read < (int64)(sizeof(float) + sizeof(uint32)))
+				{
+					result = false;
+					break;
+				}
+				memcpy(&lods[l].error, read, sizeof(float)); read += sizeof(float);
+				memcpy(&indexCount, read, sizeof(uint32)); read += sizeof(uint32);
+
+				if ((uint64)(end - read) < (uint64)indexCount * sizeof(uint32) || indexCount % 3 != 0)
+				{
+					result = false;
+					break;
+				}
+				lods[l].indices.resize(indexCount);
+				if (indexCount > 0)
+					memcpy(lods[l].indices.data(), read, indexCount * sizeof(uint32));
+				read += indexCount * sizeof(uint32);
+			}
+		}
+	}
+
+	if (!result)
+	{
+		std::cerr << "LOD cache " << filename << " is invalid, regenerating." << std::endl;
+		cache.entries.clear();
+	}
+
+	freeFile(file);
+	return result;
+}
+
+bool lodsMatchMesh(const std::vector<mesh_lod_level>& lods, uint32 vertexCount)
+{
+	for (const mesh_lod_level& lod : lods)
+	{
+		for (uint32 index : lod.indices)
+		{
+			if (index >= vertexCount)
+				return false;
+		}
+	}
+	return true;
+}
+
+template <typename T>
+static inline void writeValue(std::vector<uint8>& buffer, const T& value)
+{
+	const uint8* bytes = (const uint8*)&value;
+	buffer.insert(buffer.end(), bytes, bytes + sizeof(T));
+}
+
+bool saveLodCache(const mesh_lod_cache& cache, const std::string& filename)
+{
+	std::vector<uint8> buffer;
+	writeValue(buffer, (uint32)LOD_CACHE_MAGIC);
+	writeValue(buffer, (uint32)cache.entries.size());
+	for (const auto& entry : cache.entries)
+	{
+		writeValue(buffer, entry.first);
+		writeValue(buffer, (uint32)entry.second.size());
+		for (const mesh_lod_level& lod : entry.second)
+		{
+			writeValue(buffer, lod.error);
+			writeValue(buffer, (uint32)lod.indices.size());
+			const uint8* bytes = (const uint8*)lod.indices.data();
+			buffer.insert(buffer.end(), bytes, bytes + lod.indices.size() * sizeof(uint32));
+		}
+	}
+
+	if (!writeFile(filename.c_str(), buffer.data(), buffer.size()))
+	{
+		std::cerr << "Could not write LOD cache " << filename << "." << std::endl;
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <cstring>
+
+#include "common.h"
+#include "math.h"
+
+// level 0 is the full detail mesh
+#define MAX_MESH_LODS 4
+
+// a LOD is drawn once its error projects to less than this many pixels
+#define LOD_ERROR_THRESHOLD_PIXELS 1.f
+
+struct mesh_lod_level
+{
+	std::vector<uint32> indices;
+	float error; // object space distance to the full detail mesh
+};
+
+// simplified index lists of all meshes of one model file, keyed by a hash of the source vertices and indices
+struct mesh_lod_cache
+{
+	std::unordered_map<uint64, std::vector<mesh_lod_level>> entries;
+	bool dirty = false;
+};
+
+bool loadLodCache(mesh_lod_cache& cache, const std::string& filename);
+bool saveLodCache(const mesh_lod_cache& cache, const std::string& filename);
+
+// false if a cached entry indexes past the vertices of its mesh, it has to be regenerated then
+bool lodsMatchMesh(const std::vector<mesh_lod_level>& lods, uint32 vertexCount);
+
+uint64 hashMeshData(const void* vertices, uint32 vertexCount, uint32 vertexSize, const uint32* indices, uint32 indexCount);
+
+// quadric error edge collapse. vertices are only moved onto other existing vertices, so the result is a new index
+// list into the same vertex buffer. the position must be the first member of a vertex. returns at least
+// targetIndexCount indices, more if collapsing further would break borders, seams or flip triangles
+std::vector<uint32> simplifyMesh(const uint8* vertices, uint32 vertexCount, uint32 vertexSize, const uint32* indices, uint32 indexCount,
+	uint32 targetIndexCount, float& error);
+
+// levels 1 to MAX_MESH_LODS - 1, each with roughly half the triangles of the previous one. levels which would not
+// save enough triangles are left out, so this may return fewer
+void generateLods(const uint8* vertices, uint32 vertexCount, uint32 vertexSize, const uint32* indices, uint32 indexCount,
+	std::vector<mesh_lod_level>& lods);
+
+// coarsest level whose error, seen from distance, projects to less than LOD_ERROR_THRESHOLD_PIXELS.
+// pixelsPerUnit is the screen size of one unit at distance 1, i.e. 0.5 * screenHeight * proj.m11
+static inline uint32 selectLod(const float* errors, uint32 numberOfLods, float distance, float pixelsPerUnit)
+{
+	uint32 result = 0;
+	for (uint32 i = 1; i < numberOfLods; ++i)
+	{
+		if (errors[i] * pixelsPerUnit >= LOD_ERROR_THRESHOLD_PIXELS * distance)
+			break;
+		result = i;
+	}
+	return result;
+}
@@ -0,0 +1,585 @@
+#include "mesh_optimizer.h"
+
+#include <algorithm>
+#include <cstring>
+#include <cfloat>
+
+
+#define MESH_OPTIMIZATION_CACHE_MAGIC 0x3154504F // "OPT1"
+
+// the vertex cache optimization scores against a larger lru cache. it does not need to match the hardware, a larger
+// cache just makes the order degrade gracefully on smaller ones
+#define FORSYTH_CACHE_SIZE 32
+#define FORSYTH_MAX_VALENCE 32
+
+#define OVERDRAW_VIEWPORT_SIZE 256
+
+static inline const vec3& getPosition(const uint8* vertices, uint32 vertexSize, uint32 index)
+{
+	return *(const vec3*)(vertices + index * vertexSize);
+}
+
+struct forsyth_scores
+{
+	float cache[FORSYTH_CACHE_SIZE];
+	float valence[FORSYTH_MAX_VALENCE + 1];
+};
+
+static void initializeForsythScores(forsyth_scores& scores)
+{
+	// the vertices of the last triangle get a fixed score, so the next triangle does not just rotate around them
+	for (uint32 i = 0; i < FORSYTH_CACHE_SIZE; ++i)
+		scores.cache[i] = (i < 3) ? 0.75f : powf(1.f - (float)(i - 3) / (FORSYTH_CACHE_SIZE - 3), 1.5f);
+
+	// vertices with few triangles left are preferred, so they leave the mesh early and do not need to be fetched again
+	scores.valence[0] = 0.f;
+	for (uint32 i = 1; i <= FORSYTH_MAX_VALENCE; ++i)
+		scores.valence[i] = 2.f / sqrtf((float)i);
+}
+
+static inline float getVertexScore(const forsyth_scores& scores, int32 cachePosition, uint32 remainingTriangles)
+{
+	if (remainingTriangles == 0)
+		return -1.f;
+
+	float score = (cachePosition >= 0) ? scores.cache[cachePosition] : 0.f;
+	return score + scores.valence[min(remainingTriangles, (uint32)FORSYTH_MAX_VALENCE)];
+}
+
+void optimizeVertexCache(uint32* destination, const uint32* indices, uint32 indexCount, uint32 vertexCount)
+{
+	uint32 triangleCount = indexCount / 3;
+	if (triangleCount == 0)
+		return;
+
+	forsyth_scores scores;
+	initializeForsythScores(scores);
+
+	// vertex to triangle adjacency. triangles are removed from a vertex' list once they are emitted
+	std::vector<uint32> adjacencyOffsets(vertexCount + 1, 0);
+	std::vector<uint32> remaining(vertexCount, 0);
+	for (uint32 i = 0; i < indexCount; ++i)
+		++remaining[indices[i]];
+	for (uint32 v = 0; v < vertexCount; ++v)
+		adjacencyOffsets[v + 1] = adjacencyOffsets[v] + remaining[v];
+
+	std::vector<uint32> adjacency(indexCount);
+	{
+		std::vector<uint32> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+		for (uint32 i = 0; i < indexCount; ++i)
+			adjacency[fill[indices[i]]++] = i / 3;
+	}
+
+	std::vector<int32> cachePositions(vertexCount, -1);
+	std::vector<float> vertexScores(vertexCount);
+	for (uint32 v = 0; v < vertexCount; ++v)
+		vertexScores[v] = getVertexScore(scores, -1, remaining[v]);
+
+	std::vector<float> triangleScores(triangleCount);
+	for (uint32 t = 0; t < triangleCount; ++t)
+		triangleScores[t] = vertexScores[indices[t * 3 + 0]] + vertexScores[indices[t * 3 + 1]] + vertexScores[indices[t * 3 + 2]];
+
+	std::vector<uint8> emitted(triangleCount, 0);
+
+	uint32 cache[FORSYTH_CACHE_SIZE + 3];
+	uint32 cacheCount = 0;
+
+	uint32 bestTriangle = 0;
+	for (uint32 t = 1; t < triangleCount; ++t)
+	{
+		if (triangleScores[t] > triangleScores[bestTriangle])
+			bestTriangle = t;
+	}
+
+	uint32 scanCursor = 0;
+	uint32 outputIndex = 0;
+	while (bestTriangle != ~0u)
+	{
+		const uint32* triangle = &indices[bestTriangle * 3];
+		destination[outputIndex++] = triangle[0];
+		destination[outputIndex++] = triangle[1];
+		destination[outputIndex++] = triangle[2];
+		emitted[bestTriangle] = 1;
+
+		// the triangle's vertices move to the front, everything else keeps its order
+		uint32 newCache[FORSYTH_CACHE_SIZE + 3];
+		uint32 newCacheCount = 0;
+		for (uint32 k = 0; k < 3; ++k)
+		{
+			uint32 v = triangle[k];
+			if (std::find(newCache, newCache + newCacheCount, v) == newCache + newCacheCount)
+				newCache[newCacheCount++] = v;
+
+			uint32* begin = &adjacency[adjacencyOffsets[v]];
+			uint32* end = begin + remaining[v];
+			uint32* it = std::find(begin, end, bestTriangle);
+			if (it != end)
+			{
+				*it = *(end - 1);
+				--remaining[v];
+			}
+		}
+		for (uint32 i = 0; i < cacheCount; ++i)
+		{
+			uint32 v = cache[i];
+			if (std::find(newCache, newCache + newCacheCount, v) == newCache + newCacheCount)
+				newCache[newCacheCount++] = v;
+		}
+
+		// evicted vertices lose their cache score
+		for (uint32 i = FORSYTH_CACHE_SIZE; i < newCacheCount; ++i)
+		{
+			cachePositions[newCache[i]] = -1;
+			vertexScores[newCache[i]] = getVertexScore(scores, -1, remaining[newCache[i]]);
+		}
+		cacheCount = min(newCacheCount, (uint32)FORSYTH_CACHE_SIZE);
+		memcpy(cache, newCache, cacheCount * sizeof(uint32));
+
+		for (uint32 i = 0; i < cacheCount; ++i)
+		{
+			cachePositions[cache[i]] = (int32)i;
+			vertexScores[cache[i]] = getVertexScore(scores, (int32)i, remaining[cache[i]]);
+		}
+
+		// only triangles around cached or evicted vertices changed their score, the best of them comes next
+		bestTriangle = ~0u;
+		float bestScore = -FLT_MAX;
+		for (uint32 i = 0; i < newCacheCount; ++i)
+		{
+			uint32 v = newCache[i];
+			for (uint32 j = adjacencyOffsets[v]; j < adjacencyOffsets[v] + remaining[v]; ++j)
+			{
+				uint32 t = adjacency[j];
+				const uint32* other = &indices[t * 3];
+				float score = vertexScores[other[0]] + vertexScores[other[1]] + vertexScores[other[2]];
+				triangleScores[t] = score;
+				if (score > bestScore)
+				{
+					bestScore = score;
+					bestTriangle = t;
+				}
+			}
+		}
+
+		// dead end, continue with the next triangle in input order. scanning for the best score would be quadratic
+		if (bestTriangle == ~0u)
+		{
+			while (scanCursor < triangleCount && emitted[scanCursor])
+				++scanCursor;
+			if (scanCursor < triangleCount)
+				bestTriangle = scanCursor;
+		}
+	}
+}
+
+// counts the vertices that miss a fifo cache of VERTEX_CACHE_SIZE. cacheTimestamps holds the time each vertex was last
+// loaded, a vertex is still cached if fewer than VERTEX_CACHE_SIZE others were loaded since
+static inline uint32 updateFifoCache(uint32 a, uint32 b, uint32 c, std::vector<uint32>& cacheTimestamps, uint32& timestamp)
+{
+	uint32 misses = 0;
+	uint32 triangle[3] = { a, b, c };
+	for (uint32 k = 0; k < 3; ++k)
+	{
+		if (timestamp - cacheTimestamps[triangle[k]] > VERTEX_CACHE_SIZE)
+		{
+			cacheTimestamps[triangle[k]] = timestamp++;
+			++misses;
+		}
+	}
+	return misses;
+}
+
+struct overdraw_cluster
+{
+	uint32 start, end;	// triangle range
+	float sortKey;
+};
+
+void optimizeOverdraw(uint32* destination, const uint32* indices, uint32 indexCount, const uint8* vertices, uint32 vertexCount, uint32 vertexSize,
+	float threshold)
+{
+	uint32 triangleCount = indexCount / 3;
+	if (triangleCount == 0)
+		return;
+
+	// hard boundaries are where the cache order starts over anyway, all three vertices miss
+	std::vector<uint32> hardBoundaries;
+	std::vector<uint32> cacheTimestamps(vertexCount, 0);
+	uint32 timestamp = VERTEX_CACHE_SIZE + 1;
+	for (uint32 t = 0; t < triangleCount; ++t)
+	{
+		const uint32* triangle = &indices[t * 3];
+		if (updateFifoCache(triangle[0], triangle[1], triangle[2], cacheTimestamps, timestamp) == 3 || t == 0)
+			hardBoundaries.push_back(t);
+	}
+	hardBoundaries.push_back(triangleCount);
+
+	// soft boundaries split a hard cluster further wherever the miss ratio since the last split is already good enough
+	std::vector<overdraw_cluster> clusters;
+	for (uint32 h = 0; h + 1 < hardBoundaries.size(); ++h)
+	{
+		uint32 start = hardBoundaries[h], end = hardBoundaries[h + 1];
+
+		timestamp += VERTEX_CACHE_SIZE + 1;
+		uint32 clusterMisses = 0;
+		for (uint32 t = start; t < end; ++t)
+			clusterMisses += updateFifoCache(indices[t * 3 + 0], indices[t * 3 + 1], indices[t * 3 + 2], cacheTimestamps, timestamp);
+		float targetAcmr = threshold * (float)clusterMisses / (float)(end - start);
+
+		timestamp += VERTEX_CACHE_SIZE + 1;
+		uint32 clusterStart = start;
+		uint32 misses = 0;
+		for (uint32 t = start; t < end; ++t)
+		{
+			misses += updateFifoCache(indices[t * 3 + 0], indices[t * 3 + 1], indices[t * 3 + 2], cacheTimestamps, timestamp);
+			if ((float)misses / (float)(t - clusterStart + 1) <= targetAcmr && t + 1 < end)
+			{
+				overdraw_cluster cluster = { clusterStart, t + 1, 0.f };
+				clusters.push_back(cluster);
+				clusterStart = t + 1;
+				misses = 0;
+				timestamp += VERTEX_CACHE_SIZE + 1;
+			}
+		}
+		overdraw_cluster cluster = { clusterStart, end, 0.f };
+		clusters.push_back(cluster);
+	}
+
+	// area weighted centroid of the whole mesh
+	vec3 meshCentroid(0.f, 0.f, 0.f);
+	float meshArea = 0.f;
+	for (uint32 i = 0; i < indexCount; i += 3)
+	{
+		const vec3& p0 = getPosition(vertices, vertexSize, indices[i + 0]);
+		const vec3& p1 = getPosition(vertices, vertexSize, indices[i + 1]);
+		const vec3& p2 = getPosition(vertices, vertexSize, indices[i + 2]);
+		float area = length(cross(p1 - p0, p2 - p0));
+		meshCentroid = meshCentroid + (p0 + p1 + p2) * (area / 3.f);
+		meshArea += area;
+	}
+	if (meshArea > 0.f)
+		meshCentroid = meshCentroid / meshArea;
+
+	// clusters far out along their average normal face away from the rest of the mesh and are likely in front of it
+	for (overdraw_cluster& cluster : clusters)
+	{
+		vec3 centroid(0.f, 0.f, 0.f);
+		vec3 normal(0.f, 0.f, 0.f);
+		float clusterArea = 0.f;
+		for (uint32 t = cluster.start; t < cluster.end; ++t)
+		{
+			const vec3& p0 = getPosition(vertices, vertexSize, indices[t * 3 + 0]);
+			const vec3& p1 = getPosition(vertices, vertexSize, indices[t * 3 + 1]);
+			const vec3& p2 = getPosition(vertices, vertexSize, indices[t * 3 + 2]);
+			vec3 n = cross(p1 - p0, p2 - p0);
+			float area = length(n);
+			centroid = centroid + (p0 + p1 + p2) * (area / 3.f);
+			normal = normal + n;
+			clusterArea += area;
+		}
+		if (clusterArea > 0.f)
+			centroid = centroid / clusterArea;
+
+		float normalLength = length(normal);
+		cluster.sortKey = (normalLength > 0.f) ? dot(centroid - meshCentroid, normal / normalLength) : 0.f;
+	}
+
+	// stable, so equal clusters keep their cache friendly order
+	std::stable_sort(clusters.begin(), clusters.end(),
+		[](const overdraw_cluster& a, const overdraw_cluster& b) { return a.sortKey > b.sortKey; });
+
+	uint32 outputIndex = 0;
+	for (const overdraw_cluster& cluster : clusters)
+	{
+		memcpy(destination + outputIndex, indices + cluster.start * 3, (cluster.end - cluster.start) * 3 * sizeof(uint32));
+		outputIndex += (cluster.end - cluster.start) * 3;
+	}
+}
+
+uint32 optimizeVertexFetch(uint32* vertexRemap, uint32* indices, uint32 indexCount, uint32 vertexCount)
+{
+	std::vector<uint32> newIndices(vertexCount, ~0u);
+	uint32 numberOfVertices = 0;
+	for (uint32 i = 0; i < indexCount; ++i)
+	{
+		uint32 v = indices[i];
+		if (newIndices[v] == ~0u)
+		{
+			newIndices[v] = numberOfVertices;
+			vertexRemap[numberOfVertices++] = v;
+		}
+		indices[i] = newIndices[v];
+	}
+	return numberOfVertices;
+}
+
+struct overdraw_buffer
+{
+	float depth[OVERDRAW_VIEWPORT_SIZE][OVERDRAW_VIEWPORT_SIZE];
+	uint32 shaded[OVERDRAW_VIEWPORT_SIZE][OVERDRAW_VIEWPORT_SIZE];
+};
+
+static inline float edgeFunction(float ax, float ay, float bx, float by, float px, float py)
+{
+	return (bx - ax) * (py - ay) - (by - ay) * (px - ax);
+}
+
+// top left fill rule, so pixels on shared edges are only shaded once
+static inline bool isTopLeft(float ax, float ay, float bx, float by)
+{
+	return (ay == by && bx < ax) || by < ay;
+}
+
+// p holds screen x, y and depth. draws counter clockwise triangles with a depth test, counting every shaded pixel
+static void rasterizeTriangle(overdraw_buffer& buffer, const vec3& p0, const vec3& p1, const vec3& p2)
+{
+	float area = edgeFunction(p0.x, p0.y, p1.x, p1.y, p2.x, p2.y);
+	if (area <= 0.f)
+		return;
+
+	int32 minX = max((int32)floorf(min(p0.x, min(p1.x, p2.x))), 0);
+	int32 minY = max((int32)floorf(min(p0.y, min(p1.y, p2.y))), 0);
+	int32 maxX = min((int32)ceilf(max(p0.x, max(p1.x, p2.x))), OVERDRAW_VIEWPORT_SIZE - 1);
+	int32 maxY = min((int32)ceilf(max(p0.y, max(p1.y, p2.y))), OVERDRAW_VIEWPORT_SIZE - 1);
+
+	bool topLeft0 = isTopLeft(p1.x, p1.y, p2.x, p2.y);
+	bool topLeft1 = isTopLeft(p2.x, p2.y, p0.x, p0.y);
+	bool topLeft2 = isTopLeft(p0.x, p0.y, p1.x, p1.y);
+
+	for (int32 y = minY; y <= maxY; ++y)
+	{
+		for (int32 x = minX; x <= maxX; ++x)
+		{
+			float px = x + 0.5f, py = y + 0.5f;
+			float w0 = edgeFunction(p1.x, p1.y, p2.x, p2.y, px, py);
+			float w1 = edgeFunction(p2.x, p2.y, p0.x, p0.y, px, py);
+			float w2 = edgeFunction(p0.x, p0.y, p1.x, p1.y, px, py);
+			if (w0 < 0.f || w1 < 0.f || w2 < 0.f)
+				continue;
+			if ((w0 == 0.f && !topLeft0) || (w1 == 0.f && !topLeft1) || (w2 == 0.f && !topLeft2))
+				continue;
+
+			float depth = (w0 * p0.z + w1 * p1.z + w2 * p2.z) / area;
+			if (depth < buffer.depth[y][x])
+			{
+				buffer.depth[y][x] = depth;
+				++buffer.shaded[y][x];
+			}
+		}
+	}
+}
+
+mesh_statistics analyzeMesh(const uint32* indices, uint32 indexCount, const uint8* vertices, uint32 vertexCount, uint32 vertexSize)
+{
+	mesh_statistics result = { 0.f, 0.f, 0.f };
+	uint32 triangleCount = indexCount / 3;
+	if (triangleCount == 0)
+		return result;
+
+	std::vector<uint32> cacheTimestamps(vertexCount, 0);
+	std::vector<uint8> used(vertexCount, 0);
+	uint32 timestamp = VERTEX_CACHE_SIZE + 1;
+	uint32 misses = 0;
+	uint32 usedVertices = 0;
+	for (uint32 i = 0; i < indexCount; i += 3)
+	{
+		misses += updateFifoCache(indices[i + 0], indices[i + 1], indices[i + 2], cacheTimestamps, timestamp);
+		for (uint32 k = 0; k < 3; ++k)
+		{
+			usedVertices += !used[indices[i + k]];
+			used[indices[i + k]] = 1;
+		}
+	}
+	result.acmr = (float)misses / (float)triangleCount;
+	result.atvr = (float)misses / (float)usedVertices;
+
+	// overdraw from both sides along every axis, with the mesh fit into the viewport
+	vec3 minCorner(FLT_MAX, FLT_MAX, FLT_MAX), maxCorner(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+	for (uint32 i = 0; i < indexCount; ++i)
+	{
+		const vec3& p = getPosition(vertices, vertexSize, indices[i]);
+		minCorner = vec3(min(minCorner.x, p.x), min(minCorner.y, p.y), min(minCorner.z, p.z));
+		maxCorner = vec3(max(maxCorner.x, p.x), max(maxCorner.y, p.y), max(maxCorner.z, p.z));
+	}
+	vec3 extent = maxCorner - minCorner;
+	float scale = max(extent.x, max(extent.y, extent.z));
+	scale = (scale > 0.f) ? (OVERDRAW_VIEWPORT_SIZE - 1) / scale : 0.f;
+
+	overdraw_buffer* buffer = new overdraw_buffer;
+	uint64 shadedPixels = 0, coveredPixels = 0;
+	for (uint32 axis = 0; axis < 3; ++axis)
+	{
+		for (uint32 side = 0; side < 2; ++side)
+		{
+			for (uint32 y = 0; y < OVERDRAW_VIEWPORT_SIZE; ++y)
+			{
+				for (uint32 x = 0; x < OVERDRAW_VIEWPORT_SIZE; ++x)
+					buffer->depth[y][x] = FLT_MAX;
+			}
+			memset(buffer->shaded, 0, sizeof(buffer->shaded));
+
+			// looking down the axis from the positive side keeps the winding of the cyclic (axis, axis + 1, axis + 2)
+			// basis, from the negative side the screen x axis is mirrored
+			float sign = side ? -1.f : 1.f;
+			for (uint32 i = 0; i < indexCount; i += 3)
+			{
+				vec3 screen[3];
+				for (uint32 k = 0; k < 3; ++k)
+				{
+					vec3 p = (getPosition(vertices, vertexSize, indices[i + k]) - minCorner) * scale;
+					float c[3] = { p.x, p.y, p.z };
+					float u = c[(axis + 1) % 3], v = c[(axis + 2) % 3];
+					screen[k] = vec3(side ? (OVERDRAW_VIEWPORT_SIZE - 1) - u : u, v, -sign * c[axis]);
+				}
+				rasterizeTriangle(*buffer, screen[0], screen[1], screen[2]);
+			}
+
+			for (uint32 y = 0; y < OVERDRAW_VIEWPORT_SIZE; ++y)
+			{
+				for (uint32 x = 0; x < OVERDRAW_VIEWPORT_SIZE; ++x)
+				{
+					shadedPixels += buffer->shaded[y][x];
+					coveredPixels += buffer->shaded[y][x] > 0;
+				}
+			}
+		}
+	}
+	delete buffer;
+
+	result.overdraw = coveredPixels ? (float)shadedPixels / (float)coveredPixels : 0.f;
+	return result;
+}
+
+void optimizeMesh(optimized_mesh& result, const uint8* vertices, uint32 vertexCount, uint32 vertexSize, const uint32* indices, uint32 indexCount)
+{
+	result.before = analyzeMesh(indices, indexCount, vertices, vertexCount, vertexSize);
+
+	std::vector<uint32> cacheOptimized(indexCount);
+	optimizeVertexCache(cacheOptimized.data(), indices, indexCount, vertexCount);
+
+	result.indices.resize(indexCount);
+	optimizeOverdraw(result.indices.data(), cacheOptimized.data(), indexCount, vertices, vertexCount, vertexSize);
+
+	result.vertexRemap.resize(vertexCount);
+	uint32 numberOfVertices = optimizeVertexFetch(result.vertexRemap.data(), result.indices.data(), indexCount, vertexCount);
+	result.vertexRemap.resize(numberOfVertices);
+
+	std::vector<uint8> remappedVertices((size_t)numberOfVertices * vertexSize);
+	for (uint32 v = 0; v < numberOfVertices; ++v)
+		memcpy(&remappedVertices[(size_t)v * vertexSize], vertices + (size_t)result.vertexRemap[v] * vertexSize, vertexSize);
+	result.after = analyzeMesh(result.indices.data(), indexCount, remappedVertices.data(), numberOfVertices, vertexSize);
+}
+
+template <typename T>
+static inline void writeValue(std::vector<uint8>& buffer, const T& value)
+{
+	const uint8* bytes = (const uint8*)&value;
+	buffer.insert(buffer.end(), bytes, bytes + sizeof(T));
+}
+
+static inline void writeArray(std::vector<uint8>& buffer, const std::vector<uint32>& values)
+{
+	writeValue(buffer, (uint32)values.size());
+	const uint8* bytes = (const uint8*)values.data();
+	buffer.insert(buffer.end(), bytes, bytes + values.size() * sizeof(uint32));
+}
+
+static inline bool readArray(const uint8*& read, const uint8* end, std::vector<uint32>& values)
+{
+	uint32 count;
+	if ((uint64)(end - read) < sizeof(count))
+		return false;
+	memcpy(&count, read, sizeof(count)); read += sizeof(count);
+
+	if ((uint64)(end - read) < (uint64)count * sizeof(uint32))
+		return false;
+	values.resize(count);
+	if (count > 0)
+		memcpy(values.data(), read, count * sizeof(uint32));
+	read += count * sizeof(uint32);
+	return true;
+}
+
+// file layout: magic, number of entries, then per entry the hash, the statistics before and after, the number of
+// indices and the indices, the number of vertices and the vertex remap
+bool loadMeshOptimizationCache(mesh_optimization_cache& cache, const std::string& filename)
+{
+	input_file file = readFile(filename.c_str());
+	if (!file.contents)
+		return false;
+
+	const uint8* read = (const uint8*)file.contents;
+	const uint8* end = read + file.size;
+
+	bool result = false;
+	uint32 header[2];
+	if (file.size >= sizeof(header))
+	{
+		memcpy(header, read, sizeof(header));
+		read += sizeof(header);
+		result = header[0] == MESH_OPTIMIZATION_CACHE_MAGIC;
+
+		for (uint32 e = 0; result && e < header[1]; ++e)
+		{
+			uint64 hash;
+			if (end - read < (int64)(sizeof(hash) + 2 * sizeof(mesh_statistics)))
+			{
+				result = false;
+				break;
+			}
+			memcpy(&hash, read, sizeof(hash)); read += sizeof(hash);
+
+			optimized_mesh& mesh = cache.entries[hash];
+			memcpy(&mesh.before, read, sizeof(mesh_statistics)); read += sizeof(mesh_statistics);
+			memcpy(&mesh.after, read, sizeof(mesh_statistics)); read += sizeof(mesh_statistics);
+
+			result = readArray(read, end, mesh.indices) && readArray(read, end, mesh.vertexRemap);
+		}
+	}
+
+	if (!result)
+	{
+		std::cerr << "Mesh optimization cache " << filename << " is invalid, regenerating." << std::endl;
+		cache.entries.clear();
+	}
+
+	freeFile(file);
+	return result;
+}
+
+bool optimizedMeshMatches(const optimized_mesh& mesh, uint32 sourceVertexCount)
+{
+	for (uint32 source : mesh.vertexRemap)
+	{
+		if (source >= sourceVertexCount)
+			return false;
+	}
+	for (uint32 index : mesh.indices)
+	{
+		if (index >= mesh.vertexRemap.size())
+			return false;
+	}
+	return mesh.indices.size() % 3 == 0;
+}
+
+bool saveMeshOptimizationCache(const mesh_optimization_cache& cache, const std::string& filename)
+{
+	std::vector<uint8> buffer;
+	writeValue(buffer, (uint32)MESH_OPTIMIZATION_CACHE_MAGIC);
+	writeValue(buffer, (uint32)cache.entries.size());
+	for (const auto& entry : cache.entries)
+	{
+		writeValue(buffer, entry.first);
+		writeValue(buffer, entry.second.before);
+		writeValue(buffer, entry.second.after);
+		writeArray(buffer, entry.second.indices);
+		writeArray(buffer, entry.second.vertexRemap);
+	}
+
+	if (!writeFile(filename.c_str(), buffer.data(), buffer.size()))
+	{
+		std::cerr << "Could not write mesh optimization cache " << filename << "." << std::endl;
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <vector>
+#include <unordered_map>
+#include <string>
+
+#include "common.h"
+#include "math.h"
+
+// post transform cache model for statistics and overdraw clustering. a fifo is closer to real hardware than lru
+#define VERTEX_CACHE_SIZE 16
+
+// clusters may be split for overdraw sorting as long as the cache miss ratio gets at most this much worse
+#define OVERDRAW_THRESHOLD 1.05f
+
+struct mesh_statistics
+{
+	float acmr;		// average cache miss ratio, transformed vertices per triangle. 0.5 is the best possible
+	float atvr;		// average transformed vertex ratio, transformed vertices per vertex. 1 is the best possible
+	float overdraw;	// shaded pixels per covered pixel, over six axis aligned views
+};
+
+struct optimized_mesh
+{
+	std::vector<uint32> indices;		// into the remapped vertices
+	std::vector<uint32> vertexRemap;	// new vertex index -> original vertex index, unused vertices are dropped
+	mesh_statistics before, after;
+};
+
+// optimized meshes of one model file, keyed by a hash of the source vertices and indices
+struct mesh_optimization_cache
+{
+	std::unordered_map<uint64, optimized_mesh> entries;
+	bool dirty = false;
+};
+
+bool loadMeshOptimizationCache(mesh_optimization_cache& cache, const std::string& filename);
+bool saveMeshOptimizationCache(const mesh_optimization_cache& cache, const std::string& filename);
+
+// false if a cached entry remaps from past the source vertices or indexes past its remapped ones, it has to be
+// optimized again then
+bool optimizedMeshMatches(const optimized_mesh& mesh, uint32 sourceVertexCount);
+
+// reorders triangles so vertices are reused while they are still in the post transform cache (Forsyth)
+void optimizeVertexCache(uint32* destination, const uint32* indices, uint32 indexCount, uint32 vertexCount);
+
+// splits the triangles into clusters without hurting the cache much and sorts the clusters so outward facing ones
+// come first, which occlude the rest from most directions. expects cache optimized indices. the position must be the
+// first member of a vertex
+void optimizeOverdraw(uint32* destination, const uint32* indices, uint32 indexCount, const uint8* vertices, uint32 vertexCount, uint32 vertexSize,
+	float threshold = OVERDRAW_THRESHOLD);
+
+// renumbers vertices in order of first use, so vertex fetch walks through memory linearly. indices are changed in
+// place, vertexRemap needs room for vertexCount entries. returns the number of used vertices
+uint32 optimizeVertexFetch(uint32* vertexRemap, uint32* indices, uint32 indexCount, uint32 vertexCount);
+
+mesh_statistics analyzeMesh(const uint32* indices, uint32 indexCount, const uint8* vertices, uint32 vertexCount, uint32 vertexSize);
+
+// all of the above, with statistics before and after
+void optimizeMesh(optimized_mesh& result, const uint8* vertices, uint32 vertexCount, uint32 vertexSize, const uint32* indices, uint32 indexCount);
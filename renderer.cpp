@@ -1,4 +1,5 @@
 #include "renderer.h"
+#include "math_batch.h"
 
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
@@ -8,11 +9,17 @@
 #include <stb/stb_image.h>
 
 #include <string>
+#include <cstring>
+#include <cstddef>
+#include <cfloat>
+#include <algorithm>
 
 #include "scene.h"
 
 
-static bool loadTexture(opengl_texture& texture, const std::string& filename);
+static bool loadTexture(opengl_scene_resources& resources, opengl_texture& texture, const std::string& filename, texture_usage usage);
+static bool loadCompressedTextureHeader(compressed_texture& texture, const std::string& filepath, texture_usage usage);
+static bool encodeTexture(compressed_texture& texture, const std::string& filepath, texture_usage usage);
 
 
 #pragma pack(push, 1)
@@ -30,16 +37,71 @@ struct vertex3PTNT
 	vec3 nor;
 	vec3 tan;
 };
+
+// pool layouts if QUANTIZE_VERTICES is set. positions and texture coordinates are unorm16 relative to the bounds of
+// their mesh, normals and tangents are octahedral encoded snorm16
+struct vertex3PTN_quantized
+{
+	uint16 pos[4]; // w is padding
+	uint16 tex[2];
+	int16 nor[2];
+};
+
+struct vertex3PTNT_quantized
+{
+	uint16 pos[4];
+	uint16 tex[2];
+	int16 nor[2];
+	int16 tan[2];
+};
 #pragma pack(pop)
 
-static void uploadVertexData(opengl_mesh& mesh, const std::vector<vertex3PTN>& vertices, const std::vector<uint32>& indices)
+static inline uint16 quantizeUnorm16(float v)
+{
+	return (uint16)(clamp(v, 0.f, 1.f) * 65535.f + 0.5f);
+}
+
+static inline int16 quantizeSnorm16(float v)
+{
+	float scaled = clamp(v, -1.f, 1.f) * 32767.f;
+	return (int16)(scaled >= 0.f ? scaled + 0.5f : scaled - 0.5f);
+}
+
+// maps the unit sphere onto the [-1, 1] square. the lower hemisphere is folded over the diagonals
+static void encodeOctahedral(const vec3& n, int16* result)
+{
+	float sum = fabsf(n.x) + fabsf(n.y) + fabsf(n.z);
+	float x = (sum > 0.f) ? n.x / sum : 0.f;
+	float y = (sum > 0.f) ? n.y / sum : 0.f;
+	if (n.z < 0.f)
+	{
+		float foldedX = (1.f - fabsf(y)) * (x >= 0.f ? 1.f : -1.f);
+		float foldedY = (1.f - fabsf(x)) * (y >= 0.f ? 1.f : -1.f);
+		x = foldedX;
+		y = foldedY;
+	}
+	result[0] = quantizeSnorm16(x);
+	result[1] = quantizeSnorm16(y);
+}
+
+// the vertex data written to the pool, float or quantized
+static uint32 getPoolVertexSize(vertex_format format)
+{
+#if QUANTIZE_VERTICES
+	return (format == VERTEX_FORMAT_PTNT) ? sizeof(vertex3PTNT_quantized) : sizeof(vertex3PTN_quantized);
+#else
+	return (format == VERTEX_FORMAT_PTNT) ? sizeof(vertex3PTNT) : sizeof(vertex3PTN);
+#endif
+}
+
+static void uploadVertexData(opengl_mesh& mesh, const vertex3PTN* vertices, uint32 vertexCount, const uint32* indices, uint32 indexCount)
 {
 	glGenVertexArrays(1, &mesh.vao);
 	glBindVertexArray(mesh.vao);
 
 	glGenBuffers(1, &mesh.vbo);
 	glBindBuffer(GL_ARRAY_BUFFER, mesh.vbo);
-	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(vertex3PTN), &vertices[0], GL_STATIC_DRAW);
+	glBufferData(GL_ARRAY_BUFFER, vertexCount * sizeof(vertex3PTN), vertices, GL_STATIC_DRAW);
 
 	// positions
 	glEnableVertexAttribArray(0);
@@ -55,45 +117,801 @@ static void uploadVertexData(opengl_mesh& mesh, const std::vector<vertex3PTN>& v
 
 	glGenBuffers(1, &mesh.ibo);
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.ibo);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(uint32), &indices[0], GL_STATIC_DRAW);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCount * sizeof(uint32), indices, GL_STATIC_DRAW);
 
 	glBindVertexArray(0);
 }
 
-static void uploadVertexData(opengl_mesh& mesh, const std::vector<vertex3PTNT>& vertices, const std::vector<uint32>& indices)
+// converts the vertices to the pool layout. the mesh gets the transforms which undo the quantization, all vertex
+// formats start with position, texCoords and normal
+static uint32 appendVertices(opengl_geometry_pool& pool, opengl_mesh& mesh, const void* vertices, uint32 vertexCount, uint32 vertexSize)
 {
-	glGenVertexArrays(1, &mesh.vao);
-	glBindVertexArray(mesh.vao);
+	uint32 baseVertex = pool.vertexCount;
+	const uint8* bytes = (const uint8*)vertices;
+	pool.vertexCount += vertexCount;
+
+#if QUANTIZE_VERTICES
+	// one scale for all axes, so normals are not distorted when it is folded into the model view matrix
+	bounding_box bounds = emptyBoundingBox();
+	vec2 texMin(FLT_MAX), texMax(-FLT_MAX);
+	for (uint32 i = 0; i < vertexCount; ++i)
+	{
+		const vertex3PTN& v = *(const vertex3PTN*)(bytes + i * vertexSize);
+		growBoundingBox(bounds, v.pos);
+		texMin = vec2(min(texMin.x, v.tex.x), min(texMin.y, v.tex.y));
+		texMax = vec2(max(texMax.x, v.tex.x), max(texMax.y, v.tex.y));
+	}
+	vec3 extent = bounds.maxCorner - bounds.minCorner;
+	float positionScale = max(max(extent.x, extent.y), max(extent.z, 1e-6f));
+	vec2 texScale(max(texMax.x - texMin.x, 1e-6f), max(texMax.y - texMin.y, 1e-6f));
 
-	glGenBuffers(1, &mesh.vbo);
-	glBindBuffer(GL_ARRAY_BUFFER, mesh.vbo);
-	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(vertex3PTNT), &vertices[0], GL_STATIC_DRAW);
+	mesh.dequantization = createModelMatrix(bounds.minCorner, quat(), positionScale);
+	mesh.texCoordTransform = vec4(texMin.x, texMin.y, texScale.x, texScale.y);
+
+	size_t offset = pool.vertexData.size();
+	pool.vertexData.resize(offset + vertexCount * pool.vertexSize);
+	for (uint32 i = 0; i < vertexCount; ++i)
+	{
+		const vertex3PTN& v = *(const vertex3PTN*)(bytes + i * vertexSize);
+		vertex3PTNT_quantized q; // the PTN layout is a prefix of the PTNT layout
+		vec3 pos = (v.pos - bounds.minCorner) / positionScale;
+		q.pos[0] = quantizeUnorm16(pos.x);
+		q.pos[1] = quantizeUnorm16(pos.y);
+		q.pos[2] = quantizeUnorm16(pos.z);
+		q.pos[3] = 0;
+		q.tex[0] = quantizeUnorm16((v.tex.x - texMin.x) / texScale.x);
+		q.tex[1] = quantizeUnorm16((v.tex.y - texMin.y) / texScale.y);
+		encodeOctahedral(v.nor, q.nor);
+		if (mesh.format == VERTEX_FORMAT_PTNT)
+			encodeOctahedral(((const vertex3PTNT*)(bytes + i * vertexSize))->tan, q.tan);
+
+		memcpy(&pool.vertexData[offset + i * pool.vertexSize], &q, pool.vertexSize);
+	}
+#else
+	mesh.dequantization = mat4();
+	mesh.texCoordTransform = vec4(0.f, 0.f, 1.f, 1.f);
+	pool.vertexData.insert(pool.vertexData.end(), bytes, bytes + vertexCount * vertexSize);
+#endif
+
+	return baseVertex;
+}
+
+static uint32 appendIndices(opengl_geometry_pool& pool, const uint32* indices, uint32 indexCount)
+{
+	uint32 firstIndex = pool.indexCount;
+	pool.indexData.insert(pool.indexData.end(), indices, indices + indexCount);
+	pool.indexCount += indexCount;
+	return firstIndex;
+}
+
+static inline const vec3& getVertexPosition(const uint8* vertices, uint32 vertexSize, uint32 index)
+{
+	// the position is the first member of every vertex format
+	return *(const vec3*)(vertices + index * vertexSize);
+}
+
+static void computeMeshBounds(opengl_mesh& mesh, const uint8* vertices, uint32 vertexSize, const uint32* indices, uint32 indexCount)
+{
+	mesh.bounds = emptyBoundingBox();
+	for (uint32 i = 0; i < indexCount; ++i)
+		growBoundingBox(mesh.bounds, getVertexPosition(vertices, vertexSize, indices[i]));
+
+	mesh.boundingSphere.center = (mesh.bounds.minCorner + mesh.bounds.maxCorner) * 0.5f;
+	float radiusSquared = 0.f;
+	for (uint32 i = 0; i < indexCount; ++i)
+		radiusSquared = max(radiusSquared, sqlength(getVertexPosition(vertices, vertexSize, indices[i]) - mesh.boundingSphere.center));
+	mesh.boundingSphere.radius = sqrtf(radiusSquared);
+}
+
+// sqrt of the ratio of texture coordinate area to object space area, i.e. how many uv units one unit of the surface
+// covers on average. every vertex format starts with the position followed by the texture coordinates
+static float computeUVDensity(const uint8* vertices, uint32 vertexSize, const uint32* indices, uint32 indexCount)
+{
+	float uvArea = 0.f, area = 0.f;
+	for (uint32 i = 0; i + 2 < indexCount; i += 3)
+	{
+		const uint8* a = vertices + indices[i + 0] * vertexSize;
+		const uint8* b = vertices + indices[i + 1] * vertexSize;
+		const uint8* c = vertices + indices[i + 2] * vertexSize;
+		const vec3& pa = *(const vec3*)a;
+		const vec2& ta = *(const vec2*)(a + sizeof(vec3));
+		const vec2& tb = *(const vec2*)(b + sizeof(vec3));
+		const vec2& tc = *(const vec2*)(c + sizeof(vec3));
+
+		area += length(cross(*(const vec3*)b - pa, *(const vec3*)c - pa));
+		uvArea += fabsf((tb.x - ta.x) * (tc.y - ta.y) - (tc.x - ta.x) * (tb.y - ta.y));
+	}
+	return (area > 0.f) ? sqrtf(uvArea / area) : 0.f;
+}
+
+// a mesh of a model, before it is appended to the pool of its vertex format. the expensive part (optimizing, splitting
+// into chunks and simplifying) runs on the job system. appending is left to the loading thread, so the layout of the
+// pools does not depend on the scheduling
+struct processed_mesh
+{
+	vertex_format format;
+	uint32 vertexSize;
+	uint32 materialIndex;
+	float chunkSize;	// if not 0, the triangles are split into a grid of chunks which share the vertices, so large static meshes can be culled piece by piece
+	std::string name;
+
+	// on the load arena, until the mesh is optimized
+	const uint8* sourceVertices;
+	uint32 sourceVertexCount;
+	const uint32* sourceIndices;
+	uint32 sourceIndexCount;
+
+	// unused vertices are dropped, the triangles are sorted by chunk and keep their order within a chunk
+	const optimized_mesh* optimized;
+	std::vector<uint8> vertices;
+	std::vector<uint32> indices;
+	std::vector<uint32> chunkOffsets;	// first triangle of every non-empty chunk, followed by the number of triangles
+	std::vector<const std::vector<mesh_lod_level>*> chunkLods;
+};
+
+// the meshes of one model and its caches, which the jobs look up and fill
+struct mesh_processing
+{
+	job_system* jobSystem;
+	std::vector<processed_mesh> meshes;
+
+	std::mutex cacheMutex;
+	mesh_lod_cache lodCache;
+	mesh_optimization_cache optimizationCache;
+};
+
+// vertices and indices stay on the load arena until the model is finished
+static void addProcessedMesh(mesh_processing& processing, vertex_format format, uint32 vertexSize, const void* vertices, uint32 vertexCount,
+	const uint32* indices, uint32 indexCount, uint32 materialIndex, float chunkSize, const std::string& name)
+{
+	if (vertexCount == 0 || indexCount == 0)
+		return;
+
+	processing.meshes.push_back(processed_mesh());
+	processed_mesh& mesh = processing.meshes.back();
+	mesh.format = format;
+	mesh.vertexSize = vertexSize;
+	mesh.materialIndex = materialIndex;
+	mesh.chunkSize = chunkSize;
+	mesh.name = name;
+	mesh.sourceVertices = (const uint8*)vertices;
+	mesh.sourceVertexCount = vertexCount;
+	mesh.sourceIndices = indices;
+	mesh.sourceIndexCount = indexCount;
+}
+
+// reorders the triangles for the vertex cache and overdraw and the vertices for fetching, loaded from the cache if
+// possible
+static void optimizeMeshData(mesh_processing& processing, processed_mesh& mesh)
+{
+	uint64 hash = hashMeshData(mesh.sourceVertices, mesh.sourceVertexCount, mesh.vertexSize, mesh.sourceIndices, mesh.sourceIndexCount);
+
+	mesh.optimized = 0;
+	{
+		std::lock_guard<std::mutex> lock(processing.cacheMutex);
+		auto cached = processing.optimizationCache.entries.find(hash);
+		if (cached != processing.optimizationCache.entries.end())
+		{
+			if (optimizedMeshMatches(cached->second, mesh.sourceVertexCount))
+				mesh.optimized = &cached->second;
+			else
+				std::cerr << "Mesh optimization cache entry of " << mesh.name << " does not match its vertices, optimizing again." << std::endl;
+		}
+	}
+	if (!mesh.optimized)
+	{
+		// entries of the map stay where they are when it grows, and the same mesh may just have been optimized by
+		// another job, in which case its result is kept. an invalid entry from the file is replaced
+		optimized_mesh optimized;
+		optimizeMesh(optimized, mesh.sourceVertices, mesh.sourceVertexCount, mesh.vertexSize, mesh.sourceIndices, mesh.sourceIndexCount);
+
+		std::lock_guard<std::mutex> lock(processing.cacheMutex);
+		optimized_mesh& entry = processing.optimizationCache.entries[hash];
+		if (!optimizedMeshMatches(entry, mesh.sourceVertexCount) || entry.vertexRemap.empty())
+			entry = std::move(optimized);
+		mesh.optimized = &entry;
+		processing.optimizationCache.dirty = true;
+	}
+
+	const optimized_mesh& optimized = *mesh.optimized;
+	mesh.indices = optimized.indices;
+	mesh.vertices.resize(optimized.vertexRemap.size() * mesh.vertexSize);
+	for (uint32 v = 0; v < optimized.vertexRemap.size(); ++v)
+		memcpy(&mesh.vertices[v * mesh.vertexSize], &mesh.sourceVertices[optimized.vertexRemap[v] * mesh.vertexSize], mesh.vertexSize);
+}
+
+// buckets the triangles by the cell of a grid their centroid falls into
+static void splitMeshIntoChunks(processed_mesh& mesh)
+{
+	const uint8* vertexBytes = &mesh.vertices[0];
+	uint32 vertexCount = (uint32)(mesh.vertices.size() / mesh.vertexSize);
+	uint32 numberOfTriangles = (uint32)mesh.indices.size() / 3;
+
+	bounding_box meshBounds = emptyBoundingBox();
+	for (uint32 i = 0; i < vertexCount; ++i)
+		growBoundingBox(meshBounds, getVertexPosition(vertexBytes, mesh.vertexSize, i));
+	vec3 extent = meshBounds.maxCorner - meshBounds.minCorner;
+
+	uint32 cellsX = 1, cellsY = 1, cellsZ = 1;
+	if (mesh.chunkSize > 0.f)
+	{
+		cellsX = (uint32)clamp(ceilf(extent.x / mesh.chunkSize), 1.f, (float)MAX_CHUNKS_PER_AXIS);
+		cellsY = (uint32)clamp(ceilf(extent.y / mesh.chunkSize), 1.f, (float)MAX_CHUNKS_PER_AXIS);
+		cellsZ = (uint32)clamp(ceilf(extent.z / mesh.chunkSize), 1.f, (float)MAX_CHUNKS_PER_AXIS);
+	}
+	uint32 numberOfCells = cellsX * cellsY * cellsZ;
+
+	mesh.chunkOffsets.clear();
+	if (numberOfCells == 1)
+	{
+		mesh.chunkOffsets.push_back(0);
+		mesh.chunkOffsets.push_back(numberOfTriangles);
+		return;
+	}
+
+	std::vector<uint32> triangleCells(numberOfTriangles);
+	std::vector<uint32> cellOffsets(numberOfCells + 1, 0);
+	for (uint32 t = 0; t < numberOfTriangles; ++t)
+	{
+		vec3 centroid = (getVertexPosition(vertexBytes, mesh.vertexSize, mesh.indices[t * 3 + 0])
+			+ getVertexPosition(vertexBytes, mesh.vertexSize, mesh.indices[t * 3 + 1])
+			+ getVertexPosition(vertexBytes, mesh.vertexSize, mesh.indices[t * 3 + 2])) / 3.f;
+		vec3 cellPos = (centroid - meshBounds.minCorner) / mesh.chunkSize;
+
+		uint32 x = min((uint32)max(cellPos.x, 0.f), cellsX - 1);
+		uint32 y = min((uint32)max(cellPos.y, 0.f), cellsY - 1);
+		uint32 z = min((uint32)max(cellPos.z, 0.f), cellsZ - 1);
+		uint32 cell = (z * cellsY + y) * cellsX + x;
+
+		triangleCells[t] = cell;
+		++cellOffsets[cell + 1];
+	}
 
+	for (uint32 c = 1; c <= numberOfCells; ++c)
+		cellOffsets[c] += cellOffsets[c - 1];
+
+	std::vector<uint32> sortedIndices(mesh.indices.size());
+	std::vector<uint32> cellFill(cellOffsets.begin(), cellOffsets.end() - 1);
+	for (uint32 t = 0; t < numberOfTriangles; ++t)
+	{
+		uint32 dest = cellFill[triangleCells[t]]++;
+		sortedIndices[dest * 3 + 0] = mesh.indices[t * 3 + 0];
+		sortedIndices[dest * 3 + 1] = mesh.indices[t * 3 + 1];
+		sortedIndices[dest * 3 + 2] = mesh.indices[t * 3 + 2];
+	}
+	mesh.indices.swap(sortedIndices);
+
+	for (uint32 c = 0; c < numberOfCells; ++c)
+	{
+		if (cellOffsets[c + 1] > cellOffsets[c])
+			mesh.chunkOffsets.push_back(cellOffsets[c]);
+	}
+	mesh.chunkOffsets.push_back(numberOfTriangles);
+}
+
+struct chunk_lod_data
+{
+	mesh_processing* processing;
+	processed_mesh* mesh;
+};
+
+// simplified versions of every chunk, loaded from the cache if possible
+static void generateChunkLods(void* data, uint32 begin, uint32 end)
+{
+	chunk_lod_data* lodData = (chunk_lod_data*)data;
+	mesh_processing& processing = *lodData->processing;
+	processed_mesh& mesh = *lodData->mesh;
+	uint32 vertexCount = (uint32)(mesh.vertices.size() / mesh.vertexSize);
+
+	for (uint32 c = begin; c < end; ++c)
+	{
+		const uint32* indices = &mesh.indices[mesh.chunkOffsets[c] * 3];
+		uint32 indexCount = (mesh.chunkOffsets[c + 1] - mesh.chunkOffsets[c]) * 3;
+		uint64 hash = hashMeshData(&mesh.vertices[0], vertexCount, mesh.vertexSize, indices, indexCount);
+
+		mesh.chunkLods[c] = 0;
+		{
+			std::lock_guard<std::mutex> lock(processing.cacheMutex);
+			auto cached = processing.lodCache.entries.find(hash);
+			if (cached != processing.lodCache.entries.end())
+			{
+				if (lodsMatchMesh(cached->second, vertexCount))
+					mesh.chunkLods[c] = &cached->second;
+				else
+					std::cerr << "LOD cache entry of " << mesh.name << " indexes past its vertices, regenerating." << std::endl;
+			}
+		}
+		if (!mesh.chunkLods[c])
+		{
+			std::vector<mesh_lod_level> levels;
+			generateLods(&mesh.vertices[0], vertexCount, mesh.vertexSize, indices, indexCount, levels);
+
+			// replaces an invalid entry. the other chunks only read the entries once all are done
+			std::lock_guard<std::mutex> lock(processing.cacheMutex);
+			std::vector<mesh_lod_level>& entry = processing.lodCache.entries[hash];
+			entry = std::move(levels);
+			mesh.chunkLods[c] = &entry;
+			processing.lodCache.dirty = true;
+		}
+	}
+}
+
+static void processMeshes(void* data, uint32 begin, uint32 end)
+{
+	mesh_processing& processing = *(mesh_processing*)data;
+	for (uint32 m = begin; m < end; ++m)
+	{
+		processed_mesh& mesh = processing.meshes[m];
+		optimizeMeshData(processing, mesh);
+		splitMeshIntoChunks(mesh);
+
+		// large static meshes have hundreds of chunks, they are simplified in parallel as well
+		uint32 numberOfChunks = (uint32)mesh.chunkOffsets.size() - 1;
+		mesh.chunkLods.resize(numberOfChunks);
+		chunk_lod_data lodData = { &processing, &mesh };
+		parallelFor(*processing.jobSystem, numberOfChunks, 1, generateChunkLods, &lodData);
+	}
+}
+
+static void appendProcessedMesh(opengl_scene_resources& resources, std::vector<opengl_mesh>& meshes, const processed_mesh& processed)
+{
+	const optimized_mesh& optimized = *processed.optimized;
+	std::cout << processed.name << ": " << processed.indices.size() / 3 << " triangles, ACMR " << optimized.before.acmr << " -> " << optimized.after.acmr
+		<< ", ATVR " << optimized.before.atvr << " -> " << optimized.after.atvr
+		<< ", overdraw " << optimized.before.overdraw << " -> " << optimized.after.overdraw << std::endl;
+
+	const uint8* vertexBytes = &processed.vertices[0];
+	uint32 vertexSize = processed.vertexSize;
+	uint32 vertexCount = (uint32)(processed.vertices.size() / vertexSize);
+
+	opengl_geometry_pool& pool = resources.pools[processed.format];
+	pool.vertexSize = getPoolVertexSize(processed.format);
+
+	opengl_mesh mesh = {};
+	mesh.format = processed.format;
+	mesh.materialIndex = processed.materialIndex;
+	mesh.baseVertex = (int32)appendVertices(pool, mesh, vertexBytes, vertexCount, vertexSize);
+	mesh.uvDensity = computeUVDensity(vertexBytes, vertexSize, &processed.indices[0], (uint32)processed.indices.size());
+
+	uint32 firstIndex = appendIndices(pool, &processed.indices[0], (uint32)processed.indices.size());
+
+	for (uint32 c = 0; c + 1 < processed.chunkOffsets.size(); ++c)
+	{
+		const uint32* indices = &processed.indices[processed.chunkOffsets[c] * 3];
+
+		opengl_mesh chunk = mesh;
+		chunk.firstIndex = firstIndex + processed.chunkOffsets[c] * 3;
+		chunk.indexCount = (processed.chunkOffsets[c + 1] - processed.chunkOffsets[c]) * 3;
+		computeMeshBounds(chunk, vertexBytes, vertexSize, indices, chunk.indexCount);
+
+		// the simplified versions are appended to the index data after the mesh
+		chunk.lods[0].firstIndex = chunk.firstIndex;
+		chunk.lods[0].indexCount = chunk.indexCount;
+		chunk.lods[0].error = 0.f;
+		chunk.numberOfLods = 1;
+		for (const mesh_lod_level& level : *processed.chunkLods[c])
+		{
+			if (chunk.numberOfLods == MAX_MESH_LODS || level.indices.size() == 0)
+				break;
+
+			opengl_mesh_lod& lod = chunk.lods[chunk.numberOfLods++];
+			lod.indexCount = (uint32)level.indices.size();
+			lod.firstIndex = appendIndices(pool, level.indices.data(), lod.indexCount);
+			lod.error = level.error;
+		}
+
+		meshes.push_back(chunk);
+	}
+}
+
+// the optimized and simplified meshes are cached next to the model
+static void beginMeshProcessing(mesh_processing& processing, opengl_scene_resources& resources, const std::string& filepath)
+{
+	assert(resources.jobSystem);
+	processing.jobSystem = resources.jobSystem;
+	loadLodCache(processing.lodCache, filepath + ".lod");
+	loadMeshOptimizationCache(processing.optimizationCache, filepath + ".opt");
+}
+
+static void finishMeshProcessing(mesh_processing& processing, opengl_scene_resources& resources, std::vector<opengl_mesh>& meshes, const std::string& filepath)
+{
+	parallelFor(*processing.jobSystem, (uint32)processing.meshes.size(), 1, processMeshes, &processing);
+
+	for (const processed_mesh& mesh : processing.meshes)
+		appendProcessedMesh(resources, meshes, mesh);
+
+	if (processing.lodCache.dirty)
+		saveLodCache(processing.lodCache, filepath + ".lod");
+	if (processing.optimizationCache.dirty)
+		saveMeshOptimizationCache(processing.optimizationCache, filepath + ".opt");
+
+	resetArena(resources.loadArena);
+}
+
+static void uploadGeometryPool(opengl_geometry_pool& pool, vertex_format format)
+{
+	if (pool.vertexCount == 0)
+		return;
+
+	glGenVertexArrays(1, &pool.vao);
+	glBindVertexArray(pool.vao);
+
+	glGenBuffers(1, &pool.vbo);
+	glBindBuffer(GL_ARRAY_BUFFER, pool.vbo);
+	glBufferData(GL_ARRAY_BUFFER, pool.vertexData.size(), &pool.vertexData[0], GL_STATIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	// binding 0: vertices
+	glBindVertexBuffer(0, pool.vbo, 0, pool.vertexSize);
+
+#if QUANTIZE_VERTICES
+	// positions and texCoords are decoded to [0, 1] by the vertex fetch, the draw data scales them back
+	glEnableVertexAttribArray(0);
+	glVertexAttribFormat(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, offsetof(vertex3PTNT_quantized, pos));
+	glVertexAttribBinding(0, 0);
+	glEnableVertexAttribArray(1);
+	glVertexAttribFormat(1, 2, GL_UNSIGNED_SHORT, GL_TRUE, offsetof(vertex3PTNT_quantized, tex));
+	glVertexAttribBinding(1, 0);
+	// normals and tangents are unpacked from octahedral coordinates in the shader
+	glEnableVertexAttribArray(2);
+	glVertexAttribFormat(2, 2, GL_SHORT, GL_TRUE, offsetof(vertex3PTNT_quantized, nor));
+	glVertexAttribBinding(2, 0);
+	if (format == VERTEX_FORMAT_PTNT)
+	{
+		glEnableVertexAttribArray(3);
+		glVertexAttribFormat(3, 2, GL_SHORT, GL_TRUE, offsetof(vertex3PTNT_quantized, tan));
+		glVertexAttribBinding(3, 0);
+	}
+#else
 	// positions
 	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(vertex3PTNT), (void*)0);
+	glVertexAttribFormat(0, 3, GL_FLOAT, GL_FALSE, 0);
+	glVertexAttribBinding(0, 0);
 	// texCoords
 	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(vertex3PTNT), (void*)(3 * sizeof(GLfloat)));
+	glVertexAttribFormat(1, 2, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat));
+	glVertexAttribBinding(1, 0);
 	// normals
 	glEnableVertexAttribArray(2);
-	glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(vertex3PTNT), (void*)(5 * sizeof(GLfloat)));
+	glVertexAttribFormat(2, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(GLfloat));
+	glVertexAttribBinding(2, 0);
 	// tangents
-	glEnableVertexAttribArray(3);
-	glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(vertex3PTNT), (void*)(8 * sizeof(GLfloat)));
-
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	if (format == VERTEX_FORMAT_PTNT)
+	{
+		glEnableVertexAttribArray(3);
+		glVertexAttribFormat(3, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat));
+		glVertexAttribBinding(3, 0);
+	}
+#endif
 
-	glGenBuffers(1, &mesh.ibo);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.ibo);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(uint32), &indices[0], GL_STATIC_DRAW);
+	// binding 1: per draw data, the buffer is bound when drawing
+	for (uint32 i = 0; i < 4; ++i)
+	{
+		glEnableVertexAttribArray(4 + i);
+		glVertexAttribFormat(4 + i, 4, GL_FLOAT, GL_FALSE, i * 4 * sizeof(GLfloat));
+		glVertexAttribBinding(4 + i, 1);
+	}
+	glEnableVertexAttribArray(8);
+	glVertexAttribIFormat(8, 1, GL_UNSIGNED_INT, offsetof(draw_instance, materialIndex));
+	glVertexAttribBinding(8, 1);
+	glEnableVertexAttribArray(9);
+	glVertexAttribFormat(9, 4, GL_FLOAT, GL_FALSE, offsetof(draw_instance, texCoordTransform));
+	glVertexAttribBinding(9, 1);
+	glVertexBindingDivisor(1, 1);
+
+	glGenBuffers(1, &pool.ibo);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, pool.ibo);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, pool.indexData.size() * sizeof(uint32), &pool.indexData[0], GL_STATIC_DRAW);
 
 	glBindVertexArray(0);
+
+	std::vector<uint8>().swap(pool.vertexData);
+	std::vector<uint32>().swap(pool.indexData);
+}
+
+static uint64 getTextureArrayLevelsSize(const opengl_texture_array& textureArray, uint32 firstLevel, uint32 endLevel)
+{
+	uint64 size = 0;
+	for (uint32 level = firstLevel; level < endLevel; ++level)
+		size += getTextureLevelSize(textureArray.format, max(textureArray.width >> level, 1u), max(textureArray.height >> level, 1u));
+	return size * textureArray.layerFiles.size();
 }
 
-static material loadMaterial(aiMaterial* mat)
+// immutable storage for the levels from firstLevel on, which become the levels from 0 on of the gl texture
+static GLuint allocateTextureArray(const opengl_texture_array& textureArray, uint32 firstLevel)
 {
-	material material = { 0 };
+	GLuint textureID;
+	glGenTextures(1, &textureID);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, textureID);
+
+	// the mips are precomputed with proper filtering, nothing is generated at load time
+	glTexStorage3D(GL_TEXTURE_2D_ARRAY, textureArray.numberOfLevels - firstLevel, getGLInternalFormat(textureArray.format),
+		max(textureArray.width >> firstLevel, 1u), max(textureArray.height >> firstLevel, 1u), (GLsizei)textureArray.layerFiles.size());
+
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameterf(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_LOD_BIAS, 0);
+
+	// anisotropic filtering
+	float supported = 0.f;
+	glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &supported);
+	if (supported != 0.f)
+	{
+		float amount = min(4.f, supported);
+		glTexParameterf(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_ANISOTROPY_EXT, amount);
+	}
+
+	return textureID;
+}
+
+// uploads levels [firstLevel, endLevel) of all layers to the bound texture, whose level 0 is baseLevel
+static void uploadTextureLevels(const opengl_texture_array& textureArray, const std::vector<compressed_texture>& layers,
+	uint32 firstLevel, uint32 endLevel, uint32 baseLevel)
+{
+	GLenum internalFormat = getGLInternalFormat(textureArray.format);
+
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1); // rows of r8 and rgb8 levels are tightly packed
+	for (uint32 layer = 0; layer < layers.size(); ++layer)
+	{
+		const compressed_texture& texture = layers[layer];
+		for (uint32 level = firstLevel; level < endLevel; ++level)
+		{
+			uint32 width = max(textureArray.width >> level, 1u), height = max(textureArray.height >> level, 1u);
+			const uint8* data = &texture.data[texture.levelOffsets[level]];
+			if (isTextureFormatCompressed(texture.format))
+			{
+				glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, level - baseLevel, 0, 0, layer, width, height, 1, internalFormat,
+					getTextureLevelSize(texture.format, width, height), data);
+			}
+			else
+			{
+				glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level - baseLevel, 0, 0, layer, width, height, 1, getGLFormat(texture.format), GL_UNSIGNED_BYTE, data);
+			}
+		}
+	}
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+}
+
+// the sampler state is baked into the handle, so this has to come after the parameters are set
+static void makeTextureArrayResident(opengl_texture_array& textureArray)
+{
+	textureArray.handle = glGetTextureHandleARB(textureArray.textureID);
+	glMakeTextureHandleResidentARB(textureArray.handle);
+}
+
+static void deleteTextureArray(opengl_texture_array& textureArray)
+{
+	if (textureArray.handle)
+		glMakeTextureHandleNonResidentARB(textureArray.handle);
+	glDeleteTextures(1, &textureArray.textureID);
+	textureArray.textureID = 0;
+	textureArray.handle = 0;
+}
+
+// frames already submitted may still sample the texture through its handle. everything submitted so far is before
+// the fence, so it is deleted once the fence has passed
+static void retireTextureArray(opengl_scene_resources& resources, opengl_texture_array& textureArray)
+{
+	retired_texture_array retired = { textureArray.textureID, textureArray.handle, glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0) };
+	resources.retiredTextureArrays.push_back(retired);
+	textureArray.textureID = 0;
+	textureArray.handle = 0;
+}
+
+static void deleteRetiredTextureArrays(opengl_scene_resources& resources, bool waitForGPU)
+{
+	for (uint32 i = 0; i < resources.retiredTextureArrays.size();)
+	{
+		retired_texture_array& retired = resources.retiredTextureArrays[i];
+		GLenum status = glClientWaitSync(retired.fence, waitForGPU ? GL_SYNC_FLUSH_COMMANDS_BIT : 0, waitForGPU ? UINT64_MAX : 0);
+		if (status == GL_TIMEOUT_EXPIRED)
+		{
+			++i;
+			continue;
+		}
+
+		glDeleteSync(retired.fence);
+		if (retired.handle)
+			glMakeTextureHandleNonResidentARB(retired.handle);
+		glDeleteTextures(1, &retired.textureID);
+		retired = resources.retiredTextureArrays.back();
+		resources.retiredTextureArrays.pop_back();
+	}
+}
+
+// only the tail is uploaded with the scene, so the first frame does not wait for the full resolution
+static void uploadTextureArray(opengl_texture_array& textureArray, bool bindless)
+{
+	textureArray.textureID = allocateTextureArray(textureArray, textureArray.residentLevel);
+	uploadTextureLevels(textureArray, textureArray.pendingLayers, textureArray.residentLevel, textureArray.numberOfLevels, textureArray.residentLevel);
+	std::vector<compressed_texture>().swap(textureArray.pendingLayers);
+
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+	if (bindless)
+		makeTextureArrayResident(textureArray);
+}
+
+// two 64 bit handles per 16 byte entry of the std140 block. written to the frame's region of the upload ring, so
+// frames in flight keep reading the handles they were submitted with
+static upload_allocation uploadTextureHandles(opengl_upload_ring& ring, const opengl_scene_resources& resources)
+{
+	GLuint64 handles[MAX_TEXTURE_ARRAYS] = { 0 };
+	for (uint32 i = 0; i < resources.numberOfTextureArrays; ++i)
+		handles[i] = resources.textureArrays[i].handle;
+
+	return uploadUniforms(ring, handles, sizeof(handles));
+}
+
+// uploads levels [firstLevel, endLevel) of all layers from the staging buffer, laid out like the streaming workers
+// write them. the gl texture's level 0 is residentLevel
+static void uploadStagedTextureLevels(const opengl_texture_array& textureArray, const opengl_staging_buffer& staging, uint64 offset,
+	uint32 firstLevel, uint32 endLevel)
+{
+	GLenum internalFormat = getGLInternalFormat(textureArray.format);
+
+	glBindTexture(GL_TEXTURE_2D_ARRAY, textureArray.textureID);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, staging.buffer);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	for (uint32 layer = 0; layer < textureArray.layerFiles.size(); ++layer)
+	{
+		for (uint32 level = firstLevel; level < endLevel; ++level)
+		{
+			uint32 width = max(textureArray.width >> level, 1u), height = max(textureArray.height >> level, 1u);
+			uint32 size = getTextureLevelSize(textureArray.format, width, height);
+			const void* source = (const void*)(uintptr_t)offset; // offset into the bound unpack buffer
+			if (isTextureFormatCompressed(textureArray.format))
+			{
+				glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, level - textureArray.residentLevel, 0, 0, layer, width, height, 1, internalFormat, size, source);
+			}
+			else
+			{
+				glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level - textureArray.residentLevel, 0, 0, layer, width, height, 1,
+					getGLFormat(textureArray.format), GL_UNSIGNED_BYTE, source);
+			}
+			offset += size;
+		}
+	}
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+}
+
+// immutable storage cannot grow or shrink, so the array is reallocated with the new finest level. the levels both
+// versions have are copied on the gpu, new finer levels have to be uploaded after this
+static void resizeTextureArray(opengl_scene_resources& resources, opengl_texture_array& textureArray, uint32 residentLevel)
+{
+	GLuint textureID = allocateTextureArray(textureArray, residentLevel);
+
+	for (uint32 level = max(residentLevel, textureArray.residentLevel); level < textureArray.numberOfLevels; ++level)
+	{
+		glCopyImageSubData(textureArray.textureID, GL_TEXTURE_2D_ARRAY, level - textureArray.residentLevel, 0, 0, 0,
+			textureID, GL_TEXTURE_2D_ARRAY, level - residentLevel, 0, 0, 0,
+			max(textureArray.width >> level, 1u), max(textureArray.height >> level, 1u), (GLsizei)textureArray.layerFiles.size());
+	}
+
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+	retireTextureArray(resources, textureArray);
+	textureArray.textureID = textureID;
+	textureArray.residentLevel = residentLevel;
+	if (resources.bindlessTextures)
+		makeTextureArrayResident(textureArray);
+}
+
+static material_data packMaterial(const material& mat)
+{
+	material_data result;
+	result.ambient[0] = mat.ambient.x; result.ambient[1] = mat.ambient.y; result.ambient[2] = mat.ambient.z; result.ambient[3] = 0.f;
+	result.diffuse[0] = mat.diffuse.x; result.diffuse[1] = mat.diffuse.y; result.diffuse[2] = mat.diffuse.z; result.diffuse[3] = 0.f;
+	result.specular[0] = mat.specular.x; result.specular[1] = mat.specular.y; result.specular[2] = mat.specular.z; result.specular[3] = mat.shininess;
+
+	result.textureArrays[0] = mat.hasDiffuseTexture ? (int32)mat.diffuseTexture.arrayIndex : -1;
+	result.textureArrays[1] = mat.hasNormalTexture ? (int32)mat.normalTexture.arrayIndex : -1;
+	result.textureArrays[2] = mat.hasSpecularTexture ? (int32)mat.specularTexture.arrayIndex : -1;
+	result.textureArrays[3] = mat.emitting ? 1 : 0;
+
+	result.textureLayers[0] = (float)mat.diffuseTexture.layer;
+	result.textureLayers[1] = (float)mat.normalTexture.layer;
+	result.textureLayers[2] = (float)mat.specularTexture.layer;
+	result.textureLayers[3] = 0.f;
+
+	return result;
+}
+
+static uint8 getMaterialPermutation(const material& mat)
+{
+	uint8 result = 0;
+	if (mat.hasDiffuseTexture) result |= MATERIAL_DIFFUSE_TEXTURE;
+	if (mat.hasNormalTexture) result |= MATERIAL_NORMAL_TEXTURE;
+	if (mat.hasSpecularTexture) result |= MATERIAL_SPECULAR_TEXTURE;
+	if (mat.emitting) result |= MATERIAL_EMITTING;
+	return result;
+}
+
+void finishSceneResources(opengl_scene_resources& resources, const std::vector<material>& staticGeometryMaterials, const std::vector<material>& materials)
+{
+	for (uint32 i = 0; i < VERTEX_FORMAT_COUNT; ++i)
+		uploadGeometryPool(resources.pools[i], (vertex_format)i);
+
+	resources.bindlessTextures = GLEW_ARB_bindless_texture != 0;
+	for (uint32 i = 0; i < resources.numberOfTextureArrays; ++i)
+		uploadTextureArray(resources.textureArrays[i], resources.bindlessTextures);
+
+	std::vector<material_data> materialData;
+	materialData.reserve(staticGeometryMaterials.size() + materials.size());
+	for (const material& mat : staticGeometryMaterials)
+	{
+		materialData.push_back(packMaterial(mat));
+		resources.materialPermutations.push_back(getMaterialPermutation(mat));
+	}
+	for (const material& mat : materials)
+	{
+		materialData.push_back(packMaterial(mat));
+		resources.materialPermutations.push_back(getMaterialPermutation(mat));
+	}
+
+	if (materialData.size() > MAX_MATERIALS)
+	{
+		std::cerr << "scene has " << materialData.size() << " materials, only " << MAX_MATERIALS << " are supported. meshes using the others are not drawn" << std::endl;
+		materialData.resize(MAX_MATERIALS);
+		resources.materialPermutations.resize(MAX_MATERIALS);
+	}
+
+	// draws tell the streamer which levels of their material's textures they need
+	resources.materialTextureArrays.resize(materialData.size() * 3);
+	for (uint32 i = 0; i < materialData.size(); ++i)
+	{
+		for (uint32 t = 0; t < 3; ++t)
+			resources.materialTextureArrays[i * 3 + t] = materialData[i].textureArrays[t];
+	}
+
+	uint64 residentSize = 0, streamedSize = 0;
+	for (uint32 i = 0; i < resources.numberOfTextureArrays; ++i)
+	{
+		const opengl_texture_array& textureArray = resources.textureArrays[i];
+		residentSize += getTextureArrayLevelsSize(textureArray, textureArray.tailLevel, textureArray.numberOfLevels);
+		streamedSize += getTextureArrayLevelsSize(textureArray, 0, textureArray.tailLevel);
+	}
+	std::cout << "textures: " << residentSize / 1024 << " KB always resident, " << streamedSize / 1024 << " KB streamed with a budget of "
+		<< resources.textureBudget / 1024 << " KB" << std::endl;
+
+	// no streaming step can be larger than the budget, so every step that fits the budget also fits the staging buffer
+	if (streamedSize > 0)
+		createStagingBuffer(resources.textureStaging, min(streamedSize, resources.textureBudget));
+	startTextureStreamer(resources.textureStreamer);
+
+	glGenBuffers(1, &resources.materialBuffer);
+	glBindBuffer(GL_UNIFORM_BUFFER, resources.materialBuffer);
+	glBufferData(GL_UNIFORM_BUFFER, MAX_MATERIALS * sizeof(material_data), NULL, GL_STATIC_DRAW);
+	if (materialData.size() > 0)
+		glBufferSubData(GL_UNIFORM_BUFFER, 0, materialData.size() * sizeof(material_data), &materialData[0]);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+	std::cout << "most bytes loaded at once: " << resources.loadArena.peakUsed << std::endl;
+	deleteArena(resources.loadArena);
+}
+
+void deleteSceneResources(opengl_scene_resources& resources)
+{
+	for (uint32 i = 0; i < VERTEX_FORMAT_COUNT; ++i)
+	{
+		opengl_geometry_pool& pool = resources.pools[i];
+		glDeleteVertexArrays(1, &pool.vao);
+		glDeleteBuffers(1, &pool.vbo);
+		glDeleteBuffers(1, &pool.ibo);
+	}
+
+	stopTextureStreamer(resources.textureStreamer);
+	deleteStagingBuffer(resources.textureStaging);
+	for (uint32 i = 0; i < resources.numberOfTextureArrays; ++i)
+		deleteTextureArray(resources.textureArrays[i]);
+	deleteRetiredTextureArrays(resources, true);
+
+	glDeleteBuffers(1, &resources.materialBuffer);
+	deleteArena(resources.loadArena);
+}
+
+static material loadMaterial(opengl_scene_resources& resources, aiMaterial* mat)
+{
+	material material = {};
 	aiString name;
 	mat->Get(AI_MATKEY_NAME, name);
 
@@ -124,69 +942,133 @@ static material loadMaterial(aiMaterial* mat)
 	if (mat->GetTexture(aiTextureType_DIFFUSE, 0, &texPath) == aiReturn_SUCCESS)
 	{
 		std::cout << name.C_Str() << " has diffuse: " << texPath.C_Str() << std::endl;
-		material.hasDiffuseTexture = true;
-		loadTexture(material.diffuseTexture, texPath.C_Str());
+		material.hasDiffuseTexture = loadTexture(resources, material.diffuseTexture, texPath.C_Str(), TEXTURE_USAGE_COLOR);
 	}
 	if (mat->GetTexture(aiTextureType_HEIGHT, 0, &texPath) == aiReturn_SUCCESS) // why is the normal map in aiTextureType_HEIGHT???
 	{
 		std::cout << name.C_Str() << " has normal: " << texPath.C_Str() << std::endl;
-		material.hasNormalTexture = true;
-		loadTexture(material.normalTexture, texPath.C_Str());
+		material.hasNormalTexture = loadTexture(resources, material.normalTexture, texPath.C_Str(), TEXTURE_USAGE_NORMAL);
 	}
 	if (mat->GetTexture(aiTextureType_SPECULAR, 0, &texPath) == aiReturn_SUCCESS)
 	{
 		std::cout << name.C_Str() << " has specular: " << texPath.C_Str() << std::endl;
-		material.hasSpecularTexture = true;
-		loadTexture(material.specularTexture, texPath.C_Str());
+		material.hasSpecularTexture = loadTexture(resources, material.specularTexture, texPath.C_Str(), TEXTURE_USAGE_MASK);
 	}
 
 	return material;
 }
 
+// the meshes of a model share its materials, each one is loaded the first time a mesh uses it. loadedMaterials has
+// the index in materials of every material of the model, or -1
+static uint32 getModelMaterial(opengl_scene_resources& resources, std::vector<material>& materials, std::vector<int32>& loadedMaterials,
+	const aiScene* aiScene, uint32 aiMaterialIndex)
+{
+	if (loadedMaterials[aiMaterialIndex] < 0)
+	{
+		loadedMaterials[aiMaterialIndex] = (int32)materials.size();
+		materials.push_back(loadMaterial(resources, aiScene->mMaterials[aiMaterialIndex]));
+	}
+	return (uint32)loadedMaterials[aiMaterialIndex];
+}
+
+struct texture_encoding
+{
+	std::string filepath;
+	texture_usage usage;
+};
+
+static void encodeTextures(void* data, uint32 begin, uint32 end)
+{
+	texture_encoding* encodings = (texture_encoding*)data;
+	for (uint32 i = begin; i < end; ++i)
+	{
+		compressed_texture texture;
+		encodeTexture(texture, encodings[i].filepath, encodings[i].usage);
+	}
+}
+
+// textures without an up to date compressed version are encoded on all threads, which is by far the slowest part of
+// loading a model for the first time. all others start reading in the background, while the meshes are processed
+static void prepareMaterialTextures(opengl_scene_resources& resources, const aiScene* aiScene)
+{
+	aiTextureType types[] = { aiTextureType_DIFFUSE, aiTextureType_HEIGHT, aiTextureType_SPECULAR };
+	texture_usage usages[] = { TEXTURE_USAGE_COLOR, TEXTURE_USAGE_NORMAL, TEXTURE_USAGE_MASK };
+
+	std::vector<texture_encoding> encodings;
+	for (uint32 i = 0; i < aiScene->mNumMaterials; ++i)
+	{
+		for (uint32 t = 0; t < arraysize(types); ++t)
+		{
+			aiString texPath;
+			if (aiScene->mMaterials[i]->GetTexture(types[t], 0, &texPath) != aiReturn_SUCCESS
+				|| resources.loadedTextures.find(texPath.C_Str()) != resources.loadedTextures.end())
+				continue;
+
+			std::string filepath = "res/textures/" + std::string(texPath.C_Str());
+			compressed_texture header;
+			if (loadCompressedTextureHeader(header, filepath, usages[t]))
+			{
+				prefetchFile((filepath + ".ktx").c_str());
+				continue;
+			}
+
+			bool queued = false;
+			for (const texture_encoding& encoding : encodings)
+				queued |= (encoding.filepath == filepath);
+			if (!queued)
+				encodings.push_back({ filepath, usages[t] });
+		}
+	}
+
+	parallelFor(*resources.jobSystem, (uint32)encodings.size(), 1, encodeTextures, encodings.data());
+}
+
 // this is expected to be already at the desired world position
-bool loadStaticGeometry(std::vector<opengl_mesh>& meshes, std::vector<material>& materials, const std::string& filename)
+bool loadStaticGeometry(opengl_scene_resources& resources, std::vector<opengl_mesh>& meshes, std::vector<material>& materials, const std::string& filename)
 {
 	std::string filepath = std::string("res/models/") + filename;
 
 	Assimp::Importer Importer;
 	const aiScene* aiScene = Importer.ReadFile(filepath, aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_CalcTangentSpace
-		| aiProcess_FlipUVs | aiProcess_JoinIdenticalVertices | aiProcess_ImproveCacheLocality);
+		| aiProcess_FlipUVs | aiProcess_JoinIdenticalVertices);
 
 	if (!aiScene) {
 		std::cerr << "File " << filepath << " not found." << std::endl;
 		return false;
 	}
 
+	prepareMaterialTextures(resources, aiScene);
+
+	mesh_processing processing;
+	beginMeshProcessing(processing, resources, filepath);
+	std::vector<int32> loadedMaterials(aiScene->mNumMaterials, -1);
+
 	uint32 numberOfMeshes = aiScene->mNumMeshes;
 	for (uint32 m = 0; m < numberOfMeshes; ++m)
 	{
 		const aiMesh* aiMesh = aiScene->mMeshes[m];
-		opengl_mesh mesh = { 0 };
-
-		std::vector<uint32> indices;
-		indices.reserve(aiMesh->mNumFaces * 3);
+		std::string meshName = filename + " mesh " + std::to_string(m);
 
-		uint32 vertexCount = aiMesh->mNumVertices;
 		uint32 indexCount = aiMesh->mNumFaces * 3;
-		mesh.indexCount = indexCount;
+		uint32* indices = pushArray<uint32>(resources.loadArena, indexCount);
 
 		// indices
 		for (uint32 i = 0; i < aiMesh->mNumFaces; i++) {
 			const aiFace &face = aiMesh->mFaces[i];
 			assert(face.mNumIndices == 3);
-			indices.push_back(face.mIndices[0]);
-			indices.push_back(face.mIndices[1]);
-			indices.push_back(face.mIndices[2]);
+			indices[i * 3 + 0] = face.mIndices[0];
+			indices[i * 3 + 1] = face.mIndices[1];
+			indices[i * 3 + 2] = face.mIndices[2];
 		}
 
 		// material
-		material material = loadMaterial(aiScene->mMaterials[aiMesh->mMaterialIndex]);
+		uint32 materialIndex = getModelMaterial(resources, materials, loadedMaterials, aiScene, aiMesh->mMaterialIndex);
+		const material& material = materials[materialIndex];
 
 		// vertices
 		if (material.hasNormalTexture)
 		{
-			std::vector<vertex3PTNT> vertices;
-			vertices.reserve(aiMesh->mNumVertices);
+			vertex3PTNT* vertices = pushArray<vertex3PTNT>(resources.loadArena, aiMesh->mNumVertices);
 
 			for (uint32 i = 0; i < aiMesh->mNumVertices; ++i) {
 
@@ -202,15 +1084,15 @@ bool loadStaticGeometry(std::vector<opengl_mesh>& meshes, std::vector<material>&
 
 				vertex.nor = vec3(nor.x, nor.y, nor.z);
 				vertex.tan = vec3(tan.x, tan.y, tan.z);
-				vertices.push_back(vertex);
+				vertices[i] = vertex;
 			}
 
-			uploadVertexData(mesh, vertices, indices);
+			addProcessedMesh(processing, VERTEX_FORMAT_PTNT, sizeof(vertex3PTNT), vertices, aiMesh->mNumVertices, indices, indexCount, materialIndex,
+				STATIC_GEOMETRY_CHUNK_SIZE, meshName);
 		}
 		else
 		{
-			std::vector<vertex3PTN> vertices;
-			vertices.reserve(aiMesh->mNumVertices);
+			vertex3PTN* vertices = pushArray<vertex3PTN>(resources.loadArena, aiMesh->mNumVertices);
 
 			for (uint32 i = 0; i < aiMesh->mNumVertices; ++i) {
 
@@ -224,20 +1106,20 @@ bool loadStaticGeometry(std::vector<opengl_mesh>& meshes, std::vector<material>&
 					vertex.tex = vec2(aiMesh->mTextureCoords[0][i].x, aiMesh->mTextureCoords[0][i].y);
 
 				vertex.nor = vec3(nor.x, nor.y, nor.z);
-				vertices.push_back(vertex);
+				vertices[i] = vertex;
 			}
 
-			uploadVertexData(mesh, vertices, indices);
+			addProcessedMesh(processing, VERTEX_FORMAT_PTN, sizeof(vertex3PTN), vertices, aiMesh->mNumVertices, indices, indexCount, materialIndex,
+				STATIC_GEOMETRY_CHUNK_SIZE, meshName);
 		}
-
-		meshes.push_back(mesh);
-		materials.push_back(material);
 	}
 
+	finishMeshProcessing(processing, resources, meshes, filepath);
+
 	return true;
 }
 
-bool loadMesh(opengl_mesh& mesh, const std::string& filename)
+bool loadMesh(memory_arena& arena, opengl_mesh& mesh, const std::string& filename)
 {
 	std::string filepath = std::string("res/models/") + filename;
 
@@ -255,15 +1137,13 @@ bool loadMesh(opengl_mesh& mesh, const std::string& filename)
 
 	const aiMesh* aiMesh = aiScene->mMeshes[0];
 
-	std::vector<vertex3PTN> vertices;
-	std::vector<uint32> indices;
-
-	vertices.reserve(aiMesh->mNumVertices);
-	indices.reserve(aiMesh->mNumFaces * 3);
-
 	uint32 vertexCount = aiMesh->mNumVertices;
 	uint32 indexCount = aiMesh->mNumFaces * 3;
 
+	uint64 marker = getArenaMarker(arena);
+	vertex3PTN* vertices = pushArray<vertex3PTN>(arena, vertexCount);
+	uint32* indices = pushArray<uint32>(arena, indexCount);
+
 	mesh.indexCount = indexCount;
 
 	assert(aiMesh->HasPositions());
@@ -280,30 +1160,31 @@ bool loadMesh(opengl_mesh& mesh, const std::string& filename)
 		vertex.pos = vec3(pos.x, pos.y, pos.z);
 		vertex.tex = vec2(tex.x, tex.y);
 		vertex.nor = vec3(nor.x, nor.y, nor.z);
-		vertices.push_back(vertex);
+		vertices[i] = vertex;
 	}
 
 	for (uint32 i = 0; i < aiMesh->mNumFaces; i++) {
 		const aiFace &face = aiMesh->mFaces[i];
 		assert(face.mNumIndices == 3);
-		indices.push_back(face.mIndices[0]);
-		indices.push_back(face.mIndices[1]);
-		indices.push_back(face.mIndices[2]);
+		indices[i * 3 + 0] = face.mIndices[0];
+		indices[i * 3 + 1] = face.mIndices[1];
+		indices[i * 3 + 2] = face.mIndices[2];
 	}
 
-	uploadVertexData(mesh, vertices, indices);
+	uploadVertexData(mesh, vertices, vertexCount, indices, indexCount);
+	resetArenaToMarker(arena, marker);
 
 	return true;
 }
 
 // returns start and end index of loaded meshes and materials
-std::pair<uint32, uint32> loadMesh(std::vector<opengl_mesh>& meshes, std::vector<material>& materials, const std::string& filename)
+std::pair<uint32, uint32> loadMesh(opengl_scene_resources& resources, std::vector<opengl_mesh>& meshes, std::vector<material>& materials, const std::string& filename)
 {
 	std::string filepath = std::string("res/models/") + filename;
 
 	Assimp::Importer Importer;
 	const aiScene* aiScene = Importer.ReadFile(filepath, aiProcess_Triangulate | aiProcess_GenSmoothNormals
-		| aiProcess_FlipUVs | aiProcess_JoinIdenticalVertices | aiProcess_ImproveCacheLocality);
+		| aiProcess_FlipUVs | aiProcess_JoinIdenticalVertices);
 
 	if (!aiScene) {
 		std::cerr << "File " << filepath << " not found." << std::endl;
@@ -312,6 +1193,12 @@ std::pair<uint32, uint32> loadMesh(std::vector<opengl_mesh>& meshes, std::vector
 
 	uint32 startIndex = (uint32)meshes.size();
 
+	prepareMaterialTextures(resources, aiScene);
+
+	mesh_processing processing;
+	beginMeshProcessing(processing, resources, filepath);
+	std::vector<int32> loadedMaterials(aiScene->mNumMaterials, -1);
+
 	uint32 numberOfMeshes = aiScene->mNumMeshes;
 
 	assert(numberOfMeshes > 0);
@@ -319,21 +1206,13 @@ std::pair<uint32, uint32> loadMesh(std::vector<opengl_mesh>& meshes, std::vector
 	for (uint32 m = 0; m < numberOfMeshes; ++m)
 	{
 		const aiMesh* aiMesh = aiScene->mMeshes[m];
+		std::string meshName = filename + " mesh " + std::to_string(m);
 
-		std::vector<vertex3PTN> vertices; // this does not support normal mapping for now
-		std::vector<uint32> indices;
-
-		material material = loadMaterial(aiScene->mMaterials[aiMesh->mMaterialIndex]);
-		opengl_mesh mesh = { 0 };
-
-		vertices.reserve(aiMesh->mNumVertices);
-		indices.reserve(aiMesh->mNumFaces * 3);
-
-		uint32 vertexCount = aiMesh->mNumVertices;
 		uint32 indexCount = aiMesh->mNumFaces * 3;
+		vertex3PTN* vertices = pushArray<vertex3PTN>(resources.loadArena, aiMesh->mNumVertices); // this does not support normal mapping for now
+		uint32* indices = pushArray<uint32>(resources.loadArena, indexCount);
 
-		mesh.indexCount = indexCount;
-
+		uint32 materialIndex = getModelMaterial(resources, materials, loadedMaterials, aiScene, aiMesh->mMaterialIndex);
 
 		for (uint32 i = 0; i < aiMesh->mNumVertices; ++i) {
 
@@ -348,23 +1227,22 @@ std::pair<uint32, uint32> loadMesh(std::vector<opengl_mesh>& meshes, std::vector
 			if (aiMesh->HasTextureCoords(0))
 				vertex.tex = vec2(aiMesh->mTextureCoords[0][i].x, aiMesh->mTextureCoords[0][i].y);
 
-			vertices.push_back(vertex);
+			vertices[i] = vertex;
 		}
 
 		for (uint32 i = 0; i < aiMesh->mNumFaces; i++) {
 			const aiFace &face = aiMesh->mFaces[i];
 			assert(face.mNumIndices == 3);
-			indices.push_back(face.mIndices[0]);
-			indices.push_back(face.mIndices[1]);
-			indices.push_back(face.mIndices[2]);
+			indices[i * 3 + 0] = face.mIndices[0];
+			indices[i * 3 + 1] = face.mIndices[1];
+			indices[i * 3 + 2] = face.mIndices[2];
 		}
 
-		uploadVertexData(mesh, vertices, indices);
-
-		meshes.push_back(mesh);
-		materials.push_back(material);
+		addProcessedMesh(processing, VERTEX_FORMAT_PTN, sizeof(vertex3PTN), vertices, aiMesh->mNumVertices, indices, indexCount, materialIndex, 0.f, meshName);
 	}
 
+	finishMeshProcessing(processing, resources, meshes, filepath);
+
 	uint32 endIndex = (uint32)meshes.size();
 
 	return std::pair<uint32, uint32>(startIndex, endIndex);
@@ -385,158 +1263,156 @@ static inline void bindAndDrawMesh(opengl_mesh& mesh)
 	glBindVertexArray(0);
 }
 
-static bool loadTexture(opengl_texture& texture, const std::string& filename)
+// the compressed version next to the source is used as long as it is newer and written by the current encoder. only
+// its header is loaded
+static bool loadCompressedTextureHeader(compressed_texture& texture, const std::string& filepath, texture_usage usage)
 {
-	std::string filepath = "res/textures/" + filename;
+	std::string cacheFilepath = filepath + ".ktx";
+	uint64 sourceWriteTime = getFileWriteTime(filepath.c_str());
+	uint64 cacheWriteTime = getFileWriteTime(cacheFilepath.c_str());
+	return cacheWriteTime != 0 && cacheWriteTime >= sourceWriteTime
+		&& loadKTX(texture, cacheFilepath, 0, 0) && texture.encoderVersion == TEXTURE_ENCODER_VERSION && isTextureFormatForUsage(texture.format, usage);
+}
 
+// compresses the source image and writes the compressed version next to it
+static bool encodeTexture(compressed_texture& texture, const std::string& filepath, texture_usage usage)
+{
+	// decode straight from the mapped file, stb would otherwise copy it into its own buffer first
+	input_file file = readFile(filepath.c_str());
 	int32 width, height, comp;
-	unsigned char *data = stbi_load(filepath.c_str(), &width, &height, &comp, 4);
+	unsigned char *data = 0;
+	if (file.contents && file.size <= INT32_MAX)
+		data = stbi_load_from_memory((const stbi_uc*)file.contents, (int32)file.size, &width, &height, &comp, 4);
+	freeFile(file);
 	if (!data)
-	{
-		std::cerr << "File " << filepath << " not found." << std::endl;
-		return false;
-	}
-
-	glGenTextures(1, &texture.textureID);
-	glBindTexture(GL_TEXTURE_2D, texture.textureID);
-
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
-
-	glGenerateMipmap(GL_TEXTURE_2D);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_LOD_BIAS, 0);
-
-	// anisotropic filtering
-	float supported = 0.f;
-	glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &supported);
-	if (supported != 0.f)
-	{
-		float amount = min(4.f, supported);
-		glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY_EXT, amount);
-	}
-
-	glBindTexture(GL_TEXTURE_2D, 0);
+		return false;
 
+	std::cout << "encoding " + filepath + "\n";
+	compressTexture(texture, data, width, height, usage);
 	stbi_image_free(data);
 
+	if (!saveKTX(texture, filepath + ".ktx"))
+		std::cerr << "could not write " + filepath + ".ktx, the texture will stay at low resolution\n";
 	return true;
 }
 
-void deleteTexture(opengl_texture& texture)
+// decodes the image and encodes it with mips, or loads the version cached next to it if that is up to date.
+// from the cache only the always resident tail is read, the other levels are streamed from there later
+static bool loadCompressedTexture(compressed_texture& texture, const std::string& filepath, texture_usage usage)
 {
-	glDeleteTextures(1, &texture.textureID);
+	if (loadCompressedTextureHeader(texture, filepath, usage))
+	{
+		uint32 tailLevel = getResidentTailLevel(texture.width, texture.height, texture.numberOfLevels);
+		return loadKTX(texture, filepath + ".ktx", tailLevel);
+	}
+	return encodeTexture(texture, filepath, usage);
 }
 
-static GLuint loadShaderComponent(const std::string& filename, GLenum glType)
+static bool loadTexture(opengl_scene_resources& resources, opengl_texture& texture, const std::string& filename, texture_usage usage)
 {
-	GLuint shaderID = glCreateShader(glType);
-	if (!shaderID)
+	std::unordered_map<std::string, opengl_texture>::iterator it = resources.loadedTextures.find(filename);
+	if (it != resources.loadedTextures.end())
 	{
-		std::cerr << "shader component creation failed" << std::endl;
+		texture = it->second;
+		return true;
 	}
 
-	std::string path = getPath(filename);
-
-	input_file openFiles[5];
-	openFiles[0] = readFile(filename.c_str());
-	uint32 numberOfOpenFiles = 1;
-	uint32 returnTo[5] = { 0 };
+	std::string filepath = "res/textures/" + filename;
 
-	if (!openFiles[0].contents)
+	compressed_texture compressed;
+	if (!loadCompressedTexture(compressed, filepath, usage))
 	{
-		std::cerr << "shader file reading failed" << std::endl;
+		std::cerr << "File " << filepath << " not found." << std::endl;
+		return false;
 	}
 
-	char* shaderPrefix;
-	switch (glType)
+	uint32 totalSize = 0, uncompressedSize = 0;
+	for (uint32 level = 0; level < compressed.numberOfLevels; ++level)
 	{
-		case GL_VERTEX_SHADER: { shaderPrefix = "##GL_VERTEX_SHADER\n"; } break;
-		case GL_GEOMETRY_SHADER: { shaderPrefix = "##GL_GEOMETRY_SHADER\n"; } break;
-		case GL_FRAGMENT_SHADER: { shaderPrefix = "##GL_FRAGMENT_SHADER\n"; } break;
+		uint32 width = max(compressed.width >> level, 1u), height = max(compressed.height >> level, 1u);
+		totalSize += getTextureLevelSize(compressed.format, width, height);
+		uncompressedSize += width * height * 4;
 	}
-	uint64 prefixLength = strlen(shaderPrefix);
-
-
 
-	uint64 indexStack[5] = { 0 };
+	// freshly encoded textures have all levels, only the tail is kept like for cached ones
+	uint32 tailLevel = getResidentTailLevel(compressed.width, compressed.height, compressed.numberOfLevels);
+	trimTextureLevels(compressed, tailLevel, compressed.numberOfLevels);
 
-	char* shaderSources[10] = { 0 };
-	shaderSources[0] = (char*)openFiles[0].contents;
-	GLint shaderLengths[10] = { 0 };
+	std::cout << filename << ": " << getTextureFormatName(compressed.format) << ", " << totalSize / 1024 << " KB ("
+		<< uncompressedSize / 1024 << " KB uncompressed), " << compressed.data.size() / 1024 << " KB resident" << std::endl;
 
-	for (indexStack[0] = 0; indexStack[0] < openFiles[0].size; ++indexStack[0])
+	uint32 arrayIndex = resources.numberOfTextureArrays;
+	for (uint32 i = 0; i < resources.numberOfTextureArrays; ++i)
 	{
-		if (strncmp(shaderSources[0] + indexStack[0], shaderPrefix, prefixLength - 1) == 0)
+		const opengl_texture_array& textureArray = resources.textureArrays[i];
+		if (textureArray.width == compressed.width && textureArray.height == compressed.height
+			&& textureArray.format == compressed.format && textureArray.numberOfLevels == compressed.numberOfLevels)
 		{
-			shaderSources[0] = shaderSources[0] + indexStack[0] + prefixLength;
+			arrayIndex = i;
 			break;
 		}
 	}
 
-	indexStack[0] += prefixLength;
-
-	const char* include = "#include \"";
-	size_t includeLength = strlen(include);
-
-	uint32 filePointer = 0;
-	uint64 currentIndex = 0;
-	uint32 currentWrite = 0;
-	while (true)
+	if (arrayIndex == MAX_TEXTURE_ARRAYS)
 	{
-		if (filePointer == 0 && (indexStack[0] + currentIndex >= openFiles[0].size || strncmp(shaderSources[currentWrite] + currentIndex, "##", 2) == 0))
-		{
-			shaderLengths[currentWrite] = (GLint)currentIndex;
-			break;
-		}
-		else if (strncmp(shaderSources[currentWrite] + currentIndex, include, includeLength) == 0)
-		{
-			char includeFileName[50];
-			uint32 fileNameLength = 0;
-			for (; shaderSources[currentWrite][currentIndex + includeLength + fileNameLength] != '\"'; ++fileNameLength)
-			{
-				includeFileName[fileNameLength] = shaderSources[currentWrite][currentIndex + includeLength + fileNameLength];
-			}
-			includeFileName[fileNameLength] = '\0';
-			std::string includeFilePath = path + "/" + includeFileName;
-			std::cout << openFiles[filePointer].filename << " includes " << includeFilePath << std::endl;
-
-			openFiles[numberOfOpenFiles++] = readFile(includeFilePath.c_str());
+		std::cerr << "too many different texture sizes and formats, " << filepath << " is ignored" << std::endl;
+		return false;
+	}
 
-			shaderLengths[currentWrite] = (GLint)currentIndex;
-			indexStack[filePointer] = indexStack[filePointer] + currentIndex + includeLength + fileNameLength + 1;
+	opengl_texture_array& textureArray = resources.textureArrays[arrayIndex];
+	if (arrayIndex == resources.numberOfTextureArrays)
+	{
+		textureArray.width = compressed.width;
+		textureArray.height = compressed.height;
+		textureArray.format = compressed.format;
+		textureArray.numberOfLevels = compressed.numberOfLevels;
+		textureArray.tailLevel = tailLevel;
+		textureArray.residentLevel = tailLevel;
+		textureArray.wantedLevel = tailLevel;
+		textureArray.lastUsedFrame = 0;
+		textureArray.streaming = false;
+		++resources.numberOfTextureArrays;
+	}
 
-			uint32 myFilePointer = filePointer;
-			filePointer = numberOfOpenFiles - 1;
+	texture.arrayIndex = arrayIndex;
+	texture.layer = (uint32)textureArray.pendingLayers.size();
+	textureArray.pendingLayers.push_back(std::move(compressed));
+	textureArray.layerFiles.push_back(filepath + ".ktx");
 
-			++currentWrite;
-			returnTo[currentWrite] = myFilePointer;
+	resources.loadedTextures[filename] = texture;
 
-			shaderSources[currentWrite] = (char*)openFiles[filePointer].contents;
+	return true;
+}
 
-			currentIndex = 0;
-		}
-		else if (indexStack[filePointer] + currentIndex >= openFiles[filePointer].size)
-		{
-			shaderLengths[currentWrite] = (GLint)currentIndex;
+static const char* stageNames[SHADER_STAGE_COUNT] = { "vertex shader", "geometry shader", "fragment shader" };
 
-			filePointer = returnTo[filePointer];
-			++currentWrite;
+// KHR_parallel_shader_compile, not in our glew version
+#define GL_COMPLETION_STATUS_KHR 0x91B1
 
-			shaderSources[currentWrite] = (char*)openFiles[filePointer].contents + indexStack[filePointer];
-			currentIndex = 0;
-		}
-		else
-		{
-			++currentIndex;
-		}
+// only submits the source, the status is checked when the program is finished
+static GLuint beginShaderComponent(shader_preprocessor& preprocessor, uint32 fileIndex, shader_stage stage, const char* defines, GLenum glType)
+{
+	if (!expandShader(preprocessor, fileIndex, stage, defines))
+	{
+		std::cerr << "shader file " << preprocessor.files[fileIndex].filepath << " has no " << stageNames[stage] << std::endl;
+		return 0;
 	}
 
-	uint32 numberOfStrings = currentWrite + 1;
-
+	GLuint shaderID = glCreateShader(glType);
+	if (!shaderID)
+	{
+		std::cerr << "shader component creation failed" << std::endl;
+		return 0;
+	}
 
-	glShaderSource(shaderID, numberOfStrings, shaderSources, shaderLengths);
+	glShaderSource(shaderID, (GLsizei)preprocessor.sources.size(), preprocessor.sources.data(), preprocessor.lengths.data());
 	glCompileShader(shaderID);
 
+	return shaderID;
+}
+
+static void printShaderComponentErrors(GLuint shaderID, const char* filename, shader_stage stage)
+{
 	GLint success;
 	glGetShaderiv(shaderID, GL_COMPILE_STATUS, &success);
 	if (!success)
@@ -544,63 +1420,131 @@ static GLuint loadShaderComponent(const std::string& filename, GLenum glType)
 		GLchar infoLog[1024];
 		glGetShaderInfoLog(shaderID, 1024, NULL, infoLog);
 
-		std::cerr << "Error compiling shader " << openFiles[0].filename << ":\n" << infoLog << std::endl;
+		std::cerr << "Error compiling " << stageNames[stage] << " of " << filename << ":\n" << infoLog << std::endl;
 	}
+}
 
-	for (uint32 i = 0; i < currentWrite; ++i)
-		freeFile(openFiles[i]);
+static void discardPendingShader(opengl_shader& shader)
+{
+	if (shader.pendingProgramID) glDeleteProgram(shader.pendingProgramID);
+	if (shader.pendingVS_ID && shader.pendingVS_ID != shader.vs_ID) glDeleteShader(shader.pendingVS_ID);
+	if (shader.pendingFS_ID && shader.pendingFS_ID != shader.fs_ID) glDeleteShader(shader.pendingFS_ID);
 
-	return shaderID;
+	shader.pendingProgramID = 0;
+	shader.pendingVS_ID = shader.pendingFS_ID = 0;
+	shader.pendingVSHash = shader.pendingFSHash = 0;
 }
 
-static bool loadShader(opengl_shader& shader, const std::string& filename)
+// submits compiling and linking without waiting for the driver. only stages whose expanded source changed are
+// recompiled. returns false if there is nothing new to compile
+static bool beginShaderLoad(shader_preprocessor& preprocessor, opengl_shader& shader, const char* filename, const char* defines = "")
 {
 	std::string path = "res/shaders/";
 	std::string filepath = path + filename;
 
-	uint64 writeTime = getFileWriteTime(filepath.c_str());
-	if (writeTime <= shader.writeTime)
+	uint32 fileIndex = getShaderFile(preprocessor, filepath);
+	uint64 vsHash = getShaderStageHash(preprocessor, fileIndex, SHADER_STAGE_VERTEX, defines);
+	uint64 fsHash = getShaderStageHash(preprocessor, fileIndex, SHADER_STAGE_FRAGMENT, defines);
+
+	if (shader.pendingProgramID)
 	{
-		//std::cout << "already loaded" << std::endl;
+		if (vsHash == shader.pendingVSHash && fsHash == shader.pendingFSHash)
+			return false;
+		discardPendingShader(shader);
+	}
 
-		shader.writeTime = writeTime;
+	if (vsHash == shader.vsHash && fsHash == shader.fsHash)
 		return false;
-	}
 
-	shader.writeTime = writeTime;
+	GLuint vs_ID = (vsHash == shader.vsHash) ? shader.vs_ID : beginShaderComponent(preprocessor, fileIndex, SHADER_STAGE_VERTEX, defines, GL_VERTEX_SHADER);
+	GLuint fs_ID = (fsHash == shader.fsHash) ? shader.fs_ID : beginShaderComponent(preprocessor, fileIndex, SHADER_STAGE_FRAGMENT, defines, GL_FRAGMENT_SHADER);
 
-	std::cout << "reloading" << std::endl;
+	GLuint programID = 0;
+	if (vs_ID && fs_ID)
+	{
+		programID = glCreateProgram();
+		if (!programID)
+			std::cerr << "program creation failed" << std::endl;
+	}
 
-	shader.programID = glCreateProgram();
-	if (!shader.programID)
+	if (!programID)
 	{
-		std::cerr << "program creation failed" << std::endl;
+		if (vs_ID && vs_ID != shader.vs_ID) glDeleteShader(vs_ID);
+		if (fs_ID && fs_ID != shader.fs_ID) glDeleteShader(fs_ID);
+		return false;
+	}
+
+	glAttachShader(programID, vs_ID);
+	glAttachShader(programID, fs_ID);
+	glLinkProgram(programID);
+
+	shader.filename = filename;
+	shader.pendingProgramID = programID;
+	shader.pendingVS_ID = vs_ID;
+	shader.pendingFS_ID = fs_ID;
+	shader.pendingVSHash = vsHash;
+	shader.pendingFSHash = fsHash;
+
+	return true;
+}
+
+// returns true once the pending program replaced the current one. with KHR_parallel_shader_compile this does not block
+// while the driver is still busy, the current program is used in the meantime. if there is no current program yet, or
+// the extension is missing, this waits
+static bool finishShaderLoad(opengl_shader& shader, bool parallelShaderCompile)
+{
+	if (!shader.pendingProgramID)
 		return false;
+
+	if (parallelShaderCompile && shader.programID)
+	{
+		GLint completed;
+		glGetProgramiv(shader.pendingProgramID, GL_COMPLETION_STATUS_KHR, &completed);
+		if (!completed)
+			return false;
 	}
 
-	shader.vs_ID = loadShaderComponent(filepath, GL_VERTEX_SHADER);
-	shader.fs_ID = loadShaderComponent(filepath, GL_FRAGMENT_SHADER);
-	glAttachShader(shader.programID, shader.vs_ID);
-	glAttachShader(shader.programID, shader.fs_ID);
-	glLinkProgram(shader.programID);
 	GLint success;
-	glGetProgramiv(shader.programID, GL_LINK_STATUS, &success);
+	glGetProgramiv(shader.pendingProgramID, GL_LINK_STATUS, &success);
 	if (!success)
 	{
+		if (shader.pendingVS_ID != shader.vs_ID) printShaderComponentErrors(shader.pendingVS_ID, shader.filename, SHADER_STAGE_VERTEX);
+		if (shader.pendingFS_ID != shader.fs_ID) printShaderComponentErrors(shader.pendingFS_ID, shader.filename, SHADER_STAGE_FRAGMENT);
+
 		GLchar infoLog[1024];
-		glGetProgramInfoLog(shader.programID, 1024, NULL, infoLog);
-		std::cerr << "error linking shader" << filename << ":\n" << infoLog << std::endl;
+		glGetProgramInfoLog(shader.pendingProgramID, 1024, NULL, infoLog);
+		std::cerr << "error linking shader" << shader.filename << ":\n" << infoLog << std::endl;
+
+		discardPendingShader(shader);
 		return false;
 	}
 
-	glValidateProgram(shader.programID);
-	glGetProgramiv(shader.programID, GL_VALIDATE_STATUS, &success);
+	glValidateProgram(shader.pendingProgramID);
+	glGetProgramiv(shader.pendingProgramID, GL_VALIDATE_STATUS, &success);
 	if (!success)
 	{
 		std::cerr << "error validating shader" << std::endl;
+		discardPendingShader(shader);
 		return false;
 	}
 
+	if (shader.programID)
+	{
+		glDeleteProgram(shader.programID);
+		if (shader.pendingVS_ID != shader.vs_ID) glDeleteShader(shader.vs_ID);
+		if (shader.pendingFS_ID != shader.fs_ID) glDeleteShader(shader.fs_ID);
+	}
+
+	shader.programID = shader.pendingProgramID;
+	shader.vs_ID = shader.pendingVS_ID;
+	shader.fs_ID = shader.pendingFS_ID;
+	shader.vsHash = shader.pendingVSHash;
+	shader.fsHash = shader.pendingFSHash;
+
+	shader.pendingProgramID = 0;
+	shader.pendingVS_ID = shader.pendingFS_ID = 0;
+	shader.pendingVSHash = shader.pendingFSHash = 0;
+
 	return true;
 }
 
@@ -703,16 +1647,16 @@ static void deleteFBO(opengl_fbo& fbo)
 	fbo.usesDepth = false;
 }
 
-static inline void bindFramebuffer(opengl_fbo& fbo)
+static inline void bindFramebuffer(memory_arena& frameArena, opengl_fbo& fbo)
 {
 	glBindFramebuffer(GL_FRAMEBUFFER, fbo.fbo);
 	glViewport(0, 0, fbo.width, fbo.height);
 	if (fbo.colorTextures.size() > 0)
 	{
-		std::vector<GLenum> drawBuffers(fbo.colorTextures.size());
+		GLenum* drawBuffers = pushArray<GLenum>(frameArena, fbo.colorTextures.size());
 		for (uint32 i = 0; i < fbo.colorTextures.size(); ++i)
 			drawBuffers[i] = GL_COLOR_ATTACHMENT0 + i;
-		glDrawBuffers((GLsizei)fbo.colorTextures.size(), &drawBuffers[0]);
+		glDrawBuffers((GLsizei)fbo.colorTextures.size(), drawBuffers);
 	}
 	else
 	{
@@ -811,49 +1755,76 @@ static void blitFrameBufferToScreen(opengl_fbo& from, uint32 fromIndex,
 		GL_COLOR_BUFFER_BIT, GL_NEAREST);
 }
 
+static bool beginGeometryPermutation(opengl_renderer& renderer, uint32 permutation)
+{
+	char defines[256] = "";
+	if (permutation & MATERIAL_DIFFUSE_TEXTURE) strcat(defines, "#define HAS_DIFFUSE_TEXTURE\n");
+	if (permutation & MATERIAL_NORMAL_TEXTURE) strcat(defines, "#define HAS_NORMAL_TEXTURE\n");
+	if (permutation & MATERIAL_SPECULAR_TEXTURE) strcat(defines, "#define HAS_SPECULAR_TEXTURE\n");
+	if (permutation & MATERIAL_EMITTING) strcat(defines, "#define EMITTING\n");
+	if (renderer.bindlessTextures) strcat(defines, "#define BINDLESS_TEXTURES\n");
+#if QUANTIZE_VERTICES
+	strcat(defines, "#define QUANTIZED_VERTICES\n");
+#endif
+
+	return beginShaderLoad(renderer.shaderPreprocessor, renderer.geometryPermutations[permutation].shader, "geometry_shader.glsl", defines);
+}
+
+static void setupGeometryPermutation(opengl_geometry_permutation& geometry)
+{
+	opengl_shader& shader = geometry.shader;
+	bindShader(shader);
+	glUniformBlockBinding(shader.programID, glGetUniformBlockIndex(shader.programID, "geometry_pass_block"), PASS_BLOCK_BINDING);
+
+	GLuint textureHandleBlock = glGetUniformBlockIndex(shader.programID, "texture_handle_block");
+	if (textureHandleBlock != GL_INVALID_INDEX)
+	{
+		glUniformBlockBinding(shader.programID, textureHandleBlock, TEXTURE_HANDLE_BLOCK_BINDING);
+	}
+	else
+	{
+		GLint textureUnits[MAX_TEXTURE_ARRAYS];
+		for (uint32 i = 0; i < MAX_TEXTURE_ARRAYS; ++i)
+			textureUnits[i] = i;
+		glUniform1iv(glGetUniformLocation(shader.programID, "textureArrays"), MAX_TEXTURE_ARRAYS, textureUnits);
+	}
+
+	glUniformBlockBinding(shader.programID, glGetUniformBlockIndex(shader.programID, "material_block"), MATERIAL_BLOCK_BINDING);
+}
+
 static bool loadAllShaders(opengl_renderer& renderer)
 {
-	bool reloaded = false;
+	// after the first load, shaders are only looked at if one of the shader files changed. everything is submitted
+	// before anything is waited for, so the driver can compile in parallel
+	bool firstLoad = renderer.shaderPreprocessor.files.empty();
+	if (updateShaderFiles(renderer.shaderPreprocessor) > 0 || firstLoad)
 	{
-		opengl_shader& shader = renderer.geometryShader;
-		if (loadShader(shader, "geometry_shader.glsl"))
+		for (uint32 i = 0; i < MATERIAL_PERMUTATION_COUNT; ++i)
 		{
-			bindShader(shader);
-			renderer.geometry_MVP = glGetUniformLocation(shader.programID, "MVP");
-			renderer.geometry_MV = glGetUniformLocation(shader.programID, "MV");
-			renderer.geometry_ambient = glGetUniformLocation(shader.programID, "ambient");
-			renderer.geometry_diffuse = glGetUniformLocation(shader.programID, "diffuse");
-			renderer.geometry_specular = glGetUniformLocation(shader.programID, "specular");
-			renderer.geometry_shininess = glGetUniformLocation(shader.programID, "shininess");
-			renderer.geometry_emitting = glGetUniformLocation(shader.programID, "emitting");
-			renderer.geometry_hasDiffuseTexture = glGetUniformLocation(shader.programID, "hasDiffuseTexture");
-			renderer.geometry_hasNormalTexture = glGetUniformLocation(shader.programID, "hasNormalTexture");
-			renderer.geometry_hasSpecularTexture = glGetUniformLocation(shader.programID, "hasSpecularTexture");
-			renderer.geometry_numberOfPointLights = glGetUniformLocation(shader.programID, "numberOfPointLights");
-
-			for (uint32 i = 0; i < MAX_POINT_LIGHTS; ++i)
-			{
-				std::string uniformName = std::string("pointLights[") + std::to_string(i) + "].";
-				renderer.geometry_pl_position[i] = glGetUniformLocation(shader.programID, (uniformName + "position").c_str());
-				renderer.geometry_pl_radius[i] = glGetUniformLocation(shader.programID, (uniformName + "radius").c_str());
-				renderer.geometry_pl_color[i] = glGetUniformLocation(shader.programID, (uniformName + "color").c_str());
-			}
-
-			glUniform1i(glGetUniformLocation(shader.programID, "diffuseTexture"), 0);
-			glUniform1i(glGetUniformLocation(shader.programID, "normalTexture"), 1);
-			glUniform1i(glGetUniformLocation(shader.programID, "specularTexture"), 2);
+			if (renderer.geometryPermutations[i].used)
+				beginGeometryPermutation(renderer, i);
+		}
+		beginShaderLoad(renderer.shaderPreprocessor, renderer.ssrShader, "ssr_shader.glsl");
+		beginShaderLoad(renderer.shaderPreprocessor, renderer.blurShader, "blur_shader.glsl");
+		beginShaderLoad(renderer.shaderPreprocessor, renderer.resultShader, "result_shader.glsl");
+	}
 
+	bool reloaded = false;
+	for (uint32 i = 0; i < MATERIAL_PERMUTATION_COUNT; ++i)
+	{
+		opengl_geometry_permutation& geometry = renderer.geometryPermutations[i];
+		if (finishShaderLoad(geometry.shader, renderer.parallelShaderCompile))
+		{
+			setupGeometryPermutation(geometry);
 			reloaded = true;
 		}
 	}
 	{
 		opengl_shader& shader = renderer.ssrShader;
-		if (loadShader(shader, "ssr_shader.glsl"))
+		if (finishShaderLoad(shader, renderer.parallelShaderCompile))
 		{
 			bindShader(shader);
-			renderer.ssr_proj = glGetUniformLocation(shader.programID, "proj");
-			renderer.ssr_toPrevFramePos = glGetUniformLocation(shader.programID, "toPrevFramePos");
-			renderer.ssr_clippingPlanes = glGetUniformLocation(shader.programID, "clippingPlanes");
+			glUniformBlockBinding(shader.programID, glGetUniformBlockIndex(shader.programID, "ssr_pass_block"), PASS_BLOCK_BINDING);
 
 			glUniform1i(glGetUniformLocation(shader.programID, "positionTexture"), 0);
 			glUniform1i(glGetUniformLocation(shader.programID, "normalTexture"), 1);
@@ -867,11 +1838,10 @@ static bool loadAllShaders(opengl_renderer& renderer)
 	}
 	{
 		opengl_shader& shader = renderer.blurShader;
-		if (loadShader(shader, "blur_shader.glsl"))
+		if (finishShaderLoad(shader, renderer.parallelShaderCompile))
 		{
 			bindShader(shader);
-
-			renderer.blur_blurDirection = glGetUniformLocation(shader.programID, "blurDirection");
+			glUniformBlockBinding(shader.programID, glGetUniformBlockIndex(shader.programID, "blur_pass_block"), PASS_BLOCK_BINDING);
 
 			glUniform1i(glGetUniformLocation(shader.programID, "inputTexture"), 0);
 
@@ -880,7 +1850,7 @@ static bool loadAllShaders(opengl_renderer& renderer)
 	}
 	{
 		opengl_shader& shader = renderer.resultShader;
-		if (loadShader(shader, "result_shader.glsl"))
+		if (finishShaderLoad(shader, renderer.parallelShaderCompile))
 		{
 			bindShader(shader);
 
@@ -899,6 +1869,15 @@ void initializeRenderer(opengl_renderer& renderer, uint32 screenWidth, uint32 sc
 	renderer.width = screenWidth;
 	renderer.height = screenHeight;
 
+	if (!GLEW_VERSION_4_3)
+	{
+		std::cerr << "OpenGL 4.3 is required for indirect drawing" << std::endl;
+	}
+	if (!GLEW_ARB_buffer_storage)
+	{
+		std::cerr << "ARB_buffer_storage is required for the persistently mapped upload ring" << std::endl;
+	}
+
 	bool fboSuccess = initializeFBOs(renderer);
 	if (!fboSuccess)
 	{
@@ -907,13 +1886,43 @@ void initializeRenderer(opengl_renderer& renderer, uint32 screenWidth, uint32 sc
 
 	// shaders
 	{
+		// lets the driver compile and link on its own threads, while we keep rendering with the previous programs
+		renderer.parallelShaderCompile = false;
+		bool s3tcSupported = false; // bc1 and bc3, bc4 and bc5 are core
+		GLint numberOfExtensions = 0;
+		glGetIntegerv(GL_NUM_EXTENSIONS, &numberOfExtensions);
+		for (GLint i = 0; i < numberOfExtensions; ++i)
+		{
+			const char* extension = (const char*)glGetStringi(GL_EXTENSIONS, i);
+			if (strcmp(extension, "GL_KHR_parallel_shader_compile") == 0 || strcmp(extension, "GL_ARB_parallel_shader_compile") == 0)
+				renderer.parallelShaderCompile = true;
+			if (strcmp(extension, "GL_EXT_texture_compression_s3tc") == 0)
+				s3tcSupported = true;
+		}
+		if (!s3tcSupported)
+			std::cerr << "GL_EXT_texture_compression_s3tc is not supported, color textures will not load" << std::endl;
+
+		// otherwise the texture arrays are bound to one unit each and picked with a branch in the shader
+		renderer.bindlessTextures = GLEW_ARB_bindless_texture != 0;
+		std::cout << "bindless textures " << (renderer.bindlessTextures ? "supported" : "not supported") << std::endl;
+
 		for (uint32 i = 0; i < SHADER_COUNT; ++i)
-			renderer.shaders[i].writeTime = 0;
+			renderer.shaders[i] = opengl_shader();
+		for (uint32 i = 0; i < MATERIAL_PERMUTATION_COUNT; ++i)
+			renderer.geometryPermutations[i] = opengl_geometry_permutation();
 		loadAllShaders(renderer);
+
+		std::cout << "shader includes:" << std::endl;
+		for (const char* filename : { "geometry_shader.glsl", "ssr_shader.glsl", "blur_shader.glsl", "result_shader.glsl" })
+			printShaderDependencies(renderer.shaderPreprocessor, getShaderFile(renderer.shaderPreprocessor, std::string("res/shaders/") + filename));
 	}
 
-	loadMesh(renderer.plane, "plane.obj");
-	loadMesh(renderer.sphere, "sphere.obj");
+	// nothing is rendered yet, the frame arena holds the vertices until they are uploaded
+	createArena(renderer.frameArena, FRAME_ARENA_SIZE);
+	loadMesh(renderer.frameArena, renderer.plane, "plane.obj");
+	loadMesh(renderer.frameArena, renderer.sphere, "sphere.obj");
+
+	createUploadRing(renderer.uploadRing);
 
 	glClearColor(0.18f, 0.35f, 0.5f, 1.0f);
 	glEnable(GL_CULL_FACE);
@@ -921,150 +1930,542 @@ void initializeRenderer(opengl_renderer& renderer, uint32 screenWidth, uint32 sc
 	glEnable(GL_DEPTH_TEST);
 }
 
-static void renderGeometry(opengl_renderer& renderer, scene_state& scene)
+// distance from the camera to the closest point of the bounds. never smaller than the near plane, so close objects use the finest level
+static float getLodDistance(const camera& cam, const bounding_sphere& sphere)
+{
+	float distance = length(sphere.center - cam.position) - sphere.radius;
+	return max(distance, cam.nearPlane);
+}
+
+// a texel of the finest needed level should cover about one pixel. uvPerPixel is the texture coordinate distance one
+// pixel covers at the closest point of the draw
+static void requestTextureLevels(uint32* wantedTextureLevels, const opengl_scene_resources& resources, uint32 materialIndex, float uvPerPixel)
 {
-	opengl_shader& geometryShader = renderer.geometryShader;
-	bindShader(geometryShader);
+	if ((materialIndex + 1) * 3 > resources.materialTextureArrays.size())
+		return;
 
-	glUniform1i(renderer.geometry_numberOfPointLights, (int32)scene.pointLights.size());
-	for (uint32 i = 0; i < min(scene.pointLights.size(), MAX_POINT_LIGHTS); ++i)
+	for (uint32 t = 0; t < 3; ++t)
 	{
-		vec4 posVS = scene.cam.view * vec4(scene.pointLights[i].position, 1.f);
-		glUniform3f(renderer.geometry_pl_position[i], posVS.x, posVS.y, posVS.z);
-		glUniform1f(renderer.geometry_pl_radius[i], scene.pointLights[i].radius);
-		glUniform3f(renderer.geometry_pl_color[i], scene.pointLights[i].color.x, scene.pointLights[i].color.y, scene.pointLights[i].color.z);
+		int32 arrayIndex = resources.materialTextureArrays[materialIndex * 3 + t];
+		if (arrayIndex < 0)
+			continue;
+
+		// the size never changes after loading, so it is safe to read while the render thread streams
+		const opengl_texture_array& textureArray = resources.textureArrays[arrayIndex];
+		float texelsPerPixel = uvPerPixel * max(textureArray.width, textureArray.height);
+		uint32 level = (texelsPerPixel > 1.f) ? (uint32)log2f(texelsPerPixel) : 0;
+		wantedTextureLevels[arrayIndex] = min(wantedTextureLevels[arrayIndex], level);
 	}
+}
+
+// levels of arrays which are streaming or were drawn this frame at no more than the level they need are kept
+static bool canEvictTextureLevel(const opengl_texture_array& textureArray, uint64 frame)
+{
+	if (textureArray.streaming || textureArray.residentLevel >= textureArray.tailLevel)
+		return false;
+	return textureArray.lastUsedFrame != frame || textureArray.residentLevel < textureArray.wantedLevel;
+}
 
-	mat4 MV = scene.cam.view;
-	mat4 MVP = scene.cam.proj * MV;
+// applies the finished reads, then requests the next finer level of the arrays which need it most while the budget
+// allows, evicting levels of the least recently used arrays to make room. arrays grow by one level per request, so
+// the resolution improves progressively and the memory of every step is known before it is read
+static void updateTextureStreaming(opengl_scene_resources& resources, const render_frame& renderFrame)
+{
+	uint64 frame = resources.streamingFrame++;
+	deleteRetiredTextureArrays(resources, false);
 
-	for (uint32 i = 0; i < scene.staticGeometry.size(); ++i)
+	for (uint32 i = 0; i < resources.numberOfTextureArrays; ++i)
 	{
-		glUniformMatrix4fv(renderer.geometry_MV, 1, GL_FALSE, MV.data);
-		glUniformMatrix4fv(renderer.geometry_MVP, 1, GL_FALSE, MVP.data);
-
-		// material properties
-		glUniform3f(renderer.geometry_ambient, scene.staticGeometryMaterials[i].ambient.x, scene.staticGeometryMaterials[i].ambient.y, scene.staticGeometryMaterials[i].ambient.z);
-		glUniform3f(renderer.geometry_diffuse, scene.staticGeometryMaterials[i].diffuse.x, scene.staticGeometryMaterials[i].diffuse.y, scene.staticGeometryMaterials[i].diffuse.z);
-		glUniform3f(renderer.geometry_specular, scene.staticGeometryMaterials[i].specular.x, scene.staticGeometryMaterials[i].specular.y, scene.staticGeometryMaterials[i].specular.z);
-		glUniform1f(renderer.geometry_shininess, scene.staticGeometryMaterials[i].shininess);
+		opengl_texture_array& textureArray = resources.textureArrays[i];
+		textureArray.wantedLevel = min(renderFrame.wantedTextureLevels[i], textureArray.tailLevel);
+		if (renderFrame.wantedTextureLevels[i] != UINT32_MAX)
+			textureArray.lastUsedFrame = frame;
+	}
 
-		if (scene.staticGeometryMaterials[i].hasDiffuseTexture)
+	// the gl thread only issues copies out of the staging memory the workers filled
+	reclaimStaging(resources.textureStaging);
+	popFinishedTextureRequests(resources.textureStreamer, resources.finishedTextureRequests);
+	for (texture_stream_request* request : resources.finishedTextureRequests)
+	{
+		opengl_texture_array& textureArray = resources.textureArrays[request->arrayIndex];
+		textureArray.streaming = false;
+		if (request->succeeded)
 		{
-			glUniform1i(renderer.geometry_hasDiffuseTexture, 1);
-
-			glActiveTexture(GL_TEXTURE0);
-			glBindTexture(GL_TEXTURE_2D, scene.staticGeometryMaterials[i].diffuseTexture.textureID);
+			resizeTextureArray(resources, textureArray, request->firstLevel);
+			uploadStagedTextureLevels(textureArray, resources.textureStaging, request->stagingOffset, request->firstLevel, request->endLevel);
 		}
 		else
 		{
-			glUniform1i(renderer.geometry_hasDiffuseTexture, 0);
+			// the levels it has become its tail, so it is not requested again
+			std::cerr << "could not stream level " << request->firstLevel << " of texture array " << request->arrayIndex << std::endl;
+			textureArray.tailLevel = textureArray.residentLevel;
 		}
+		releaseStaging(resources.textureStaging, request->stagingOffset);
+		delete request;
+	}
 
-		if (scene.staticGeometryMaterials[i].hasNormalTexture)
-		{
-			glUniform1i(renderer.geometry_hasNormalTexture, 1);
+	uint32 numberOfArrays = resources.numberOfTextureArrays;
+	uint64 streamedSize = 0;
+	uint32 candidates[MAX_TEXTURE_ARRAYS];
+	uint32 numberOfCandidates = 0;
+	for (uint32 i = 0; i < numberOfArrays; ++i)
+	{
+		const opengl_texture_array& textureArray = resources.textureArrays[i];
+		streamedSize += getTextureArrayLevelsSize(textureArray, textureArray.residentLevel, textureArray.tailLevel);
+		if (textureArray.streaming)
+			streamedSize += getTextureArrayLevelsSize(textureArray, textureArray.residentLevel - 1, textureArray.residentLevel);
+		else if (textureArray.lastUsedFrame == frame && textureArray.wantedLevel < textureArray.residentLevel)
+			candidates[numberOfCandidates++] = i;
+	}
 
-			glActiveTexture(GL_TEXTURE1);
-			glBindTexture(GL_TEXTURE_2D, scene.staticGeometryMaterials[i].normalTexture.textureID);
-		}
-		else
+	// the arrays furthest from what they need go first
+	opengl_texture_array* textureArrays = resources.textureArrays;
+	std::sort(candidates, candidates + numberOfCandidates, [textureArrays](uint32 a, uint32 b)
+	{
+		return textureArrays[a].residentLevel - textureArrays[a].wantedLevel > textureArrays[b].residentLevel - textureArrays[b].wantedLevel;
+	});
+
+	for (uint32 c = 0; c < numberOfCandidates; ++c)
+	{
+		opengl_texture_array& textureArray = textureArrays[candidates[c]];
+		uint64 size = getTextureArrayLevelsSize(textureArray, textureArray.residentLevel - 1, textureArray.residentLevel);
+
+		// a level larger than the budget (or the staging buffer, which is at most as large) would evict everything
+		// and still not fit. the levels it has become its tail, so it is not requested again
+		if (size > resources.textureBudget || size > resources.textureStaging.capacity)
 		{
-			glUniform1i(renderer.geometry_hasNormalTexture, 0);
+			std::cerr << "level " << textureArray.residentLevel - 1 << " of texture array " << candidates[c] << " (" << size / 1024
+				<< " KB) does not fit the streaming budget, keeping level " << textureArray.residentLevel << std::endl;
+			textureArray.tailLevel = textureArray.residentLevel;
+			continue;
 		}
 
-		if (scene.staticGeometryMaterials[i].hasSpecularTexture)
+		// levels which were not needed this frame are only kept as long as nothing else needs the memory. nothing is
+		// evicted unless that makes enough room
+		uint64 evictableSize = 0;
+		for (uint32 i = 0; i < numberOfArrays; ++i)
 		{
-			glUniform1i(renderer.geometry_hasSpecularTexture, 1);
+			const opengl_texture_array& other = textureArrays[i];
+			if (canEvictTextureLevel(other, frame))
+				evictableSize += getTextureArrayLevelsSize(other, other.residentLevel, other.lastUsedFrame == frame ? other.wantedLevel : other.tailLevel);
+		}
+		if (streamedSize + size > resources.textureBudget + evictableSize)
+			continue;
+
+		// staging memory is claimed up front, so the worker can write the levels to their final place. it is claimed
+		// before anything is evicted, if it is still in use the evicted levels would be lost for nothing
+		uint64 stagingOffset;
+		uint8* staging;
+		if (!allocateStaging(resources.textureStaging, size, stagingOffset, staging))
+			continue;
+
+		// arrays not drawn this frame have older use stamps, so they are evicted before arrays which are sharper than
+		// needed
+		while (streamedSize + size > resources.textureBudget)
+		{
+			int32 victim = -1;
+			for (uint32 i = 0; i < numberOfArrays; ++i)
+			{
+				const opengl_texture_array& other = textureArrays[i];
+				if (!canEvictTextureLevel(other, frame))
+					continue;
+				if (victim < 0 || other.lastUsedFrame < textureArrays[victim].lastUsedFrame)
+					victim = (int32)i;
+			}
+			if (victim < 0)
+				break;
 
-			glActiveTexture(GL_TEXTURE2);
-			glBindTexture(GL_TEXTURE_2D, scene.staticGeometryMaterials[i].specularTexture.textureID);
+			opengl_texture_array& evicted = textureArrays[victim];
+			streamedSize -= getTextureArrayLevelsSize(evicted, evicted.residentLevel, evicted.residentLevel + 1);
+			resizeTextureArray(resources, evicted, evicted.residentLevel + 1);
 		}
-		else
+		if (streamedSize + size > resources.textureBudget)
 		{
-			glUniform1i(renderer.geometry_hasSpecularTexture, 0);
+			releaseStaging(resources.textureStaging, stagingOffset);
+			continue;
 		}
 
-		glUniform1i(renderer.geometry_emitting, scene.staticGeometryMaterials[i].emitting ? 1 : 0);
+		texture_stream_request* request = new texture_stream_request();
+		request->arrayIndex = candidates[c];
+		request->firstLevel = textureArray.residentLevel - 1;
+		request->endLevel = textureArray.residentLevel;
+		request->files = textureArray.layerFiles;
+		request->staging = staging;
+		request->stagingOffset = stagingOffset;
+		request->stagingSize = size;
+		submitTextureRequest(resources.textureStreamer, request);
+
+		textureArray.streaming = true;
+		streamedSize += size;
+	}
+}
 
-		bindAndDrawMesh(scene.staticGeometry[i]);
+static void pushDraw(command_list& commands, const opengl_scene_resources& resources, const opengl_mesh& mesh, uint32 lod, const mat4* MVs, uint32 numberOfInstances, uint32 materialIndex)
+{
+	// only the uploaded materials have a permutation, the shader would read others past the end of the material block
+	if (materialIndex >= resources.materialPermutations.size())
+		return;
+	uint32 permutation = resources.materialPermutations[materialIndex];
+
+	draw_instance* instances = recordDraw(commands, makeDrawKey(permutation, mesh.format, materialIndex),
+		mesh.lods[lod].indexCount, mesh.lods[lod].firstIndex, mesh.baseVertex, numberOfInstances);
+	for (uint32 i = 0; i < numberOfInstances; ++i)
+	{
+		draw_instance& instance = instances[i];
+		instance.MV = MVs[i] * mesh.dequantization;
+		instance.materialIndex = materialIndex;
+		memcpy(instance.texCoordTransform, &mesh.texCoordTransform, sizeof(instance.texCoordTransform));
 	}
+}
+
+// visible static meshes per job of buildFrame
+#define FRAME_RECORD_GRAIN_SIZE 64
+
+struct static_geometry_recording
+{
+	const scene_state* scene;
+	frame_builder* builder;
+	float pixelsPerUnit;
+};
 
-	for (uint32 i = 0; i < scene.entities.size(); ++i)
+static void recordStaticGeometry(void* data, uint32 begin, uint32 end)
+{
+	static_geometry_recording& recording = *(static_geometry_recording*)data;
+	const scene_state& scene = *recording.scene;
+	frame_builder& builder = *recording.builder;
+	uint32 list = begin / FRAME_RECORD_GRAIN_SIZE;
+	command_list& commands = builder.commandLists[list];
+	uint32* wantedTextureLevels = &builder.wantedTextureLevels[list * MAX_TEXTURE_ARRAYS];
+
+	for (uint32 i = begin; i < end; ++i)
 	{
-		entity& ent = scene.entities[i];
-		mat4 MV = scene.cam.view * sqtToMat4(ent.position);
-		mat4 MVP = scene.cam.proj * MV;
+		uint32 object = builder.visibleObjects[i];
+		if (object >= scene.staticGeometry.size())
+			continue;
 
-		glUniformMatrix4fv(renderer.geometry_MV, 1, GL_FALSE, MV.data);
-		glUniformMatrix4fv(renderer.geometry_MVP, 1, GL_FALSE, MVP.data);
+		const opengl_mesh& mesh = scene.staticGeometry[object];
 
-		for (uint32 m = ent.meshStartIndex; m < ent.meshEndIndex; ++m)
-		{
+		float errors[MAX_MESH_LODS];
+		for (uint32 l = 0; l < mesh.numberOfLods; ++l)
+			errors[l] = mesh.lods[l].error;
 
-			// material properties
-			glUniform3f(renderer.geometry_ambient, scene.materials[m].ambient.x, scene.materials[m].ambient.y, scene.materials[m].ambient.z);
-			glUniform3f(renderer.geometry_diffuse, scene.materials[m].diffuse.x, scene.materials[m].diffuse.y, scene.materials[m].diffuse.z);
-			glUniform3f(renderer.geometry_specular, scene.materials[m].specular.x, scene.materials[m].specular.y, scene.materials[m].specular.z);
-			glUniform1f(renderer.geometry_shininess, scene.materials[m].shininess);
+		float distance = getLodDistance(scene.cam, mesh.boundingSphere);
+		uint32 lod = selectLod(errors, mesh.numberOfLods, distance, recording.pixelsPerUnit);
+		pushDraw(commands, scene.resources, mesh, lod, &scene.cam.view, 1, mesh.materialIndex);
+		requestTextureLevels(wantedTextureLevels, scene.resources, mesh.materialIndex, mesh.uvDensity * distance / recording.pixelsPerUnit);
+	}
+}
 
-			if (scene.materials[m].hasDiffuseTexture)
-			{
-				glUniform1i(renderer.geometry_hasDiffuseTexture, 1);
+struct entity_mesh_order
+{
+	const std::vector<entity>* entities;
 
-				glActiveTexture(GL_TEXTURE0);
-				glBindTexture(GL_TEXTURE_2D, scene.materials[m].diffuseTexture.textureID);
-			}
-			else
+	bool operator()(uint32 a, uint32 b) const
+	{
+		const entity& entA = (*entities)[a];
+		const entity& entB = (*entities)[b];
+		if (entA.meshStartIndex != entB.meshStartIndex)
+			return entA.meshStartIndex < entB.meshStartIndex;
+		return entA.meshEndIndex < entB.meshEndIndex;
+	}
+};
+
+// builds the indirect commands and per draw data for both geometry passes
+void buildFrame(render_frame& frame, frame_builder& builder, scene_state& scene, uint32 screenWidth, uint32 screenHeight, bool debugRendering)
+{
+	if (screenWidth != scene.cam.width || screenHeight != scene.cam.height)
+	{
+		scene.cam.width = screenWidth;
+		scene.cam.height = screenHeight;
+		float aspect = (float)screenWidth / (float)screenHeight;
+		scene.cam.proj = createProjectionMatrix(scene.cam.verticalFOV, aspect, scene.cam.nearPlane, scene.cam.farPlane);
+		scene.cam.toPrevFramePos = scene.cam.proj;
+		std::cout << "resize" << std::endl;
+	}
+
+	frame.scene = &scene;
+	frame.cam = scene.cam;
+	frame.debugRendering = debugRendering;
+
+	camera_frustum frustum = getWorldSpaceFrustum(scene.cam.proj * scene.cam.view);
+
+	uint32 numberOfEntities = (uint32)scene.entities.size();
+	uint32 numberOfStaticMeshes = (uint32)scene.staticGeometry.size();
+	uint32 numberOfObjects = (uint32)scene.objectBounds.size();
+
+	resetArena(builder.frameArena);
+	builder.visibleObjects = pushArray<uint32>(builder.frameArena, numberOfObjects);
+	builder.lightObjects = pushArray<uint32>(builder.frameArena, numberOfObjects);
+	builder.objectVisible = pushArray<uint8>(builder.frameArena, numberOfObjects);
+	memset(builder.objectVisible, 0, numberOfObjects);
+
+	// screen space size of one world unit at distance one. a lod is chosen if its error stays below a pixel
+	float pixelsPerUnit = 0.5f * scene.cam.height * scene.cam.proj.m11;
+
+	uint32 numberOfVisible = cullBVH(scene.objectBVH, frustum, builder.visibleObjects);
+	for (uint32 i = 0; i < numberOfVisible; ++i)
+		builder.objectVisible[builder.visibleObjects[i]] = 1;
+
+	// every range of visible objects is recorded by a job into its own list, the entities go into the last one. lists
+	// are only ever added, so their memory is reused from frame to frame
+	uint32 numberOfLists = (numberOfVisible + FRAME_RECORD_GRAIN_SIZE - 1) / FRAME_RECORD_GRAIN_SIZE + 1;
+	if (builder.commandLists.size() < numberOfLists)
+		builder.commandLists.resize(numberOfLists);
+	for (uint32 l = 0; l < numberOfLists; ++l)
+		clearCommandList(builder.commandLists[l]);
+	builder.wantedTextureLevels = pushArray<uint32>(builder.frameArena, numberOfLists * MAX_TEXTURE_ARRAYS);
+	for (uint32 i = 0; i < numberOfLists * MAX_TEXTURE_ARRAYS; ++i)
+		builder.wantedTextureLevels[i] = UINT32_MAX;
+
+	command_list& entityCommands = builder.commandLists[numberOfLists - 1];
+	uint32* entityWantedTextureLevels = &builder.wantedTextureLevels[(numberOfLists - 1) * MAX_TEXTURE_ARRAYS];
+
+	static_geometry_recording staticRecording = { &scene, &builder, pixelsPerUnit };
+	parallelFor(*scene.resources.jobSystem, numberOfVisible, FRAME_RECORD_GRAIN_SIZE, recordStaticGeometry, &staticRecording);
+
+	// lights which do not reach any visible object do not need to be shaded
+	uint32 activeLights[MAX_POINT_LIGHTS];
+	uint32 numberOfActiveLights = 0;
+	for (uint32 i = 0; i < scene.pointLights.size() && numberOfActiveLights < MAX_POINT_LIGHTS; ++i)
+	{
+		bounding_sphere lightBounds;
+		lightBounds.center = scene.pointLights[i].position;
+		lightBounds.radius = scene.pointLights[i].radius;
+
+		uint32 numberOfLightObjects = queryBVH(scene.objectBVH, lightBounds, builder.lightObjects);
+		for (uint32 j = 0; j < numberOfLightObjects; ++j)
+		{
+			if (builder.objectVisible[builder.lightObjects[j]])
 			{
-				glUniform1i(renderer.geometry_hasDiffuseTexture, 0);
+				activeLights[numberOfActiveLights++] = i;
+				break;
 			}
+		}
+	}
 
-			if (scene.materials[m].hasNormalTexture)
-			{
-				glUniform1i(renderer.geometry_hasNormalTexture, 1);
+	// entity materials are stored after the static geometry materials
+	uint32 materialOffset = (uint32)scene.staticGeometryMaterials.size();
 
-				glActiveTexture(GL_TEXTURE1);
-				glBindTexture(GL_TEXTURE_2D, scene.materials[m].normalTexture.textureID);
-			}
-			else
+	// entities referencing the same mesh range are drawn instanced, one command per mesh of the range
+	uint32* entityOrder = pushArray<uint32>(builder.frameArena, numberOfEntities);
+	for (uint32 i = 0; i < numberOfEntities; ++i)
+		entityOrder[i] = i;
+
+	entity_mesh_order order = { &scene.entities };
+	std::sort(entityOrder, entityOrder + numberOfEntities, order);
+
+	// a group never has more entities than the scene, so every level has room for all of them
+	SQT* entitySQTs[MAX_MESH_LODS];
+	uint32 numberOfEntitySQTs[MAX_MESH_LODS];
+	for (uint32 l = 0; l < MAX_MESH_LODS; ++l)
+		entitySQTs[l] = pushArray<SQT>(builder.frameArena, numberOfEntities);
+	mat4* entityMVs = pushArray<mat4>(builder.frameArena, numberOfEntities);
+
+	uint32 groupStart = 0;
+	while (groupStart < numberOfEntities)
+	{
+		const entity& first = scene.entities[entityOrder[groupStart]];
+		if (first.meshStartIndex == first.meshEndIndex)
+		{
+			++groupStart;
+			continue;
+		}
+
+		// all meshes of the range switch level together, so the error of a level is the largest of the range
+		float rangeErrors[MAX_MESH_LODS];
+		uint32 rangeLods = 1;
+		for (uint32 l = 0; l < MAX_MESH_LODS; ++l)
+			rangeErrors[l] = 0.f;
+		for (uint32 m = first.meshStartIndex; m < first.meshEndIndex; ++m)
+		{
+			const opengl_mesh& mesh = scene.geometry[m];
+			rangeLods = max(rangeLods, mesh.numberOfLods);
+		}
+		for (uint32 m = first.meshStartIndex; m < first.meshEndIndex; ++m)
+		{
+			const opengl_mesh& mesh = scene.geometry[m];
+			for (uint32 l = 0; l < rangeLods; ++l)
+				rangeErrors[l] = max(rangeErrors[l], mesh.lods[min(l, mesh.numberOfLods - 1)].error);
+		}
+
+		for (uint32 l = 0; l < MAX_MESH_LODS; ++l)
+			numberOfEntitySQTs[l] = 0;
+
+		// in object space like the lod distance, the textures of the range are requested for the closest entity
+		float closestDistance = FLT_MAX;
+
+		uint32 groupEnd = groupStart;
+		for (; groupEnd < numberOfEntities; ++groupEnd)
+		{
+			uint32 entityIndex = entityOrder[groupEnd];
+			const entity& ent = scene.entities[entityIndex];
+			if (ent.meshStartIndex != first.meshStartIndex || ent.meshEndIndex != first.meshEndIndex)
+				break;
+
+			uint32 object = numberOfStaticMeshes + entityIndex;
+			if (builder.objectVisible[object])
 			{
-				glUniform1i(renderer.geometry_hasNormalTexture, 0);
+				// the error is measured in object space, so it grows with the entity's scale
+				const bounding_box& bounds = scene.objectBounds[object];
+				bounding_sphere worldSphere;
+				worldSphere.center = 0.5f * (bounds.minCorner + bounds.maxCorner);
+				worldSphere.radius = 0.5f * length(bounds.maxCorner - bounds.minCorner);
+
+				float distance = getLodDistance(scene.cam, worldSphere) / ent.position.scale;
+				uint32 lod = selectLod(rangeErrors, rangeLods, distance, pixelsPerUnit);
+				entitySQTs[lod][numberOfEntitySQTs[lod]++] = ent.position;
+				closestDistance = min(closestDistance, distance);
 			}
+		}
 
-			if (scene.materials[m].hasSpecularTexture)
+		if (closestDistance != FLT_MAX)
+		{
+			for (uint32 m = first.meshStartIndex; m < first.meshEndIndex; ++m)
 			{
-				glUniform1i(renderer.geometry_hasSpecularTexture, 1);
-
-				glActiveTexture(GL_TEXTURE2);
-				glBindTexture(GL_TEXTURE_2D, scene.materials[m].specularTexture.textureID);
+				const opengl_mesh& mesh = scene.geometry[m];
+				requestTextureLevels(entityWantedTextureLevels, scene.resources, materialOffset + mesh.materialIndex, mesh.uvDensity * closestDistance / pixelsPerUnit);
 			}
-			else
+		}
+
+		for (uint32 l = 0; l < rangeLods; ++l)
+		{
+			uint32 numberOfSQTs = numberOfEntitySQTs[l];
+			if (numberOfSQTs == 0)
+				continue;
+
+			sqtsToMat4s(scene.cam.view, entitySQTs[l], entityMVs, numberOfSQTs);
+
+			for (uint32 m = first.meshStartIndex; m < first.meshEndIndex; ++m)
 			{
-				glUniform1i(renderer.geometry_hasSpecularTexture, 0);
+				const opengl_mesh& mesh = scene.geometry[m];
+				uint32 lod = min(l, mesh.numberOfLods - 1);
+				pushDraw(entityCommands, scene.resources, mesh, lod, entityMVs, numberOfSQTs, materialOffset + mesh.materialIndex);
 			}
+		}
+
+		groupStart = groupEnd;
+	}
+
+	// sorted by program and vertex format, so the render thread only has to copy the commands and walk the batches
+	mergeCommandLists(frame.commands, builder.commandLists.data(), numberOfLists);
+	buildDrawBatches(frame.commands, frame.drawCommands, frame.drawBatches);
+	for (uint32 i = 0; i < MAX_TEXTURE_ARRAYS; ++i)
+	{
+		frame.wantedTextureLevels[i] = UINT32_MAX;
+		for (uint32 l = 0; l < numberOfLists; ++l)
+			frame.wantedTextureLevels[i] = min(frame.wantedTextureLevels[i], builder.wantedTextureLevels[l * MAX_TEXTURE_ARRAYS + i]);
+	}
 
-			glUniform1i(renderer.geometry_emitting, scene.materials[m].emitting ? 1 : 0);
+	// the same for both geometry passes and all permutations
+	geometry_pass_data& pass = frame.geometryPass;
+	pass.proj = scene.cam.proj;
+	pass.numberOfPointLights = (int32)numberOfActiveLights;
+	for (uint32 i = 0; i < numberOfActiveLights; ++i)
+	{
+		const point_light& light = scene.pointLights[activeLights[i]];
+		vec4 posVS = scene.cam.view * vec4(light.position, 1.f);
+		point_light_data& data = pass.pointLights[i];
+		data.position[0] = posVS.x; data.position[1] = posVS.y; data.position[2] = posVS.z;
+		data.radius = light.radius;
+		data.color[0] = light.color.x; data.color[1] = light.color.y; data.color[2] = light.color.z;
+		data.padding = 0.f;
+	}
+}
+
+// copies the frame's draws to the upload ring and applies its texture needs to the streaming state
+static void uploadFrame(opengl_renderer& renderer, const render_frame& frame)
+{
+	uint64 commandsSize = frame.drawCommands.size() * sizeof(draw_elements_indirect_command);
+	renderer.drawCommandUpload = allocateUpload(renderer.uploadRing, commandsSize);
+	if (commandsSize > 0)
+		memcpy(renderer.drawCommandUpload.data, &frame.drawCommands[0], commandsSize);
+
+	uint64 instancesSize = frame.commands.instances.size() * sizeof(draw_instance);
+	renderer.drawInstanceUpload = allocateUpload(renderer.uploadRing, instancesSize);
+	if (instancesSize > 0)
+		memcpy(renderer.drawInstanceUpload.data, &frame.commands.instances[0], instancesSize);
+
+	renderer.geometryPassUpload = uploadUniforms(renderer.uploadRing, &frame.geometryPass, sizeof(frame.geometryPass));
+
+	updateTextureStreaming(frame.scene->resources, frame);
+
+	// after streaming, which may have reallocated arrays
+	if (frame.scene->resources.bindlessTextures)
+		renderer.textureHandleUpload = uploadTextureHandles(renderer.uploadRing, frame.scene->resources);
+}
+
+static void renderGeometry(opengl_renderer& renderer, const render_frame& frame)
+{
+	const opengl_scene_resources& resources = frame.scene->resources;
+	glBindBufferBase(GL_UNIFORM_BUFFER, MATERIAL_BLOCK_BINDING, resources.materialBuffer);
+	glBindBufferRange(GL_UNIFORM_BUFFER, PASS_BLOCK_BINDING, renderer.geometryPassUpload.buffer, renderer.geometryPassUpload.offset, sizeof(geometry_pass_data));
+	if (resources.bindlessTextures)
+	{
+		glBindBufferRange(GL_UNIFORM_BUFFER, TEXTURE_HANDLE_BLOCK_BINDING, renderer.textureHandleUpload.buffer, renderer.textureHandleUpload.offset,
+			MAX_TEXTURE_ARRAYS * sizeof(GLuint64));
+	}
+	else
+	{
+		for (uint32 i = 0; i < resources.numberOfTextureArrays; ++i)
+		{
+			glActiveTexture(GL_TEXTURE0 + i);
+			glBindTexture(GL_TEXTURE_2D_ARRAY, resources.textureArrays[i].textureID);
+		}
+	}
 
-			bindAndDrawMesh(scene.geometry[m]);
+	// permutations are compiled the first time they are needed. all new ones are submitted before waiting for any
+	uint32 newPermutations = 0;
+	for (const draw_batch& batch : frame.drawBatches)
+	{
+		opengl_geometry_permutation& geometry = renderer.geometryPermutations[batch.program];
+		if (!geometry.used)
+		{
+			geometry.used = true;
+			beginGeometryPermutation(renderer, batch.program);
+			newPermutations |= 1 << batch.program;
 		}
 	}
+	for (uint32 p = 0; p < MATERIAL_PERMUTATION_COUNT; ++p)
+	{
+		if ((newPermutations & (1 << p)) && finishShaderLoad(renderer.geometryPermutations[p].shader, renderer.parallelShaderCompile))
+			setupGeometryPermutation(renderer.geometryPermutations[p]);
+	}
 
-#if 0
-	for (point_light& pl : scene.pointLights)
+	// the batches are sorted by program and then vertex format, so state is only set when it changes
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, renderer.drawCommandUpload.buffer);
+	uint32 boundProgram = UINT32_MAX, boundVertexFormat = UINT32_MAX;
+	for (const draw_batch& batch : frame.drawBatches)
 	{
-		vec3 pos = pl.position;
-		mat4 MV = scene.cam.view * createModelMatrix(pos, quat(), 1.f);
-		mat4 MVP = scene.cam.proj * MV;
-		glUniformMatrix4fv(renderer.geometry_MV, 1, GL_FALSE, MV.data);
-		glUniformMatrix4fv(renderer.geometry_MVP, 1, GL_FALSE, MVP.data);
+		opengl_geometry_permutation& geometry = renderer.geometryPermutations[batch.program];
+		if (!geometry.shader.programID)
+			continue;
+
+		if (batch.program != boundProgram)
+		{
+			bindShader(geometry.shader);
+			boundProgram = batch.program;
+		}
+		if (batch.vertexFormat != boundVertexFormat)
+		{
+			glBindVertexArray(resources.pools[batch.vertexFormat].vao);
+			glBindVertexBuffer(1, renderer.drawInstanceUpload.buffer, renderer.drawInstanceUpload.offset, sizeof(draw_instance));
+			boundVertexFormat = batch.vertexFormat;
+		}
 
-		bindAndDrawMesh(renderer.sphere);
+		uint64 offset = renderer.drawCommandUpload.offset + batch.firstCommand * sizeof(draw_elements_indirect_command);
+		glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (void*)offset, batch.numberOfCommands, 0);
 	}
-#endif
+	glBindVertexArray(0);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
+
+static void bindPassData(opengl_renderer& renderer, const void* data, uint64 size)
+{
+	upload_allocation allocation = uploadUniforms(renderer.uploadRing, data, size);
+	glBindBufferRange(GL_UNIFORM_BUFFER, PASS_BLOCK_BINDING, allocation.buffer, allocation.offset, size);
 }
 
-void renderScene(opengl_renderer& renderer, scene_state& scene, uint32 screenWidth, uint32 screenHeight, bool debugRendering)
+void renderScene(opengl_renderer& renderer, const render_frame& frame, uint32 screenWidth, uint32 screenHeight)
 {
 	loadAllShaders(renderer);
 
@@ -1081,30 +2482,24 @@ void renderScene(opengl_renderer& renderer, scene_state& scene, uint32 screenWid
 		initializeFBOs(renderer);
 	}
 
-	if (screenWidth != scene.cam.width || screenHeight != scene.cam.height)
-	{
-		scene.cam.width = screenWidth;
-		scene.cam.height = screenHeight;
-		float aspect = (float)screenWidth / (float)screenHeight;
-		scene.cam.proj = createProjectionMatrix(scene.cam.verticalFOV, aspect, scene.cam.nearPlane, scene.cam.farPlane);
-		scene.cam.toPrevFramePos = scene.cam.proj;
-		std::cout << "resize" << std::endl;
-	}
+	resetArena(renderer.frameArena);
+	beginUploadFrame(renderer.uploadRing);
+	uploadFrame(renderer, frame);
 
 	// front faces
-	bindFramebuffer(renderer.frontFaceBuffer);
+	bindFramebuffer(renderer.frameArena, renderer.frontFaceBuffer);
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-	renderGeometry(renderer, scene);
+	renderGeometry(renderer, frame);
 
 	// back faces
-	bindFramebuffer(renderer.backFaceBuffer);
+	bindFramebuffer(renderer.frameArena, renderer.backFaceBuffer);
 	glClear(GL_DEPTH_BUFFER_BIT);
 	glCullFace(GL_FRONT);
-	renderGeometry(renderer, scene);
+	renderGeometry(renderer, frame);
 	glCullFace(GL_BACK);
 
 	// ssr
-	bindFramebuffer(renderer.reflectionBuffer);
+	bindFramebuffer(renderer.frameArena, renderer.reflectionBuffer);
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
 	opengl_shader& ssrShader = renderer.ssrShader;
@@ -1122,16 +2517,18 @@ void renderScene(opengl_renderer& renderer, scene_state& scene, uint32 screenWid
 	glActiveTexture(GL_TEXTURE5);
 	glBindTexture(GL_TEXTURE_2D, renderer.backFaceBuffer.depthTexture);			// back face depth
 
-	mat4 proj = createScaleMatrix(vec3((float)screenWidth, (float)screenHeight, 1.f)) * createModelMatrix(vec3(0.5f, 0.5f, 0.f), quat(), vec3(0.5f, 0.5f, 1.f)) * scene.cam.proj;
+	mat4 proj = createScaleMatrix(vec3((float)screenWidth, (float)screenHeight, 1.f)) * createModelMatrix(vec3(0.5f, 0.5f, 0.f), quat(), vec3(0.5f, 0.5f, 1.f)) * frame.cam.proj;
 
-	glUniformMatrix4fv(renderer.ssr_proj, 1, GL_FALSE, proj.data);
-	glUniformMatrix4fv(renderer.ssr_toPrevFramePos, 1, GL_FALSE, scene.cam.toPrevFramePos.data);
-
-	glUniform2f(renderer.ssr_clippingPlanes, scene.cam.nearPlane, scene.cam.farPlane);
+	ssr_pass_data ssrPass;
+	ssrPass.proj = proj;
+	ssrPass.toPrevFramePos = frame.cam.toPrevFramePos;
+	ssrPass.clippingPlanes[0] = frame.cam.nearPlane;
+	ssrPass.clippingPlanes[1] = frame.cam.farPlane;
+	bindPassData(renderer, &ssrPass, sizeof(ssrPass));
 
 	bindAndDrawMesh(renderer.plane);
 
-	if (debugRendering)
+	if (frame.debugRendering)
 	{
 		blitFrameBufferToScreen(renderer.frontFaceBuffer, 2, 0, screenHeight / 2, screenWidth / 2, screenHeight);			 // top left: image without reflections
 		blitFrameBufferToScreen(renderer.reflectionBuffer, 0, screenWidth / 2, screenHeight / 2, screenWidth, screenHeight); // top right: reflection buffer
@@ -1139,23 +2536,25 @@ void renderScene(opengl_renderer& renderer, scene_state& scene, uint32 screenWid
 	}
 
 	// blur reflection buffer
-	bindFramebuffer(renderer.tmpBuffer);
+	bindFramebuffer(renderer.frameArena, renderer.tmpBuffer);
 	glClear(GL_COLOR_BUFFER_BIT);
 	opengl_shader& blurShader = renderer.blurShader;
 	bindShader(blurShader);
-	glUniform2f(renderer.blur_blurDirection, 1, 0); // blur horizontally
+	blur_pass_data blurPass = { { 1.f, 0.f } }; // blur horizontally
+	bindPassData(renderer, &blurPass, sizeof(blurPass));
 	glActiveTexture(GL_TEXTURE0);
 	glBindTexture(GL_TEXTURE_2D, renderer.reflectionBuffer.colorTextures[0]);
 	bindAndDrawMesh(renderer.plane);
-	bindFramebuffer(renderer.reflectionBuffer);
+	bindFramebuffer(renderer.frameArena, renderer.reflectionBuffer);
 	glClear(GL_COLOR_BUFFER_BIT);
 	glActiveTexture(GL_TEXTURE0);
 	glBindTexture(GL_TEXTURE_2D, renderer.tmpBuffer.colorTextures[0]);
-	glUniform2f(renderer.blur_blurDirection, 0, 1); // blur vertically
+	blurPass = { { 0.f, 1.f } }; // blur vertically
+	bindPassData(renderer, &blurPass, sizeof(blurPass));
 	bindAndDrawMesh(renderer.plane);
 
 	// bring it together - save for next frame
-	bindFramebuffer(renderer.lastFrameBuffer);
+	bindFramebuffer(renderer.frameArena, renderer.lastFrameBuffer);
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
 	opengl_shader& resultShader = renderer.resultShader;
@@ -1168,7 +2567,7 @@ void renderScene(opengl_renderer& renderer, scene_state& scene, uint32 screenWid
 	bindAndDrawMesh(renderer.plane);
 
 	// blit to screen
-	if (debugRendering)
+	if (frame.debugRendering)
 	{
 		// this is the blurred version
 		blitFrameBufferToScreen(renderer.reflectionBuffer, 0, screenWidth / 2, 0, screenWidth, screenHeight / 2);
@@ -1178,15 +2577,29 @@ void renderScene(opengl_renderer& renderer, scene_state& scene, uint32 screenWid
 		blitFrameBufferToScreen(renderer.lastFrameBuffer, 0, screenWidth, screenHeight);
 	}
 
+	endUploadFrame(renderer.uploadRing);
 }
 
 void cleanupRenderer(opengl_renderer& renderer)
 {
 	for (uint32 i = 0; i < SHADER_COUNT; ++i)
+	{
+		discardPendingShader(renderer.shaders[i]);
 		deleteShader(renderer.shaders[i]);
+	}
+	for (uint32 i = 0; i < MATERIAL_PERMUTATION_COUNT; ++i)
+	{
+		discardPendingShader(renderer.geometryPermutations[i].shader);
+		if (renderer.geometryPermutations[i].shader.programID)
+			deleteShader(renderer.geometryPermutations[i].shader);
+	}
 	deleteFBO(renderer.frontFaceBuffer);
 	deleteFBO(renderer.backFaceBuffer);
 	deleteFBO(renderer.lastFrameBuffer);
 	deleteFBO(renderer.reflectionBuffer);
 	deleteFBO(renderer.tmpBuffer);
+
+	std::cout << "most bytes uploaded in a frame: " << renderer.uploadRing.peakUploadedBytes << std::endl;
+	deleteUploadRing(renderer.uploadRing);
+	deleteArena(renderer.frameArena);
 }
@@ -2,7 +2,19 @@
 
 #include "common.h"
 #include "math.h"
+#include "culling.h"
+#include "mesh_lod.h"
+#include "mesh_optimizer.h"
+#include "texture_compression.h"
+#include "texture_streaming.h"
+#include "shader_preprocessor.h"
+#include "upload_ring.h"
+#include "staging_buffer.h"
+#include "job_system.h"
+#include "command_list.h"
+#include "memory_arena.h"
 #include <vector>
+#include <unordered_map>
 
 #include <glew/glew.h>
 #include <gl/GL.h>
@@ -14,12 +26,70 @@ struct opengl_shader
 	GLuint fs_ID;
 	GLuint programID;
 
-	uint64 writeTime;
+	// of the expanded sources, a stage is only recompiled if its hash changed
+	uint64 vsHash;
+	uint64 fsHash;
+
+	// submitted to the driver, but maybe not compiled yet. replaces the ids above once it linked
+	GLuint pendingProgramID;
+	GLuint pendingVS_ID, pendingFS_ID;
+	uint64 pendingVSHash, pendingFSHash;
+
+	const char* filename;
 };
 
+// a layer in one of the scene's texture arrays
 struct opengl_texture
+{
+	uint32 arrayIndex;
+	uint32 layer;
+};
+
+#define MAX_TEXTURE_ARRAYS 8
+
+// all textures of the same size and format share one array, so materials can be switched without rebinding.
+// the levels above the tail are streamed in on demand. the gl texture only has the resident levels, its level 0 is
+// residentLevel, so shaders do not need to know about streaming
+struct opengl_texture_array
+{
+	GLuint textureID = 0;
+	uint32 width, height;
+	texture_format format;
+	uint32 numberOfLevels;
+
+	uint32 tailLevel;					// this and all smaller levels are always resident
+	uint32 residentLevel;				// finest resident level
+	uint32 wantedLevel;					// finest level any draw of the current frame needs
+	uint64 lastUsedFrame;
+	bool streaming;						// a request for the next finer level is in flight
+	GLuint64 handle = 0;				// bindless handle, resident as long as the texture exists
+	std::vector<std::string> layerFiles;	// ktx file of every layer, the levels are streamed from there
+
+	std::vector<compressed_texture> pendingLayers; // the resident levels, until the array is uploaded
+};
+
+// a texture the gpu may still sample through its handle, deleted once the fence of the frame it was retired in passed
+struct retired_texture_array
 {
 	GLuint textureID;
+	GLuint64 handle;
+	GLsync fence;
+};
+
+enum vertex_format
+{
+	VERTEX_FORMAT_PTN,	// position, texCoords, normal
+	VERTEX_FORMAT_PTNT,	// position, texCoords, normal, tangent
+
+	VERTEX_FORMAT_COUNT,
+};
+
+// index range of one level of detail, all levels share the vertices of the mesh
+struct opengl_mesh_lod
+{
+	uint32 firstIndex;
+	uint32 indexCount;
+	float error;
 };
 
 struct opengl_mesh
@@ -28,6 +98,82 @@ struct opengl_mesh
 	GLuint vbo;
 	GLuint ibo;
 	uint32 indexCount;
+
+	// only used for meshes which live in a geometry pool
+	uint32 firstIndex;
+	int32 baseVertex;
+	vertex_format format;
+	uint32 materialIndex;
+
+	// object space, for static geometry this is world space
+	bounding_box bounds;
+	bounding_sphere boundingSphere;
+
+	// level 0 is firstIndex and indexCount
+	opengl_mesh_lod lods[MAX_MESH_LODS];
+	uint32 numberOfLods;
+
+	// undo the vertex quantization of the pool. identity if vertices are stored as floats
+	mat4 dequantization;
+	vec4 texCoordTransform; // xy: offset, zw: scale
+
+	// average texture coordinate units per object space unit, to estimate the texel size on screen for streaming
+	float uvDensity;
+};
+
+// pools store unorm16 positions and texture coordinates and octahedral snorm16 normals and tangents instead of floats.
+// this halves the vertex fetch bandwidth, which is paid twice per frame because of the back face pass
+#define QUANTIZE_VERTICES 1
+
+// static meshes larger than this are split into chunks, so they can be culled piece by piece
+#define STATIC_GEOMETRY_CHUNK_SIZE 16.f
+#define MAX_CHUNKS_PER_AXIS 32
+
+// all meshes with the same vertex format share one vertex and index buffer, so they can be drawn with one indirect call
+struct opengl_geometry_pool
+{
+	GLuint vao = 0;
+	GLuint vbo = 0;
+	GLuint ibo = 0;
+
+	uint32 vertexSize = 0;
+	uint32 vertexCount = 0;
+	uint32 indexCount = 0;
+
+	// cpu side data, until the pool is uploaded
+	std::vector<uint8> vertexData;
+	std::vector<uint32> indexData;
+};
+
+// initial size of the arena the loaders keep the meshes of a model on, until they are appended to the pools
+#define LOAD_ARENA_SIZE (16 << 20)
+
+struct opengl_scene_resources
+{
+	job_system* jobSystem = 0;	// the loaders spread their work over it
+	memory_arena loadArena;		// reset after every model, deleted once the resources are finished
+
+	opengl_geometry_pool pools[VERTEX_FORMAT_COUNT];
+
+	opengl_texture_array textureArrays[MAX_TEXTURE_ARRAYS];
+	uint32 numberOfTextureArrays = 0;
+	std::vector<retired_texture_array> retiredTextureArrays;	// replaced by a reallocation, frames in flight may still use them
+	std::unordered_map<std::string, opengl_texture> loadedTextures;
+
+	texture_streamer textureStreamer;
+	uint64 textureBudget = TEXTURE_STREAMING_BUDGET;
+	uint64 streamingFrame = 1;			// arrays which were never drawn have a use stamp of 0
+	std::vector<texture_stream_request*> finishedTextureRequests;
+	opengl_staging_buffer textureStaging;	// the streaming workers write the levels they read straight into it
+	std::vector<int32> materialTextureArrays; // diffuse, normal and specular array index of every material, or -1
+
+	GLuint materialBuffer = 0;
+	std::vector<uint8> materialPermutations; // feature mask of each material in the material buffer
+
+	// with ARB_bindless_texture the shaders read the handles of the arrays from a uniform block, instead of every array
+	// being bound to its own texture unit. the handles change when an array is reallocated, so every frame writes its
+	// own copy to the upload ring
+	bool bindlessTextures = false;
 };
 
 struct opengl_fbo
@@ -85,11 +231,70 @@ struct material
 };
 
 #define MAX_POINT_LIGHTS 11
+#define MAX_MATERIALS 128
+
+// material features which are compiled into the geometry shader instead of being branched on per fragment
+enum material_feature
+{
+	MATERIAL_DIFFUSE_TEXTURE	= (1 << 0),
+	MATERIAL_NORMAL_TEXTURE		= (1 << 1),
+	MATERIAL_SPECULAR_TEXTURE	= (1 << 2),
+	MATERIAL_EMITTING			= (1 << 3),
+};
+
+#define MATERIAL_PERMUTATION_COUNT 16
+
+// layout of the material uniform block (std140)
+struct material_data
+{
+	float ambient[4];
+	float diffuse[4];
+	float specular[4];		// w: shininess
+	int32 textureArrays[4];	// diffuse, normal, specular array index or -1, w: emitting
+	float textureLayers[4];	// diffuse, normal, specular layer
+};
+
+#define MATERIAL_BLOCK_BINDING 0
+#define TEXTURE_HANDLE_BLOCK_BINDING 1
+#define PASS_BLOCK_BINDING 2 // constants of the current pass, bound as a range of the upload ring
+
+// layouts of the per pass uniform blocks (std140)
+struct point_light_data
+{
+	float position[3];	// view space
+	float radius;
+	float color[3];
+	float padding;
+};
 
+struct geometry_pass_data
+{
+	mat4 proj;
+	point_light_data pointLights[MAX_POINT_LIGHTS];
+	int32 numberOfPointLights;
+};
+
+struct ssr_pass_data
+{
+	mat4 proj;				// eye space to screen coordinates
+	mat4 toPrevFramePos;
+	float clippingPlanes[2];
+};
+
+struct blur_pass_data
+{
+	float blurDirection[2];
+};
+
+// the geometry shader compiled for one combination of material features
+struct opengl_geometry_permutation
+{
+	opengl_shader shader;
+	bool used; // permutations are compiled the first time a material needs them
+};
 
 enum shader_type
 {
-	SHADER_GEOMETRY,
 	SHADER_SSR,
 	SHADER_BLUR,
 	SHADER_RESULT,
@@ -97,6 +302,9 @@ enum shader_type
 	SHADER_COUNT,
 };
 
+// initial size of the frame arenas of the render and the update thread, they grow to the largest frame so far
+#define FRAME_ARENA_SIZE (1 << 20)
+
 struct opengl_renderer
 {
 	uint32 width, height;
@@ -114,7 +322,6 @@ struct opengl_renderer
 	{
 		struct
 		{
-			opengl_shader geometryShader;
 			opengl_shader ssrShader;
 			opengl_shader blurShader;
 			opengl_shader resultShader;
@@ -123,24 +330,74 @@ struct opengl_renderer
 		opengl_shader shaders[SHADER_COUNT];
 	};
 
-	// shader uniforms
-	GLuint geometry_MVP, geometry_MV, geometry_ambient, geometry_diffuse, geometry_specular, geometry_shininess, geometry_emitting;
-	GLuint geometry_hasDiffuseTexture, geometry_hasNormalTexture, geometry_hasSpecularTexture;
+	shader_preprocessor shaderPreprocessor;
+	bool parallelShaderCompile;
+	bool bindlessTextures;
+	opengl_geometry_permutation geometryPermutations[MATERIAL_PERMUTATION_COUNT];
 
-	GLuint geometry_numberOfPointLights, geometry_pl_position[MAX_POINT_LIGHTS], geometry_pl_color[MAX_POINT_LIGHTS], geometry_pl_radius[MAX_POINT_LIGHTS];
+	// all per frame data is written to the upload ring and bound by offset
+	opengl_upload_ring uploadRing;
 
-	GLuint ssr_proj, ssr_toPrevFramePos, ssr_clippingPlanes;
+	// indirect geometry submission of the frame being rendered
+	upload_allocation drawCommandUpload;
+	upload_allocation drawInstanceUpload;
+	upload_allocation geometryPassUpload;
+	upload_allocation textureHandleUpload;
 
-	GLuint blur_blurDirection;
+	// transient data of the frame being rendered, reset when the next one starts
+	memory_arena frameArena;
+};
+
+// everything the render thread needs to submit one frame. frames are built on the update thread while the render
+// thread submits the previous one, so the scene can change without affecting the frame in flight
+struct render_frame
+{
+	struct scene_state* scene;	// only for its gpu resources, which the update thread does not touch
+	camera cam;
+	bool debugRendering;
+
+	// draws of both geometry passes. the program of a draw is its material permutation
+	command_list commands;
+	std::vector<draw_elements_indirect_command> drawCommands;
+	std::vector<draw_batch> drawBatches;
+	geometry_pass_data geometryPass;
+
+	// finest level of every texture array the draws need, UINT32_MAX if the array is not drawn
+	uint32 wantedTextureLevels[MAX_TEXTURE_ARRAYS];
+};
+
+// scratch for building frames, owned by the update thread. everything which only lives for one frame is on the frame
+// arena, the command lists keep their memory from frame to frame
+struct frame_builder
+{
+	memory_arena frameArena;
+
+	// one per job recording draws, merged into the frame afterwards. the finest level of every texture array the
+	// draws of a list need is at wantedTextureLevels[list * MAX_TEXTURE_ARRAYS + array]
+	std::vector<command_list> commandLists;
+	uint32* wantedTextureLevels = 0;
+
+	// culling
+	uint32* visibleObjects = 0;
+	uint8* objectVisible = 0;
+	uint32* lightObjects = 0;
 };
 
 void initializeRenderer(opengl_renderer& renderer, uint32 screenWidth, uint32 screenHeight);
-void renderScene(opengl_renderer& renderer, struct scene_state& scene, uint32 screenWidth, uint32 screenHeight, bool debugRendering = false);
+// culls the scene and builds its draws. only reads the scene, apart from adapting the camera to the screen size
+void buildFrame(render_frame& frame, frame_builder& builder, struct scene_state& scene, uint32 screenWidth, uint32 screenHeight, bool debugRendering = false);
+
+// the gl side of a frame, on the thread owning the context
+void renderScene(opengl_renderer& renderer, const render_frame& frame, uint32 screenWidth, uint32 screenHeight);
 void cleanupRenderer(opengl_renderer& renderer);
 
-bool loadStaticGeometry(std::vector<opengl_mesh>& meshes, std::vector<material>& materials, const std::string& filename);
-bool loadMesh(opengl_mesh& mesh, const std::string& filename);
-std::pair<uint32, uint32> loadMesh(std::vector<opengl_mesh>& meshes, std::vector<material>& materials, const std::string& filename);
+bool loadStaticGeometry(opengl_scene_resources& resources, std::vector<opengl_mesh>& meshes, std::vector<material>& materials, const std::string& filename);
+// the arena only holds the vertices until they are uploaded
+bool loadMesh(memory_arena& arena, opengl_mesh& mesh, const std::string& filename);
+std::pair<uint32, uint32> loadMesh(opengl_scene_resources& resources, std::vector<opengl_mesh>& meshes, std::vector<material>& materials, const std::string& filename);
+
+// uploads everything the loaders collected. materials of static geometry come first in the material buffer
+void finishSceneResources(opengl_scene_resources& resources, const std::vector<material>& staticGeometryMaterials, const std::vector<material>& materials);
+void deleteSceneResources(opengl_scene_resources& resources);
 
 void deleteMesh(opengl_mesh& mesh);
-void deleteTexture(opengl_texture& texture);
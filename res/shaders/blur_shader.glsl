@@ -18,7 +18,10 @@ void main()
 in vec2 texCoords;
 
 uniform sampler2D inputTexture;
-uniform vec2 blurDirection; // [1, 0] or [0, 1]
+layout (std140) uniform blur_pass_block
+{
+	vec2 blurDirection; // [1, 0] or [0, 1]
+};
 
 const float gauss5Weights[5] = 
 {
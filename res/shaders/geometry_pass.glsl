@@ -0,0 +1,16 @@
+struct point_light
+{
+	vec3 position;	// view space
+	float radius;
+	vec3 color;
+};
+
+#define MAX_POINT_LIGHTS 11
+
+// written to the upload ring once per frame, shared by both geometry passes
+layout (std140) uniform geometry_pass_block
+{
+	mat4 proj;
+	point_light pointLights[MAX_POINT_LIGHTS];
+	int numberOfPointLights;
+};
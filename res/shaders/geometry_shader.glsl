@@ -1,83 +1,108 @@
 ##GL_VERTEX_SHADER
 #version 330
 
+// material features are compiled in, see loadGeometryPermutation: HAS_DIFFUSE_TEXTURE, HAS_NORMAL_TEXTURE,
+// HAS_SPECULAR_TEXTURE, EMITTING. QUANTIZED_VERTICES is set if the pools store compressed vertices
+
+#include "material.glsl"
+#include "geometry_pass.glsl"
+
 layout (location = 0) in vec3 in_position;
 layout (location = 1) in vec2 in_texCoords;
+#ifdef QUANTIZED_VERTICES
+layout (location = 2) in vec2 in_normal;	// octahedral
+layout (location = 3) in vec2 in_tangent;
+#else
 layout (location = 2) in vec3 in_normal;
 layout (location = 3) in vec3 in_tangent;
+#endif
 
-uniform mat4 MV;
-uniform mat4 MVP;
-
-uniform int hasNormalTexture;
+// per draw, selected by the base instance of the indirect command. MV includes the position dequantization
+layout (location = 4) in mat4 in_MV;
+layout (location = 8) in uint in_materialIndex;
+layout (location = 9) in vec4 in_texCoordTransform;	// xy: offset, zw: scale
 
 out vec3 position;
 
 out vec3 normal;
+#ifdef HAS_NORMAL_TEXTURE
 out vec3 tangent;
 out vec3 bitangent;
+#endif
 
 out vec2 texCoords;
 
+flat out uint materialIndex;
+
+
+#ifdef QUANTIZED_VERTICES
+vec3 decodeOctahedral(vec2 e)
+{
+	vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	float t = max(-n.z, 0.0);
+	n.x += (n.x >= 0.0) ? -t : t;
+	n.y += (n.y >= 0.0) ? -t : t;
+	return n;
+}
+#define decodeDirection(v) decodeOctahedral(v)
+#else
+#define decodeDirection(v) (v)
+#endif
 
 void main()
 {
-	vec4 pos = vec4(in_position, 1.0);
+	vec4 pos = in_MV * vec4(in_position, 1.0);
 
-	position = (MV * pos).xyz;
-	texCoords = in_texCoords;
+	position = pos.xyz;
+	texCoords = in_texCoordTransform.xy + in_texCoords * in_texCoordTransform.zw;
 
-	normal = normalize((MV * vec4(in_normal, 0.0)).xyz);
+	normal = normalize((in_MV * vec4(decodeDirection(in_normal), 0.0)).xyz);
 
-	if (hasNormalTexture == 1)
-	{
-		tangent = normalize((MV * vec4(in_tangent, 0.f)).xyz);
-		bitangent = cross(tangent, normal);
-	}
+#ifdef HAS_NORMAL_TEXTURE
+	tangent = normalize((in_MV * vec4(decodeDirection(in_tangent), 0.f)).xyz);
+	bitangent = cross(tangent, normal);
+#endif
 
-	gl_Position = MVP * pos;
+	materialIndex = in_materialIndex;
+
+	gl_Position = proj * pos;
 }
 
 
 
 ##GL_FRAGMENT_SHADER
-#version 330
+#version 400
+
+#ifdef BINDLESS_TEXTURES
+#extension GL_ARB_bindless_texture : require
+#endif
+
+#include "material.glsl"
+#include "geometry_pass.glsl"
 
 in vec3 position;
 
 in vec3 normal;
+#ifdef HAS_NORMAL_TEXTURE
 in vec3 tangent;
 in vec3 bitangent;
+#endif
 
 in vec2 texCoords;
 
-// material properties
-uniform vec3 ambient;
-uniform vec3 diffuse;
-uniform vec3 specular;
-uniform float shininess;
-uniform int emitting;
-
-uniform int hasDiffuseTexture;
-uniform sampler2D diffuseTexture;
+flat in uint materialIndex;
 
-uniform int hasNormalTexture;
-uniform sampler2D normalTexture;
+#define MAX_TEXTURE_ARRAYS 8
 
-uniform int hasSpecularTexture;
-uniform sampler2D specularTexture;
-
-struct point_light
+#ifdef BINDLESS_TEXTURES
+// two 64 bit handles per entry
+layout (std140) uniform texture_handle_block
 {
-	vec3 position;
-	vec3 color;
-	float radius;
+	uvec4 textureHandles[MAX_TEXTURE_ARRAYS / 2];
 };
-
-#define MAX_POINT_LIGHTS 11
-
-uniform point_light pointLights[MAX_POINT_LIGHTS];
-uniform int numberOfPointLights;
+#else
+uniform sampler2DArray textureArrays[MAX_TEXTURE_ARRAYS];
+#endif
 
 layout (location = 0) out vec3 out_position;
 layout (location = 1) out vec3 out_normal;
@@ -85,34 +110,63 @@ layout (location = 2) out vec3 out_color;
 layout (location = 3) out float out_shininess;
 
 
+vec4 sampleTexture(int arrayIndex, float layer)
+{
+	vec3 coords = vec3(texCoords, layer);
+#ifdef BINDLESS_TEXTURES
+	// the material is the same for all fragments of a draw, so the handle is too
+	uvec4 handles = textureHandles[arrayIndex >> 1];
+	return texture(sampler2DArray((arrayIndex & 1) != 0 ? handles.zw : handles.xy), coords);
+#else
+	// the material index is not dynamically uniform across the draws of a multi draw, so the sampler array is only
+	// indexed with constants
+	if (arrayIndex == 0) return texture(textureArrays[0], coords);
+	if (arrayIndex == 1) return texture(textureArrays[1], coords);
+	if (arrayIndex == 2) return texture(textureArrays[2], coords);
+	if (arrayIndex == 3) return texture(textureArrays[3], coords);
+	if (arrayIndex == 4) return texture(textureArrays[4], coords);
+	if (arrayIndex == 5) return texture(textureArrays[5], coords);
+	if (arrayIndex == 6) return texture(textureArrays[6], coords);
+	return texture(textureArrays[7], coords);
+#endif
+}
+
 void main()
 {
+	material_data mat = materials[materialIndex];
+
+	vec3 ambient = mat.ambient.xyz;
+	vec3 diffuse = mat.diffuse.xyz;
+	vec3 specular = mat.specular.xyz;
+	float shininess = mat.specular.w;
+
 	vec3 N = normalize(normal);
 
-	if (hasNormalTexture == 1)
-	{
-		mat3 TBN = mat3(
-			normalize(tangent),
-			normalize(bitangent),
-			N
-		);
-		
-		N = normalize(TBN * normalize(texture2D(normalTexture, texCoords).xyz * 2.0 - vec3(1.0)));
-	}
+#ifdef HAS_NORMAL_TEXTURE
+	mat3 TBN = mat3(
+		normalize(tangent),
+		normalize(bitangent),
+		N
+	);
+	
+	// normal maps are stored as bc5 with x and y only
+	vec2 tangentNormalXY = sampleTexture(mat.textureArrays.y, mat.textureLayers.y).xy * 2.0 - vec2(1.0);
+	vec3 tangentNormal = vec3(tangentNormalXY, sqrt(max(1.0 - dot(tangentNormalXY, tangentNormalXY), 0.0)));
+	N = normalize(TBN * tangentNormal);
+#endif
 
 	vec3 ambientColor = vec3(0.0);
 	vec3 diffuseColor = vec3(0.0);
 	vec3 specularColor = vec3(0.0);
 	
 	vec3 diffuseTexColor = diffuse;
-	if (hasDiffuseTexture == 1)
-		diffuseTexColor *= texture2D(diffuseTexture, texCoords).rgb;
+#ifdef HAS_DIFFUSE_TEXTURE
+	diffuseTexColor *= sampleTexture(mat.textureArrays.x, mat.textureLayers.x).rgb;
+#endif
 		
-	if (emitting == 1)
-	{
-		diffuseColor = diffuseTexColor; // hack for street lantern
-	}
-	else
+#ifdef EMITTING
+	diffuseColor = diffuseTexColor; // hack for street lantern
+#else
 	{
 		vec3 E = normalize(-position);
 		for (int i = 0; i < min(MAX_POINT_LIGHTS, numberOfPointLights); ++i)
@@ -135,11 +189,16 @@ void main()
 			specularColor += specularFactor * pointLights[i].color * attenuation;
 		}
 	}
+#endif
 	
 	out_position.xyz = position;
 	out_normal.xyz = N;
 	out_color = diffuseColor + ambientColor + specularColor;
 	//out_color = diffuseColor;
 
-	out_shininess = (hasSpecularTexture == 1) ? texture2D(specularTexture, texCoords).x : 0.8; // what should be default?
+#ifdef HAS_SPECULAR_TEXTURE
+	out_shininess = sampleTexture(mat.textureArrays.z, mat.textureLayers.z).x;
+#else
+	out_shininess = 0.8; // what should be default?
+#endif
 }
@@ -0,0 +1,15 @@
+struct material_data
+{
+	vec4 ambient;
+	vec4 diffuse;
+	vec4 specular;			// w: shininess
+	ivec4 textureArrays;	// diffuse, normal, specular array index or -1, w: emitting
+	vec4 textureLayers;		// diffuse, normal, specular layer
+};
+
+#define MAX_MATERIALS 128
+
+layout (std140) uniform material_block
+{
+	material_data materials[MAX_MATERIALS];
+};
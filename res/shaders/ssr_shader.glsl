@@ -28,10 +28,13 @@ uniform sampler2D shininessTexture;
 uniform sampler2D depthTexture;
 uniform sampler2D backfaceDepthTexture;
 
-uniform mat4 proj;		// eye space to screen coordinates (NOT NDC)
-uniform mat4 toPrevFramePos; // pixel pos from last frame
+layout (std140) uniform ssr_pass_block
+{
+	mat4 proj;		// eye space to screen coordinates (NOT NDC)
+	mat4 toPrevFramePos; // pixel pos from last frame
 
-uniform vec2 clippingPlanes;
+	vec2 clippingPlanes;
+};
 
 layout (location = 0) out vec4 out_reflectedColor;
 
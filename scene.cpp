@@ -4,12 +4,36 @@
 
 
 
-void initializeScene(scene_state& scene, scene_name name, uint32 screenWidth, uint32 screenHeight)
+static void updateEntityBounds(scene_state& scene)
 {
+	uint32 offset = (uint32)scene.staticGeometry.size();
+	for (uint32 i = 0; i < scene.entities.size(); ++i)
+	{
+		const entity& ent = scene.entities[i];
+		if (ent.meshStartIndex == ent.meshEndIndex)
+		{
+			scene.objectBounds[offset + i].minCorner = ent.position.position;
+			scene.objectBounds[offset + i].maxCorner = ent.position.position;
+			continue;
+		}
+
+		bounding_sphere bounds = scene.geometry[ent.meshStartIndex].boundingSphere;
+		for (uint32 m = ent.meshStartIndex + 1; m < ent.meshEndIndex; ++m)
+			bounds = mergeBoundingSpheres(bounds, scene.geometry[m].boundingSphere);
+
+		scene.objectBounds[offset + i] = sphereToBoundingBox(transformBoundingSphere(bounds, ent.position));
+	}
+}
+
+void initializeScene(scene_state& scene, scene_name name, uint32 screenWidth, uint32 screenHeight, job_system& jobSystem)
+{
+	scene.resources.jobSystem = &jobSystem;
+	createArena(scene.resources.loadArena, LOAD_ARENA_SIZE);
+
 	// meshes
 	if (name == SCENE_HALLWAY)
 	{
-		loadStaticGeometry(scene.staticGeometry, scene.staticGeometryMaterials, "hallway/space_station_interior.obj");
+		loadStaticGeometry(scene.resources, scene.staticGeometry, scene.staticGeometryMaterials, "hallway/space_station_interior.obj");
 	
 		float lightHeight = 7.5f;
 		float radius = 15.f;
@@ -24,9 +48,9 @@ void initializeScene(scene_state& scene, scene_name name, uint32 screenWidth, ui
 	}
 	else if (name == SCENE_STREET)
 	{
-		loadStaticGeometry(scene.staticGeometry, scene.staticGeometryMaterials, "street/street.obj");
+		loadStaticGeometry(scene.resources, scene.staticGeometry, scene.staticGeometryMaterials, "street/street.obj");
 
-		std::pair<uint32, uint32> lampIndices = loadMesh(scene.geometry, scene.materials, "street/lamp.obj");
+		std::pair<uint32, uint32> lampIndices = loadMesh(scene.resources, scene.geometry, scene.materials, "street/lamp.obj");
 		float lightHeight = 5.f;
 		float radius = 30.f;
 		vec3 color(0.7f, 0.53f, 0.36f);
@@ -50,11 +74,23 @@ void initializeScene(scene_state& scene, scene_name name, uint32 screenWidth, ui
 		scene.pointLights.push_back(point_light(vec3(-40.f, lightHeight, -1.f), radius, color));
 
 
-		std::pair<uint32, uint32> wallLampIndices = loadMesh(scene.geometry, scene.materials, "street/wall_lamp.obj");
+		std::pair<uint32, uint32> wallLampIndices = loadMesh(scene.resources, scene.geometry, scene.materials, "street/wall_lamp.obj");
 		scene.entities.push_back(entity(wallLampIndices.first, wallLampIndices.second, SQT(vec3(-28.5f, 6.f, 17.6f), quat(vec3(0.f, 1.f, 0.f), degreesToRadians(180.f)), 5.f)));
 
 	}
 
+	finishSceneResources(scene.resources, scene.staticGeometryMaterials, scene.materials);
+
+	// bounding volume hierarchy
+	{
+		for (const opengl_mesh& mesh : scene.staticGeometry)
+			scene.objectBounds.push_back(mesh.bounds);
+		scene.objectBounds.resize(scene.staticGeometry.size() + scene.entities.size());
+		updateEntityBounds(scene);
+
+		buildBVH(scene.objectBVH, scene.objectBounds.data(), (uint32)scene.objectBounds.size());
+	}
+
 	// camera
 	{
 		scene.cam.nearPlane = 0.1f;
@@ -76,9 +112,6 @@ void updateScene(scene_state& scene, raw_input& input, float dt)
 {
 	mat4 prevView = scene.cam.view;
 
-	if (buttonDownEvent(input, KB_ESC))
-		exit(0);
-
 	const float movementSpeed = 10.f;
 	const float rotationSpeed = 2.f;
 
@@ -98,26 +131,17 @@ void updateScene(scene_state& scene, raw_input& input, float dt)
 	scene.cam.position += (rotation * positionChange) * movementSpeed * dt;
 
 	scene.cam.view = createViewMatrix(scene.cam.position, scene.cam.pitch, scene.cam.yaw);
-	scene.cam.toPrevFramePos = scene.cam.proj * prevView * inverted(scene.cam.view); // I think this only works with non-moving geometry!
+	scene.cam.toPrevFramePos = scene.cam.proj * prevView * invertedAffine(scene.cam.view); // I think this only works with non-moving geometry!
+
+	// entities may have moved. refitting keeps the tree valid, a rebuild is only needed if objects were added or removed
+	updateEntityBounds(scene);
+	refitBVH(scene.objectBVH, scene.objectBounds.data());
 
 	//std::cout << scene.cam.position << std::endl;
 }
 
 void cleanupScene(scene_state& scene)
 {
-	for (opengl_mesh& mesh : scene.staticGeometry)
-		deleteMesh(mesh);
-	for (material& mat : scene.staticGeometryMaterials)
-	{
-		deleteTexture(mat.diffuseTexture);
-		deleteTexture(mat.normalTexture);
-	}
-
-	for (opengl_mesh& mesh : scene.geometry)
-		deleteMesh(mesh);
-	for (material& mat : scene.materials)
-	{
-		deleteTexture(mat.diffuseTexture);
-		deleteTexture(mat.normalTexture);
-	}
+	// meshes and textures live in the shared scene resources
+	deleteSceneResources(scene.resources);
 }
\ No newline at end of file
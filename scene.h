@@ -3,6 +3,7 @@
 #include "math.h"
 #include "common.h"
 #include "renderer.h"
+#include "bvh.h"
 
 #include <vector>
 
@@ -28,6 +29,8 @@ struct scene_state
 {
 	camera cam;
 
+	opengl_scene_resources resources;
+
 	std::vector<opengl_mesh> staticGeometry;
 	std::vector<material> staticGeometryMaterials;
 
@@ -35,10 +38,14 @@ struct scene_state
 	std::vector<material> materials;
 	std::vector<entity> entities;
 
+	// world space bounds of all static meshes followed by all entities
+	std::vector<bounding_box> objectBounds;
+	bvh objectBVH;
+
 	std::vector<point_light> pointLights;
 };
 
 
-void initializeScene(scene_state& scene, scene_name name, uint32 screenWidth, uint32 screenHeight);
+void initializeScene(scene_state& scene, scene_name name, uint32 screenWidth, uint32 screenHeight, job_system& jobSystem);
 void updateScene(scene_state& scene, raw_input& input, float dt);
 void cleanupScene(scene_state& scene);
\ No newline at end of file
@@ -0,0 +1,372 @@
+#include "shader_preprocessor.h"
+
+#include <cstring>
+
+
+static const char* stageMarkers[SHADER_STAGE_COUNT] =
+{
+	"##GL_VERTEX_SHADER",
+	"##GL_GEOMETRY_SHADER",
+	"##GL_FRAGMENT_SHADER",
+};
+
+static bool startsWith(const char* text, const char* end, const char* prefix)
+{
+	size_t length = strlen(prefix);
+	return (size_t)(end - text) >= length && memcmp(text, prefix, length) == 0;
+}
+
+static void readShaderFile(shader_file& file)
+{
+	file.writeTime = getFileWriteTime(file.filepath.c_str());
+
+	input_file input = readFile(file.filepath.c_str());
+	file.valid = input.contents != 0;
+	file.contents.assign((const char*)input.contents, (size_t)input.size);
+	freeFile(input);
+
+	file.contentHash = hashBytes(file.contents.data(), file.contents.size());
+
+	if (!file.valid)
+		std::cerr << "shader file " << file.filepath << " could not be read" << std::endl;
+}
+
+// finds all directives. included files are registered afterwards, because that can grow the file array
+static void parseShaderFile(shader_preprocessor& preprocessor, uint32 fileIndex)
+{
+	std::vector<std::string> includeNames;
+	{
+		shader_file& file = preprocessor.files[fileIndex];
+		file.directives.clear();
+
+		const char* text = file.contents.data();
+		const char* end = text + file.contents.size();
+		const char* line = text;
+		while (line < end)
+		{
+			const char* lineEnd = (const char*)memchr(line, '\n', end - line);
+			lineEnd = lineEnd ? lineEnd + 1 : end;
+
+			const char* c = line;
+			while (c < lineEnd && (*c == ' ' || *c == '\t'))
+				++c;
+
+			if (c < lineEnd && *c == '#')
+			{
+				shader_directive directive;
+				directive.start = (uint32)(line - text);
+				directive.end = (uint32)(lineEnd - text);
+				directive.value = 0;
+
+				bool found = false;
+				for (uint32 s = 0; s < SHADER_STAGE_COUNT && !found; ++s)
+				{
+					if (startsWith(c, lineEnd, stageMarkers[s]))
+					{
+						directive.type = SHADER_DIRECTIVE_STAGE;
+						directive.value = s;
+						found = true;
+					}
+				}
+
+				if (!found && startsWith(c, lineEnd, "#include"))
+				{
+					const char* nameStart = (const char*)memchr(c, '\"', lineEnd - c);
+					const char* nameEnd = nameStart ? (const char*)memchr(nameStart + 1, '\"', lineEnd - nameStart - 1) : 0;
+					if (nameEnd)
+					{
+						directive.type = SHADER_DIRECTIVE_INCLUDE;
+						directive.value = (uint32)includeNames.size();
+						includeNames.push_back(std::string(nameStart + 1, nameEnd));
+						found = true;
+					}
+					else
+					{
+						std::cerr << file.filepath << ": malformed include: " << std::string(line, lineEnd) << std::endl;
+					}
+				}
+				else if (!found && startsWith(c, lineEnd, "#version"))
+				{
+					directive.type = SHADER_DIRECTIVE_VERSION;
+					found = true;
+				}
+
+				if (found)
+					file.directives.push_back(directive);
+			}
+
+			line = lineEnd;
+		}
+	}
+
+	// includes are relative to the including file
+	std::string path = getPath(preprocessor.files[fileIndex].filepath);
+	std::vector<uint32> includeIndices(includeNames.size());
+	for (uint32 i = 0; i < includeNames.size(); ++i)
+		includeIndices[i] = getShaderFile(preprocessor, path + includeNames[i]);
+
+	for (shader_directive& directive : preprocessor.files[fileIndex].directives)
+	{
+		if (directive.type == SHADER_DIRECTIVE_INCLUDE)
+			directive.value = includeIndices[directive.value];
+	}
+}
+
+// removes "." and "dir/.." segments, so every file has exactly one name and include cycles are found
+static std::string normalizePath(const std::string& filepath)
+{
+	std::vector<std::string> segments;
+	size_t start = 0;
+	while (start <= filepath.size())
+	{
+		size_t end = filepath.find_first_of("/\\", start);
+		if (end == std::string::npos)
+			end = filepath.size();
+
+		std::string segment = filepath.substr(start, end - start);
+		if (segment == ".." && !segments.empty() && segments.back() != ".." && !segments.back().empty())
+			segments.pop_back();
+		else if (segment != "." && !(segment.empty() && !segments.empty()))
+			segments.push_back(segment);
+
+		start = end + 1;
+	}
+
+	std::string result;
+	for (uint32 i = 0; i < segments.size(); ++i)
+	{
+		if (i > 0)
+			result += '/';
+		result += segments[i];
+	}
+	return result;
+}
+
+uint32 getShaderFile(shader_preprocessor& preprocessor, const std::string& unnormalizedFilepath)
+{
+	std::string filepath = normalizePath(unnormalizedFilepath);
+
+	std::unordered_map<std::string, uint32>::iterator it = preprocessor.fileIndices.find(filepath);
+	if (it != preprocessor.fileIndices.end())
+		return it->second;
+
+	// registered before parsing, so include cycles terminate here and are reported when expanding
+	uint32 fileIndex = (uint32)preprocessor.files.size();
+	preprocessor.fileIndices[filepath] = fileIndex;
+	preprocessor.files.push_back(shader_file());
+	preprocessor.files[fileIndex].filepath = filepath;
+
+	readShaderFile(preprocessor.files[fileIndex]);
+	parseShaderFile(preprocessor, fileIndex);
+
+	return fileIndex;
+}
+
+uint32 updateShaderFiles(shader_preprocessor& preprocessor)
+{
+	uint32 numberOfChangedFiles = 0;
+
+	// parsing may append newly included files, they are up to date already
+	uint32 numberOfFiles = (uint32)preprocessor.files.size();
+	for (uint32 i = 0; i < numberOfFiles; ++i)
+	{
+		shader_file& file = preprocessor.files[i];
+		if (getFileWriteTime(file.filepath.c_str()) == file.writeTime)
+			continue;
+
+		uint64 oldHash = file.contentHash;
+		readShaderFile(file);
+		if (file.contentHash != oldHash)
+		{
+			std::cout << "reloading " << file.filepath << std::endl;
+			parseShaderFile(preprocessor, i);
+			++numberOfChangedFiles;
+		}
+	}
+
+	return numberOfChangedFiles;
+}
+
+struct shader_expansion
+{
+	const char* defines;
+	bool definesInserted;
+	uint64 hash;
+
+	// null if only the hash is computed
+	std::vector<const char*>* sources;
+	std::vector<int32>* lengths;
+
+	uint32 stack[MAX_SHADER_INCLUDE_DEPTH];
+	uint32 depth;
+};
+
+static void emitSource(shader_expansion& expansion, const char* text, uint32 length)
+{
+	if (expansion.sources && length > 0)
+	{
+		expansion.sources->push_back(text);
+		expansion.lengths->push_back((int32)length);
+	}
+}
+
+static bool expandFile(const shader_preprocessor& preprocessor, shader_expansion& expansion, uint32 fileIndex, shader_stage stage, bool& stageFound)
+{
+	const shader_file& file = preprocessor.files[fileIndex];
+	if (!file.valid)
+		return false;
+
+	for (uint32 i = 0; i < expansion.depth; ++i)
+	{
+		if (expansion.stack[i] == fileIndex)
+		{
+			std::cerr << "include cycle: " << file.filepath << " includes itself" << std::endl;
+			return false;
+		}
+	}
+	if (expansion.depth == MAX_SHADER_INCLUDE_DEPTH)
+	{
+		std::cerr << "includes nested too deep in " << file.filepath << std::endl;
+		return false;
+	}
+	expansion.stack[expansion.depth++] = fileIndex;
+
+	expansion.hash = hashBytes(&file.contentHash, sizeof(file.contentHash), expansion.hash);
+
+	const char* text = file.contents.data();
+	bool inStage = true;
+	uint32 cursor = 0;
+	for (const shader_directive& directive : file.directives)
+	{
+		if (inStage)
+			emitSource(expansion, text + cursor, directive.start - cursor);
+		cursor = directive.end;
+
+		if (directive.type == SHADER_DIRECTIVE_STAGE)
+		{
+			inStage = directive.value == (uint32)stage;
+			stageFound |= inStage;
+		}
+		else if (inStage && directive.type == SHADER_DIRECTIVE_INCLUDE)
+		{
+			bool includedStageFound = false;
+			if (!expandFile(preprocessor, expansion, directive.value, stage, includedStageFound))
+			{
+				std::cerr << "included from " << file.filepath << std::endl;
+				return false;
+			}
+		}
+		else if (inStage && directive.type == SHADER_DIRECTIVE_VERSION)
+		{
+			// #version has to come first, so the defines follow it
+			emitSource(expansion, text + directive.start, directive.end - directive.start);
+			if (!expansion.definesInserted)
+			{
+				emitSource(expansion, expansion.defines, (uint32)strlen(expansion.defines));
+				expansion.definesInserted = true;
+			}
+		}
+	}
+	if (inStage)
+		emitSource(expansion, text + cursor, (uint32)file.contents.size() - cursor);
+
+	--expansion.depth;
+	return true;
+}
+
+static bool expandStage(const shader_preprocessor& preprocessor, shader_expansion& expansion, uint32 fileIndex, shader_stage stage)
+{
+	expansion.definesInserted = false;
+	expansion.depth = 0;
+	expansion.hash = hashBytes(&stage, sizeof(stage));
+	expansion.hash = hashBytes(expansion.defines, strlen(expansion.defines), expansion.hash);
+
+	// the defines go first if there is no #version line
+	if (expansion.sources)
+	{
+		expansion.sources->push_back(expansion.defines);
+		expansion.lengths->push_back(0);
+	}
+
+	bool stageFound = false;
+	if (!expandFile(preprocessor, expansion, fileIndex, stage, stageFound) || !stageFound)
+		return false;
+
+	if (expansion.sources && !expansion.definesInserted)
+		(*expansion.lengths)[0] = (int32)strlen(expansion.defines);
+
+	return true;
+}
+
+uint64 getShaderStageHash(const shader_preprocessor& preprocessor, uint32 fileIndex, shader_stage stage, const char* defines)
+{
+	shader_expansion expansion;
+	expansion.defines = defines;
+	expansion.sources = 0;
+	expansion.lengths = 0;
+
+	if (!expandStage(preprocessor, expansion, fileIndex, stage))
+		return 0;
+	return expansion.hash ? expansion.hash : 1;
+}
+
+bool expandShader(shader_preprocessor& preprocessor, uint32 fileIndex, shader_stage stage, const char* defines)
+{
+	preprocessor.sources.clear();
+	preprocessor.lengths.clear();
+
+	shader_expansion expansion;
+	expansion.defines = defines;
+	expansion.sources = &preprocessor.sources;
+	expansion.lengths = &preprocessor.lengths;
+
+	return expandStage(preprocessor, expansion, fileIndex, stage);
+}
+
+static void collectDependencies(const shader_preprocessor& preprocessor, uint32 fileIndex, std::vector<uint32>& dependencies, std::vector<bool>& visited)
+{
+	for (const shader_directive& directive : preprocessor.files[fileIndex].directives)
+	{
+		if (directive.type == SHADER_DIRECTIVE_INCLUDE && !visited[directive.value])
+		{
+			visited[directive.value] = true;
+			dependencies.push_back(directive.value);
+			collectDependencies(preprocessor, directive.value, dependencies, visited);
+		}
+	}
+}
+
+void getShaderDependencies(const shader_preprocessor& preprocessor, uint32 fileIndex, std::vector<uint32>& dependencies)
+{
+	dependencies.clear();
+	std::vector<bool> visited(preprocessor.files.size(), false);
+	visited[fileIndex] = true;
+	collectDependencies(preprocessor, fileIndex, dependencies, visited);
+}
+
+static void printIncludeTree(const shader_preprocessor& preprocessor, uint32 fileIndex, uint32 depth)
+{
+	std::cout << std::string(depth * 2, ' ') << preprocessor.files[fileIndex].filepath << std::endl;
+	if (depth == MAX_SHADER_INCLUDE_DEPTH)
+		return;
+
+	// files included by several stages are listed once
+	const std::vector<shader_directive>& directives = preprocessor.files[fileIndex].directives;
+	for (uint32 i = 0; i < directives.size(); ++i)
+	{
+		if (directives[i].type != SHADER_DIRECTIVE_INCLUDE)
+			continue;
+
+		bool listed = false;
+		for (uint32 j = 0; j < i && !listed; ++j)
+			listed = directives[j].type == SHADER_DIRECTIVE_INCLUDE && directives[j].value == directives[i].value;
+
+		if (!listed)
+			printIncludeTree(preprocessor, directives[i].value, depth + 1);
+	}
+}
+
+void printShaderDependencies(const shader_preprocessor& preprocessor, uint32 fileIndex)
+{
+	printIncludeTree(preprocessor, fileIndex, 0);
+}
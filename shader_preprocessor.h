@@ -0,0 +1,76 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <unordered_map>
+
+#include "common.h"
+
+// a shader file holds all stages, each starting with a line like ##GL_VERTEX_SHADER. text before the first stage
+// marker is shared by all stages, so included files without markers are included as a whole
+enum shader_stage
+{
+	SHADER_STAGE_VERTEX,
+	SHADER_STAGE_GEOMETRY,
+	SHADER_STAGE_FRAGMENT,
+
+	SHADER_STAGE_COUNT,
+};
+
+enum shader_directive_type
+{
+	SHADER_DIRECTIVE_STAGE,		// value: shader_stage
+	SHADER_DIRECTIVE_INCLUDE,	// value: index of the included file
+	SHADER_DIRECTIVE_VERSION,
+};
+
+// a line the preprocessor acts on. the text between directives is passed to the driver unchanged
+struct shader_directive
+{
+	shader_directive_type type;
+	uint32 start, end;	// byte range of the whole line, including the line break
+	uint32 value;
+};
+
+struct shader_file
+{
+	std::string filepath;
+	std::string contents;	// a copy, so editors can write the file while it is loaded
+	uint64 writeTime;
+	uint64 contentHash;
+	bool valid;				// false if the file could not be read
+
+	std::vector<shader_directive> directives;	// in file order
+};
+
+#define MAX_SHADER_INCLUDE_DEPTH 16
+
+// files are read and parsed once and only again if their content changed on disk. expanding a stage only collects
+// pointers into the cached contents, which glShaderSource accepts as separate strings
+struct shader_preprocessor
+{
+	std::vector<shader_file> files;
+	std::unordered_map<std::string, uint32> fileIndices;
+
+	// output of expandShader. reused, so expanding does not allocate once the arrays have grown
+	std::vector<const char*> sources;
+	std::vector<int32> lengths;
+};
+
+// returns the index of the file, reading and parsing it and all its includes if it is not cached yet
+uint32 getShaderFile(shader_preprocessor& preprocessor, const std::string& filepath);
+
+// rereads files whose write time changed. returns the number of files whose content actually changed
+uint32 updateShaderFiles(shader_preprocessor& preprocessor);
+
+// identifies the expanded source of a stage: the content hashes of all reachable files, the stage and the defines.
+// a shader only needs to be recompiled if this changed. returns 0 if the stage can not be expanded
+uint64 getShaderStageHash(const shader_preprocessor& preprocessor, uint32 fileIndex, shader_stage stage, const char* defines = "");
+
+// fills preprocessor.sources and lengths with the source of one stage. defines (e.g. "#define HAS_NORMAL_MAP\n") are
+// inserted after the #version line
+bool expandShader(shader_preprocessor& preprocessor, uint32 fileIndex, shader_stage stage, const char* defines = "");
+
+// all files the given file includes, directly or indirectly, without duplicates
+void getShaderDependencies(const shader_preprocessor& preprocessor, uint32 fileIndex, std::vector<uint32>& dependencies);
+void printShaderDependencies(const shader_preprocessor& preprocessor, uint32 fileIndex);
@@ -0,0 +1,102 @@
+#include "staging_buffer.h"
+
+
+static const GLbitfield stagingMapFlags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+// rows of compressed blocks and all pixel formats we upload are fine with this
+#define STAGING_ALIGNMENT 16
+
+void createStagingBuffer(opengl_staging_buffer& staging, uint64 capacity)
+{
+	staging.capacity = (capacity + STAGING_ALIGNMENT - 1) / STAGING_ALIGNMENT * STAGING_ALIGNMENT;
+	staging.head = 0;
+	staging.tail = 0;
+	staging.ranges.clear();
+
+	glGenBuffers(1, &staging.buffer);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, staging.buffer);
+	glBufferStorage(GL_COPY_WRITE_BUFFER, staging.capacity, NULL, stagingMapFlags);
+	staging.mapped = (uint8*)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, staging.capacity, stagingMapFlags);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+void deleteStagingBuffer(opengl_staging_buffer& staging)
+{
+	for (staging_range& range : staging.ranges)
+	{
+		if (range.fence)
+		{
+			glClientWaitSync(range.fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+			glDeleteSync(range.fence);
+		}
+	}
+	staging.ranges.clear();
+
+	// deleting the buffer unmaps it
+	glDeleteBuffers(1, &staging.buffer);
+	staging.buffer = 0;
+	staging.mapped = 0;
+}
+
+bool allocateStaging(opengl_staging_buffer& staging, uint64 size, uint64& offset, uint8*& data)
+{
+	size = (size + STAGING_ALIGNMENT - 1) / STAGING_ALIGNMENT * STAGING_ALIGNMENT;
+	if (!staging.mapped || size > staging.capacity)
+		return false;
+
+	// nothing in use, so the whole buffer is available from its start
+	if (staging.ranges.empty())
+		staging.head = staging.tail = 0;
+
+	// ranges never wrap, the end of the buffer is skipped instead
+	uint64 position = staging.head % staging.capacity;
+	uint64 padding = (position + size > staging.capacity) ? staging.capacity - position : 0;
+	if (staging.head + padding + size - staging.tail > staging.capacity)
+		return false;
+
+	if (padding > 0)
+	{
+		staging_range skipped = { staging.head, padding, 0, true };
+		staging.ranges.push_back(skipped);
+		staging.head += padding;
+	}
+
+	staging_range range = { staging.head, size, 0, false };
+	staging.ranges.push_back(range);
+	offset = staging.head % staging.capacity;
+	data = staging.mapped + offset;
+	staging.head += size;
+	return true;
+}
+
+void releaseStaging(opengl_staging_buffer& staging, uint64 offset)
+{
+	for (staging_range& range : staging.ranges)
+	{
+		if (!range.released && range.start % staging.capacity == offset)
+		{
+			range.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+			range.released = true;
+			return;
+		}
+	}
+}
+
+void reclaimStaging(opengl_staging_buffer& staging)
+{
+	while (!staging.ranges.empty())
+	{
+		staging_range& range = staging.ranges.front();
+		if (!range.released)
+			break;
+		if (range.fence)
+		{
+			if (glClientWaitSync(range.fence, 0, 0) == GL_TIMEOUT_EXPIRED)
+				break;
+			glDeleteSync(range.fence);
+		}
+
+		staging.tail = range.start + range.size;
+		staging.ranges.pop_front();
+	}
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <deque>
+
+#include "common.h"
+
+#include <glew/glew.h>
+
+// a range handed out by the staging buffer. start keeps counting past the capacity, its position in the buffer is
+// start modulo the capacity
+struct staging_range
+{
+	uint64 start;
+	uint64 size;
+	GLsync fence;	// set once the copies reading the range are issued
+	bool released;
+};
+
+// persistently mapped memory for pixel and buffer uploads. the gl thread allocates ranges, any thread may write
+// them through the mapped pointer, and the gl thread then only issues the copies out of it (e.g. with the buffer
+// bound as GL_PIXEL_UNPACK_BUFFER) and releases the range. ranges are reused in allocation order once the fence of
+// their copies has passed, so neither side ever waits for the other
+struct opengl_staging_buffer
+{
+	GLuint buffer = 0;
+	uint8* mapped = 0;
+	uint64 capacity = 0;
+
+	uint64 head = 0;	// end of the newest range
+	uint64 tail = 0;	// start of the oldest range still in use
+	std::deque<staging_range> ranges;
+};
+
+void createStagingBuffer(opengl_staging_buffer& staging, uint64 capacity);
+
+// waits for all copies out of the buffer
+void deleteStagingBuffer(opengl_staging_buffer& staging);
+
+// returns false if there is not enough free space right now. offset is the byte offset into the buffer
+bool allocateStaging(opengl_staging_buffer& staging, uint64 size, uint64& offset, uint8*& data);
+
+// call after the copies reading the range were issued
+void releaseStaging(opengl_staging_buffer& staging, uint64 offset);
+
+// frees the ranges whose copies have finished
+void reclaimStaging(opengl_staging_buffer& staging);
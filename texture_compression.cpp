@@ -0,0 +1,801 @@
+#include "texture_compression.h"
+
+#include <cstring>
+#include <cfloat>
+#include <cstdlib>
+
+#include "math.h"
+
+
+// gl enums, so this does not depend on the gl headers
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#define GL_COMPRESSED_RED_RGTC1 0x8DBB
+#define GL_COMPRESSED_RG_RGTC2 0x8DBD
+
+#define GL_R8 0x8229
+#define GL_RG8 0x822B
+#define GL_RGB8 0x8051
+#define GL_RGBA8 0x8058
+
+#define GL_RED 0x1903
+#define GL_RGB 0x1907
+#define GL_RGBA 0x1908
+#define GL_RG 0x8227
+
+#define GL_UNSIGNED_BYTE 0x1401
+
+static const uint8 ktxIdentifier[12] = { 0xAB, 0x4B, 0x54, 0x58, 0x20, 0x31, 0x31, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A }; // «KTX 11»\r\n\x1A\n
+#define KTX_ENDIANNESS 0x04030201
+#define KTX_ENCODER_VERSION_KEY "SSREncoderVersion"
+
+struct ktx_header
+{
+	uint8 identifier[12];
+	uint32 endianness;
+	uint32 glType;
+	uint32 glTypeSize;
+	uint32 glFormat;
+	uint32 glInternalFormat;
+	uint32 glBaseInternalFormat;
+	uint32 pixelWidth;
+	uint32 pixelHeight;
+	uint32 pixelDepth;
+	uint32 numberOfArrayElements;
+	uint32 numberOfFaces;
+	uint32 numberOfMipmapLevels;
+	uint32 bytesOfKeyValueData;
+};
+
+struct texture_format_info
+{
+	const char* name;
+	uint32 blockDimension;	// 4 for block compressed formats, 1 otherwise
+	uint32 blockSize;		// bytes per block or pixel
+	uint32 glInternalFormat;
+	uint32 glBaseInternalFormat;
+};
+
+static const texture_format_info formatInfos[TEXTURE_FORMAT_COUNT] =
+{
+	{ "BC1", 4, 8, GL_COMPRESSED_RGB_S3TC_DXT1_EXT, GL_RGB },
+	{ "BC3", 4, 16, GL_COMPRESSED_RGBA_S3TC_DXT5_EXT, GL_RGBA },
+	{ "BC4", 4, 8, GL_COMPRESSED_RED_RGTC1, GL_RED },
+	{ "BC5", 4, 16, GL_COMPRESSED_RG_RGTC2, GL_RG },
+
+	{ "R8", 1, 1, GL_R8, GL_RED },
+	{ "RG8", 1, 2, GL_RG8, GL_RG },
+	{ "RGB8", 1, 3, GL_RGB8, GL_RGB },
+	{ "RGBA8", 1, 4, GL_RGBA8, GL_RGBA },
+};
+
+uint32 getTextureLevelSize(texture_format format, uint32 width, uint32 height)
+{
+	const texture_format_info& info = formatInfos[format];
+	uint32 blocksX = (width + info.blockDimension - 1) / info.blockDimension;
+	uint32 blocksY = (height + info.blockDimension - 1) / info.blockDimension;
+	return blocksX * blocksY * info.blockSize;
+}
+
+bool isTextureFormatCompressed(texture_format format)
+{
+	return formatInfos[format].blockDimension > 1;
+}
+
+uint32 getGLInternalFormat(texture_format format)
+{
+	return formatInfos[format].glInternalFormat;
+}
+
+uint32 getGLFormat(texture_format format)
+{
+	return formatInfos[format].glBaseInternalFormat;
+}
+
+const char* getTextureFormatName(texture_format format)
+{
+	return formatInfos[format].name;
+}
+
+bool isTextureFormatForUsage(texture_format format, texture_usage usage)
+{
+	switch (usage)
+	{
+#if COMPRESS_TEXTURES
+		case TEXTURE_USAGE_COLOR: return format == TEXTURE_FORMAT_BC1 || format == TEXTURE_FORMAT_BC3;
+		case TEXTURE_USAGE_NORMAL: return format == TEXTURE_FORMAT_BC5;
+		case TEXTURE_USAGE_MASK: return format == TEXTURE_FORMAT_BC4;
+#else
+		case TEXTURE_USAGE_COLOR: return format == TEXTURE_FORMAT_RGB8 || format == TEXTURE_FORMAT_RGBA8;
+		case TEXTURE_USAGE_NORMAL: return format == TEXTURE_FORMAT_RG8;
+		case TEXTURE_USAGE_MASK: return format == TEXTURE_FORMAT_R8;
+#endif
+	}
+	return false;
+}
+
+static inline uint16 packColor565(const vec3& color)
+{
+	uint32 r = (uint32)clamp(color.x * 31.f / 255.f + 0.5f, 0.f, 31.f);
+	uint32 g = (uint32)clamp(color.y * 63.f / 255.f + 0.5f, 0.f, 63.f);
+	uint32 b = (uint32)clamp(color.z * 31.f / 255.f + 0.5f, 0.f, 31.f);
+	return (uint16)((r << 11) | (g << 5) | b);
+}
+
+static inline vec3 unpackColor565(uint16 color)
+{
+	uint32 r = (color >> 11) & 31, g = (color >> 5) & 63, b = color & 31;
+	return vec3((float)((r << 3) | (r >> 2)), (float)((g << 2) | (g >> 4)), (float)((b << 3) | (b >> 2)));
+}
+
+// picks the nearest of the four palette colors for every pixel. returns the squared error
+static float getBC1Indices(const vec3* pixels, uint16 color0, uint16 color1, uint32& indices)
+{
+	vec3 palette[4];
+	palette[0] = unpackColor565(color0);
+	palette[1] = unpackColor565(color1);
+	palette[2] = (palette[0] * 2.f + palette[1]) / 3.f;
+	palette[3] = (palette[0] + palette[1] * 2.f) / 3.f;
+
+	float error = 0.f;
+	indices = 0;
+	for (uint32 i = 0; i < 16; ++i)
+	{
+		uint32 best = 0;
+		float bestDistance = FLT_MAX;
+		for (uint32 p = 0; p < 4; ++p)
+		{
+			float distance = sqlength(pixels[i] - palette[p]);
+			if (distance < bestDistance)
+			{
+				bestDistance = distance;
+				best = p;
+			}
+		}
+		indices |= best << (i * 2);
+		error += bestDistance;
+	}
+	return error;
+}
+
+// endpoints along the principal axis of the colors, then one least squares refit to the chosen indices
+static void encodeBC1Block(const vec3* pixels, uint8* block)
+{
+	vec3 mean(0.f, 0.f, 0.f);
+	for (uint32 i = 0; i < 16; ++i)
+		mean = mean + pixels[i];
+	mean = mean / 16.f;
+
+	float covariance[6] = { 0.f };
+	for (uint32 i = 0; i < 16; ++i)
+	{
+		vec3 d = pixels[i] - mean;
+		covariance[0] += d.x * d.x; covariance[1] += d.x * d.y; covariance[2] += d.x * d.z;
+		covariance[3] += d.y * d.y; covariance[4] += d.y * d.z;
+		covariance[5] += d.z * d.z;
+	}
+
+	// power iteration
+	vec3 axis(1.f, 1.f, 1.f);
+	for (uint32 iteration = 0; iteration < 8; ++iteration)
+	{
+		vec3 next(covariance[0] * axis.x + covariance[1] * axis.y + covariance[2] * axis.z,
+			covariance[1] * axis.x + covariance[3] * axis.y + covariance[4] * axis.z,
+			covariance[2] * axis.x + covariance[4] * axis.y + covariance[5] * axis.z);
+		float l = length(next);
+		if (l < 1e-6f)
+			break;
+		axis = next / l;
+	}
+
+	float minProjection = FLT_MAX, maxProjection = -FLT_MAX;
+	for (uint32 i = 0; i < 16; ++i)
+	{
+		float projection = dot(pixels[i] - mean, axis);
+		minProjection = min(minProjection, projection);
+		maxProjection = max(maxProjection, projection);
+	}
+
+	// inset a little, the extremes are only hit exactly by few pixels
+	float inset = (maxProjection - minProjection) / 16.f;
+	uint16 color0 = packColor565(mean + axis * (maxProjection - inset));
+	uint16 color1 = packColor565(mean + axis * (minProjection + inset));
+
+	uint32 indices;
+	float error = getBC1Indices(pixels, color0, color1, indices);
+
+	// least squares endpoints for the chosen indices
+	{
+		static const float weights[4] = { 1.f, 0.f, 2.f / 3.f, 1.f / 3.f };
+		float aa = 0.f, ab = 0.f, bb = 0.f;
+		vec3 ax(0.f, 0.f, 0.f), bx(0.f, 0.f, 0.f);
+		for (uint32 i = 0; i < 16; ++i)
+		{
+			float a = weights[(indices >> (i * 2)) & 3];
+			float b = 1.f - a;
+			aa += a * a; ab += a * b; bb += b * b;
+			ax = ax + pixels[i] * a;
+			bx = bx + pixels[i] * b;
+		}
+
+		float determinant = aa * bb - ab * ab;
+		if (fabsf(determinant) > 1e-6f)
+		{
+			vec3 endpoint0 = (ax * bb - bx * ab) / determinant;
+			vec3 endpoint1 = (bx * aa - ax * ab) / determinant;
+			uint16 refined0 = packColor565(endpoint0);
+			uint16 refined1 = packColor565(endpoint1);
+
+			uint32 refinedIndices;
+			float refinedError = getBC1Indices(pixels, refined0, refined1, refinedIndices);
+			if (refinedError < error)
+			{
+				color0 = refined0;
+				color1 = refined1;
+				indices = refinedIndices;
+			}
+		}
+	}
+
+	// color0 > color1 selects the four color mode. swapping the endpoints swaps index 0 with 1 and 2 with 3
+	if (color0 < color1)
+	{
+		uint16 temp = color0; color0 = color1; color1 = temp;
+		indices ^= 0x55555555;
+	}
+	else if (color0 == color1)
+	{
+		indices = 0;
+	}
+
+	memcpy(block + 0, &color0, 2);
+	memcpy(block + 2, &color1, 2);
+	memcpy(block + 4, &indices, 4);
+}
+
+// eight value mode: endpoints at the minimum and maximum, six interpolated values in between
+static void encodeBC4Block(const uint8* values, uint8* block)
+{
+	uint8 minValue = 255, maxValue = 0;
+	for (uint32 i = 0; i < 16; ++i)
+	{
+		minValue = min(minValue, values[i]);
+		maxValue = max(maxValue, values[i]);
+	}
+
+	block[0] = maxValue;
+	block[1] = minValue;
+
+	uint64 indices = 0;
+	if (maxValue > minValue)
+	{
+		// palette order is max, min, then from max towards min in sevenths
+		static const uint32 paletteIndices[8] = { 1, 7, 6, 5, 4, 3, 2, 0 };
+		float range = (float)(maxValue - minValue);
+		for (uint32 i = 0; i < 16; ++i)
+		{
+			uint32 step = (uint32)((values[i] - minValue) * 7.f / range + 0.5f);
+			indices |= (uint64)paletteIndices[step] << (i * 3);
+		}
+	}
+
+	for (uint32 i = 0; i < 6; ++i)
+		block[2 + i] = (uint8)(indices >> (i * 8));
+}
+
+// copies a 4x4 block out of an rgba8 image, repeating the last row and column at the border
+static void loadBlock(const uint8* rgba, uint32 width, uint32 height, uint32 blockX, uint32 blockY, uint8* pixels)
+{
+	for (uint32 y = 0; y < 4; ++y)
+	{
+		uint32 sy = min(blockY * 4 + y, height - 1);
+		for (uint32 x = 0; x < 4; ++x)
+		{
+			uint32 sx = min(blockX * 4 + x, width - 1);
+			memcpy(pixels + (y * 4 + x) * 4, rgba + (sy * width + sx) * 4, 4);
+		}
+	}
+}
+
+static void compressLevel(const uint8* rgba, uint32 width, uint32 height, texture_format format, uint8* output)
+{
+	if (!isTextureFormatCompressed(format))
+	{
+		// keeps the leading channels
+		uint32 numberOfChannels = formatInfos[format].blockSize;
+		for (uint32 i = 0; i < width * height; ++i)
+			memcpy(output + i * numberOfChannels, rgba + i * 4, numberOfChannels);
+		return;
+	}
+
+	uint32 blocksX = (width + 3) / 4, blocksY = (height + 3) / 4;
+	uint32 blockSize = formatInfos[format].blockSize;
+
+	for (uint32 by = 0; by < blocksY; ++by)
+	{
+		for (uint32 bx = 0; bx < blocksX; ++bx)
+		{
+			uint8 pixels[16 * 4];
+			loadBlock(rgba, width, height, bx, by, pixels);
+			uint8* block = output + (by * blocksX + bx) * blockSize;
+
+			vec3 colors[16];
+			uint8 channel[16];
+			switch (format)
+			{
+				case TEXTURE_FORMAT_BC1:
+				case TEXTURE_FORMAT_BC3:
+				{
+					uint8* colorBlock = block;
+					if (format == TEXTURE_FORMAT_BC3)
+					{
+						for (uint32 i = 0; i < 16; ++i)
+							channel[i] = pixels[i * 4 + 3];
+						encodeBC4Block(channel, block);
+						colorBlock += 8;
+					}
+					for (uint32 i = 0; i < 16; ++i)
+						colors[i] = vec3(pixels[i * 4 + 0], pixels[i * 4 + 1], pixels[i * 4 + 2]);
+					encodeBC1Block(colors, colorBlock);
+				} break;
+
+				case TEXTURE_FORMAT_BC4:
+				case TEXTURE_FORMAT_BC5:
+				{
+					uint32 numberOfChannels = (format == TEXTURE_FORMAT_BC5) ? 2 : 1;
+					for (uint32 c = 0; c < numberOfChannels; ++c)
+					{
+						for (uint32 i = 0; i < 16; ++i)
+							channel[i] = pixels[i * 4 + c];
+						encodeBC4Block(channel, block + c * 8);
+					}
+				} break;
+
+				default: break;
+			}
+		}
+	}
+}
+
+enum mip_filter
+{
+	MIP_FILTER_BOX,		// no ringing, used for normals
+	MIP_FILTER_KAISER,	// windowed sinc, keeps the mips sharp
+};
+
+#define KAISER_WIDTH 3.f	// in destination pixels
+#define KAISER_ALPHA 4.f
+
+// zeroth order modified bessel function of the first kind
+static float besselI0(float x)
+{
+	float sum = 1.f, term = 1.f;
+	for (uint32 k = 1; k < 32; ++k)
+	{
+		term *= (x * 0.5f / k) * (x * 0.5f / k);
+		sum += term;
+		if (term < sum * 1e-8f)
+			break;
+	}
+	return sum;
+}
+
+static float evaluateMipFilter(mip_filter filter, float x)
+{
+	x = fabsf(x);
+	if (filter == MIP_FILTER_BOX)
+		return (x <= 0.5f) ? 1.f : 0.f;
+
+	if (x >= KAISER_WIDTH)
+		return 0.f;
+	float sinc = (x < 1e-5f) ? 1.f : sinf(M_PI * x) / (M_PI * x);
+	float t = x / KAISER_WIDTH;
+	return sinc * besselI0(KAISER_ALPHA * sqrtf(1.f - t * t)) / besselI0(KAISER_ALPHA);
+}
+
+// taps of a separable downsampling filter, for every destination pixel along one axis
+struct mip_filter_taps
+{
+	std::vector<uint32> offsets;	// destination pixel -> first tap, one more entry than destination pixels
+	std::vector<uint32> sources;
+	std::vector<float> weights;
+};
+
+static void computeMipFilterTaps(mip_filter_taps& taps, mip_filter filter, uint32 sourceSize, uint32 destinationSize)
+{
+	float scale = (float)sourceSize / (float)destinationSize;
+	float radius = ((filter == MIP_FILTER_BOX) ? 0.5f : KAISER_WIDTH) * scale;
+
+	taps.offsets.clear();
+	taps.sources.clear();
+	taps.weights.clear();
+	for (uint32 d = 0; d < destinationSize; ++d)
+	{
+		taps.offsets.push_back((uint32)taps.sources.size());
+
+		float center = (d + 0.5f) * scale;
+		int32 first = (int32)floorf(center - radius), last = (int32)ceilf(center + radius);
+		float sum = 0.f;
+		for (int32 i = first; i <= last; ++i)
+		{
+			float weight = evaluateMipFilter(filter, (i + 0.5f - center) / scale);
+			if (weight == 0.f)
+				continue;
+
+			// clamped at the border
+			taps.sources.push_back((uint32)clamp(i, 0, (int32)sourceSize - 1));
+			taps.weights.push_back(weight);
+			sum += weight;
+		}
+		for (uint32 t = taps.offsets.back(); t < taps.weights.size(); ++t)
+			taps.weights[t] /= sum;
+	}
+	taps.offsets.push_back((uint32)taps.sources.size());
+}
+
+// float rgba images, four floats per pixel, so every pixel is one sse register
+static void downsample(const std::vector<float>& source, uint32 width, uint32 height, std::vector<float>& destination,
+	uint32 newWidth, uint32 newHeight, mip_filter filter)
+{
+	mip_filter_taps horizontal, vertical;
+	computeMipFilterTaps(horizontal, filter, width, newWidth);
+	computeMipFilterTaps(vertical, filter, height, newHeight);
+
+	std::vector<float> rows(newWidth * height * 4);
+	for (uint32 y = 0; y < height; ++y)
+	{
+		const float* sourceRow = &source[y * width * 4];
+		float* row = &rows[y * newWidth * 4];
+		for (uint32 x = 0; x < newWidth; ++x)
+		{
+			__m128 sum = _mm_setzero_ps();
+			for (uint32 t = horizontal.offsets[x]; t < horizontal.offsets[x + 1]; ++t)
+				sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(sourceRow + horizontal.sources[t] * 4), _mm_set1_ps(horizontal.weights[t])));
+			_mm_storeu_ps(row + x * 4, sum);
+		}
+	}
+
+	// whole rows are accumulated at once, which walks memory linearly
+	destination.assign(newWidth * newHeight * 4, 0.f);
+	for (uint32 y = 0; y < newHeight; ++y)
+	{
+		float* destinationRow = &destination[y * newWidth * 4];
+		for (uint32 t = vertical.offsets[y]; t < vertical.offsets[y + 1]; ++t)
+		{
+			const float* row = &rows[vertical.sources[t] * newWidth * 4];
+			__m128 weight = _mm_set1_ps(vertical.weights[t]);
+			for (uint32 x = 0; x < newWidth; ++x)
+				_mm_storeu_ps(destinationRow + x * 4, _mm_add_ps(_mm_loadu_ps(destinationRow + x * 4), _mm_mul_ps(_mm_loadu_ps(row + x * 4), weight)));
+		}
+	}
+}
+
+static inline float srgbToLinear(float c)
+{
+	return (c <= 0.04045f) ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+}
+
+static inline float linearToSrgb(float c)
+{
+	return (c <= 0.0031308f) ? c * 12.92f : 1.055f * powf(c, 1.f / 2.4f) - 0.055f;
+}
+
+// color is averaged in linear space, otherwise dark texels win and mips get darker. normals are unpacked to [-1, 1]
+static void decodeTexels(const uint8* rgba, uint32 count, texture_usage usage, std::vector<float>& texels)
+{
+	float srgbTable[256];
+	for (uint32 i = 0; i < 256; ++i)
+		srgbTable[i] = srgbToLinear(i / 255.f);
+
+	texels.resize(count * 4);
+	for (uint32 i = 0; i < count; ++i)
+	{
+		for (uint32 c = 0; c < 4; ++c)
+		{
+			uint8 value = rgba[i * 4 + c];
+			float result = value / 255.f;
+			if (usage == TEXTURE_USAGE_COLOR && c < 3)
+				result = srgbTable[value];
+			else if (usage == TEXTURE_USAGE_NORMAL && c < 3)
+				result = result * 2.f - 1.f;
+			texels[i * 4 + c] = result;
+		}
+	}
+}
+
+static void normalizeTexels(std::vector<float>& texels)
+{
+	for (uint32 i = 0; i < texels.size(); i += 4)
+	{
+		vec3 n(texels[i + 0], texels[i + 1], texels[i + 2]);
+		float l = length(n);
+		n = (l > 1e-6f) ? n / l : vec3(0.f, 0.f, 1.f);
+		texels[i + 0] = n.x; texels[i + 1] = n.y; texels[i + 2] = n.z;
+	}
+}
+
+static void encodeTexels(const std::vector<float>& texels, texture_usage usage, std::vector<uint8>& rgba)
+{
+	rgba.resize(texels.size());
+	for (uint32 i = 0; i < texels.size(); ++i)
+	{
+		float value = texels[i];
+		bool rgb = (i & 3) != 3;
+		if (usage == TEXTURE_USAGE_COLOR && rgb)
+			value = linearToSrgb(clamp(value, 0.f, 1.f));
+		else if (usage == TEXTURE_USAGE_NORMAL && rgb)
+			value = value * 0.5f + 0.5f;
+		rgba[i] = (uint8)(clamp(value, 0.f, 1.f) * 255.f + 0.5f);
+	}
+}
+
+void compressTexture(compressed_texture& result, const uint8* rgba, uint32 width, uint32 height, texture_usage usage)
+{
+	bool hasAlpha = false;
+	for (uint32 i = 0; i < width * height && !hasAlpha; ++i)
+		hasAlpha = rgba[i * 4 + 3] != 255;
+
+	// the renderer does not use alpha, but textures with real alpha keep it
+	switch (usage)
+	{
+#if COMPRESS_TEXTURES
+		case TEXTURE_USAGE_COLOR: result.format = hasAlpha ? TEXTURE_FORMAT_BC3 : TEXTURE_FORMAT_BC1; break;
+		case TEXTURE_USAGE_NORMAL: result.format = TEXTURE_FORMAT_BC5; break;
+		case TEXTURE_USAGE_MASK: result.format = TEXTURE_FORMAT_BC4; break;
+#else
+		case TEXTURE_USAGE_COLOR: result.format = hasAlpha ? TEXTURE_FORMAT_RGBA8 : TEXTURE_FORMAT_RGB8; break;
+		case TEXTURE_USAGE_NORMAL: result.format = TEXTURE_FORMAT_RG8; break;
+		case TEXTURE_USAGE_MASK: result.format = TEXTURE_FORMAT_R8; break;
+#endif
+	}
+	mip_filter filter = (usage == TEXTURE_USAGE_NORMAL) ? MIP_FILTER_BOX : MIP_FILTER_KAISER;
+
+	result.width = width;
+	result.height = height;
+	result.encoderVersion = TEXTURE_ENCODER_VERSION;
+	result.numberOfLevels = 1;
+	while (result.numberOfLevels < MAX_TEXTURE_LEVELS && ((width | height) >> result.numberOfLevels) != 0)
+		++result.numberOfLevels;
+	result.firstLevel = 0;
+	result.endLevel = result.numberOfLevels;
+
+	uint32 totalSize = 0;
+	for (uint32 level = 0; level < result.numberOfLevels; ++level)
+	{
+		result.levelOffsets[level] = totalSize;
+		totalSize += getTextureLevelSize(result.format, max(width >> level, 1u), max(height >> level, 1u));
+	}
+	result.data.resize(totalSize);
+
+	// every level is filtered from the float version of the previous one, only the encoded result is quantized
+	std::vector<float> level, nextLevel;
+	decodeTexels(rgba, width * height, usage, level);
+	if (usage == TEXTURE_USAGE_NORMAL)
+		normalizeTexels(level);
+
+	std::vector<uint8> levelRGBA;
+	uint32 levelWidth = width, levelHeight = height;
+	for (uint32 l = 0; l < result.numberOfLevels; ++l)
+	{
+		if (l == 0)
+			levelRGBA.assign(rgba, rgba + width * height * 4);
+		else
+			encodeTexels(level, usage, levelRGBA);
+		compressLevel(levelRGBA.data(), levelWidth, levelHeight, result.format, &result.data[result.levelOffsets[l]]);
+
+		if (l + 1 < result.numberOfLevels)
+		{
+			uint32 nextWidth = max(levelWidth / 2, 1u), nextHeight = max(levelHeight / 2, 1u);
+			downsample(level, levelWidth, levelHeight, nextLevel, nextWidth, nextHeight, filter);
+			if (usage == TEXTURE_USAGE_NORMAL)
+				normalizeTexels(nextLevel);
+			level.swap(nextLevel);
+			levelWidth = nextWidth;
+			levelHeight = nextHeight;
+		}
+	}
+}
+
+void trimTextureLevels(compressed_texture& texture, uint32 firstLevel, uint32 endLevel)
+{
+	firstLevel = max(firstLevel, texture.firstLevel);
+	endLevel = max(min(endLevel, texture.endLevel), firstLevel);
+
+	uint32 start = (firstLevel < texture.endLevel) ? texture.levelOffsets[firstLevel] : 0;
+	uint32 end = (endLevel < texture.endLevel) ? texture.levelOffsets[endLevel] : (uint32)texture.data.size();
+	std::vector<uint8>(texture.data.begin() + start, texture.data.begin() + max(start, end)).swap(texture.data);
+
+	for (uint32 level = firstLevel; level < endLevel; ++level)
+		texture.levelOffsets[level] -= start;
+	texture.firstLevel = firstLevel;
+	texture.endLevel = endLevel;
+}
+
+// rows of uncompressed levels are padded to 4 bytes in ktx files
+static inline uint32 getKTXRowSize(texture_format format, uint32 width)
+{
+	return (width * formatInfos[format].blockSize + 3) & ~3u;
+}
+
+static inline uint32 getKTXImageSize(texture_format format, uint32 width, uint32 height)
+{
+	if (isTextureFormatCompressed(format))
+		return getTextureLevelSize(format, width, height);
+	return getKTXRowSize(format, width) * height;
+}
+
+// returns 0 if the key is not there
+static uint32 readEncoderVersion(const uint8* keyValueData, uint32 size)
+{
+	const uint8* read = keyValueData;
+	const uint8* end = keyValueData + size;
+	while (end - read >= 4)
+	{
+		uint32 keyAndValueSize;
+		memcpy(&keyAndValueSize, read, sizeof(keyAndValueSize));
+		read += sizeof(keyAndValueSize);
+		if ((uint32)(end - read) < keyAndValueSize)
+			break;
+
+		const char* key = (const char*)read;
+		uint32 keySize = (uint32)strlen(KTX_ENCODER_VERSION_KEY) + 1;
+		if (keyAndValueSize > keySize && memcmp(key, KTX_ENCODER_VERSION_KEY, keySize) == 0)
+			return (uint32)atoi(std::string(key + keySize, keyAndValueSize - keySize).c_str());
+
+		read += (keyAndValueSize + 3) & ~3u;
+	}
+	return 0;
+}
+
+bool loadKTX(compressed_texture& texture, const std::string& filename, uint32 firstLevel, uint32 endLevel)
+{
+	input_file file = readFile(filename.c_str());
+	if (!file.contents)
+		return false;
+
+	const uint8* read = (const uint8*)file.contents;
+	const uint8* end = read + file.size;
+
+	bool result = false;
+	ktx_header header;
+	if (file.size >= sizeof(header))
+	{
+		memcpy(&header, read, sizeof(header));
+		read += sizeof(header);
+
+		result = memcmp(header.identifier, ktxIdentifier, sizeof(ktxIdentifier)) == 0
+			&& header.endianness == KTX_ENDIANNESS
+			&& header.pixelDepth == 0 && header.numberOfArrayElements == 0 && header.numberOfFaces == 1
+			&& header.numberOfMipmapLevels > 0 && header.numberOfMipmapLevels <= MAX_TEXTURE_LEVELS
+			&& header.pixelWidth > 0 && header.pixelHeight > 0
+			&& (uint64)(end - read) >= header.bytesOfKeyValueData;
+
+		texture.format = TEXTURE_FORMAT_COUNT;
+		for (uint32 f = 0; f < TEXTURE_FORMAT_COUNT; ++f)
+		{
+			if (formatInfos[f].glInternalFormat == header.glInternalFormat)
+				texture.format = (texture_format)f;
+		}
+		result &= texture.format != TEXTURE_FORMAT_COUNT;
+		result &= isTextureFormatCompressed(texture.format) || header.glType == GL_UNSIGNED_BYTE;
+
+		if (result)
+		{
+			texture.encoderVersion = readEncoderVersion(read, header.bytesOfKeyValueData);
+			read += header.bytesOfKeyValueData;
+
+			texture.width = header.pixelWidth;
+			texture.height = header.pixelHeight;
+			texture.numberOfLevels = header.numberOfMipmapLevels;
+			texture.firstLevel = min(firstLevel, texture.numberOfLevels);
+			texture.endLevel = max(min(endLevel, texture.numberOfLevels), texture.firstLevel);
+			texture.data.clear();
+
+			for (uint32 level = 0; level < texture.numberOfLevels; ++level)
+			{
+				uint32 width = max(texture.width >> level, 1u), height = max(texture.height >> level, 1u);
+				uint32 imageSize;
+				if (end - read < (int64)sizeof(imageSize))
+				{
+					result = false;
+					break;
+				}
+				memcpy(&imageSize, read, sizeof(imageSize)); read += sizeof(imageSize);
+
+				if (imageSize != getKTXImageSize(texture.format, width, height) || end - read < (int64)imageSize)
+				{
+					result = false;
+					break;
+				}
+
+				if (level >= texture.firstLevel && level < texture.endLevel)
+				{
+					texture.levelOffsets[level] = (uint32)texture.data.size();
+					if (isTextureFormatCompressed(texture.format))
+					{
+						texture.data.insert(texture.data.end(), read, read + imageSize);
+					}
+					else
+					{
+						uint32 rowSize = width * formatInfos[texture.format].blockSize;
+						for (uint32 y = 0; y < height; ++y)
+							texture.data.insert(texture.data.end(), read + y * getKTXRowSize(texture.format, width), read + y * getKTXRowSize(texture.format, width) + rowSize);
+					}
+				}
+				read += (imageSize + 3) & ~3u; // mip padding
+			}
+		}
+	}
+
+	if (!result)
+		std::cerr << "KTX file " << filename << " is invalid." << std::endl;
+
+	freeFile(file);
+	return result;
+}
+
+bool saveKTX(const compressed_texture& texture, const std::string& filename)
+{
+	if (texture.firstLevel != 0 || texture.endLevel != texture.numberOfLevels)
+	{
+		std::cerr << "Could not write KTX file " << filename << ", not all levels are loaded." << std::endl;
+		return false;
+	}
+
+	// one key value pair: size, key and value with their null terminators, padding
+	std::string version = std::to_string(texture.encoderVersion);
+	uint32 keyAndValueSize = (uint32)(strlen(KTX_ENCODER_VERSION_KEY) + 1 + version.size() + 1);
+	std::vector<uint8> keyValueData(sizeof(uint32) + ((keyAndValueSize + 3) & ~3u), 0);
+	memcpy(&keyValueData[0], &keyAndValueSize, sizeof(uint32));
+	memcpy(&keyValueData[sizeof(uint32)], KTX_ENCODER_VERSION_KEY, strlen(KTX_ENCODER_VERSION_KEY) + 1);
+	memcpy(&keyValueData[sizeof(uint32) + strlen(KTX_ENCODER_VERSION_KEY) + 1], version.c_str(), version.size() + 1);
+
+	bool compressed = isTextureFormatCompressed(texture.format);
+
+	ktx_header header = {};
+	memcpy(header.identifier, ktxIdentifier, sizeof(ktxIdentifier));
+	header.endianness = KTX_ENDIANNESS;
+	header.glType = compressed ? 0 : GL_UNSIGNED_BYTE;
+	header.glTypeSize = 1;
+	header.glFormat = compressed ? 0 : formatInfos[texture.format].glBaseInternalFormat;
+	header.glInternalFormat = formatInfos[texture.format].glInternalFormat;
+	header.glBaseInternalFormat = formatInfos[texture.format].glBaseInternalFormat;
+	header.pixelWidth = texture.width;
+	header.pixelHeight = texture.height;
+	header.numberOfFaces = 1;
+	header.numberOfMipmapLevels = texture.numberOfLevels;
+	header.bytesOfKeyValueData = (uint32)keyValueData.size();
+
+	std::vector<uint8> buffer((const uint8*)&header, (const uint8*)&header + sizeof(header));
+	buffer.insert(buffer.end(), keyValueData.begin(), keyValueData.end());
+	for (uint32 level = 0; level < texture.numberOfLevels; ++level)
+	{
+		uint32 width = max(texture.width >> level, 1u), height = max(texture.height >> level, 1u);
+		uint32 imageSize = getKTXImageSize(texture.format, width, height);
+		const uint8* bytes = (const uint8*)&imageSize;
+		buffer.insert(buffer.end(), bytes, bytes + sizeof(imageSize));
+
+		const uint8* levelData = &texture.data[texture.levelOffsets[level]];
+		if (compressed)
+		{
+			buffer.insert(buffer.end(), levelData, levelData + imageSize);
+		}
+		else
+		{
+			uint32 rowSize = width * formatInfos[texture.format].blockSize;
+			for (uint32 y = 0; y < height; ++y)
+			{
+				buffer.insert(buffer.end(), levelData + y * rowSize, levelData + (y + 1) * rowSize);
+				buffer.resize(buffer.size() + getKTXRowSize(texture.format, width) - rowSize, 0);
+			}
+		}
+		buffer.resize((buffer.size() + 3) & ~(size_t)3, 0); // mip padding
+	}
+
+	if (!writeFile(filename.c_str(), buffer.data(), buffer.size()))
+	{
+		std::cerr << "Could not write KTX file " << filename << "." << std::endl;
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <vector>
+#include <string>
+
+#include "common.h"
+
+// block compressed formats if set, otherwise textures are stored with only the channels they need
+#define COMPRESS_TEXTURES 1
+
+// what the channels of a texture mean decides how it is stored and how its mips are filtered
+enum texture_usage
+{
+	TEXTURE_USAGE_COLOR,	// srgb encoded rgb(a), bc1 or bc3 if the alpha channel is used, rgb8 or rgba8 otherwise
+	TEXTURE_USAGE_NORMAL,	// tangent space normal in rgb, only x and y are stored (bc5, rg8), z is reconstructed in the shader
+	TEXTURE_USAGE_MASK,		// a single channel in r (bc4, r8), e.g. specular or displacement maps
+};
+
+enum texture_format
+{
+	TEXTURE_FORMAT_BC1,		// 8 bytes per 4x4 block, rgb
+	TEXTURE_FORMAT_BC3,		// 16 bytes per block, rgb like bc1 plus alpha like bc4
+	TEXTURE_FORMAT_BC4,		// 8 bytes per block, r
+	TEXTURE_FORMAT_BC5,		// 16 bytes per block, r and g like bc4
+
+	TEXTURE_FORMAT_R8,
+	TEXTURE_FORMAT_RG8,
+	TEXTURE_FORMAT_RGB8,
+	TEXTURE_FORMAT_RGBA8,
+
+	TEXTURE_FORMAT_COUNT,
+};
+
+#define MAX_TEXTURE_LEVELS 16
+
+// changes whenever the encoder or the mip filters change, so cached textures are rebuilt
+#define TEXTURE_ENCODER_VERSION 2
+
+// a texture with its mip chain, largest level first. data may hold only a range of the levels, e.g. when streaming.
+// levels of uncompressed formats are tightly packed
+struct compressed_texture
+{
+	texture_format format;
+	uint32 width, height;
+	uint32 numberOfLevels;
+	uint32 firstLevel, endLevel;				// levels in data
+	uint32 levelOffsets[MAX_TEXTURE_LEVELS];	// into data, for the levels in data
+	uint32 encoderVersion;						// 0 for files written by other tools
+	std::vector<uint8> data;
+};
+
+uint32 getTextureLevelSize(texture_format format, uint32 width, uint32 height);
+bool isTextureFormatCompressed(texture_format format);
+uint32 getGLInternalFormat(texture_format format);
+uint32 getGLFormat(texture_format format);		// pixel transfer format of uncompressed formats
+const char* getTextureFormatName(texture_format format);
+
+// true if the format is what compressTexture picks for this usage, given the COMPRESS_TEXTURES setting
+bool isTextureFormatForUsage(texture_format format, texture_usage usage);
+
+// generates the mip chain of an rgba8 image and encodes all levels. color is filtered in linear space, normals are
+// renormalized on every level
+void compressTexture(compressed_texture& result, const uint8* rgba, uint32 width, uint32 height, texture_usage usage);
+
+// frees all levels outside of [firstLevel, endLevel)
+void trimTextureLevels(compressed_texture& texture, uint32 firstLevel, uint32 endLevel);
+
+// ktx 1.1 files. the encoder version is kept as a key value pair. only levels in [firstLevel, endLevel) are copied
+// out of the file, the others are not even read from disk
+bool loadKTX(compressed_texture& texture, const std::string& filename, uint32 firstLevel = 0, uint32 endLevel = MAX_TEXTURE_LEVELS);
+bool saveKTX(const compressed_texture& texture, const std::string& filename);
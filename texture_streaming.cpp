@@ -0,0 +1,93 @@
+#include "texture_streaming.h"
+
+#include "math.h"
+
+#include <cstring>
+
+
+static void textureStreamingWorker(texture_streamer* streamer)
+{
+	for (;;)
+	{
+		texture_stream_request* request;
+		{
+			std::unique_lock<std::mutex> lock(streamer->mutex);
+			streamer->condition.wait(lock, [streamer]() { return streamer->quit || !streamer->pending.empty(); });
+			if (streamer->quit)
+				return;
+
+			request = streamer->pending.front();
+			streamer->pending.pop_front();
+		}
+
+		// the files are mapped, so only the pages of the requested levels are read
+		compressed_texture layer;
+		uint64 offset = 0;
+		request->succeeded = true;
+		for (uint32 i = 0; i < request->files.size() && request->succeeded; ++i)
+		{
+			request->succeeded = loadKTX(layer, request->files[i], request->firstLevel, request->endLevel)
+				&& layer.firstLevel == request->firstLevel && layer.endLevel == request->endLevel
+				&& offset + layer.data.size() <= request->stagingSize;
+			if (request->succeeded)
+			{
+				memcpy(request->staging + offset, layer.data.data(), layer.data.size());
+				offset += layer.data.size();
+			}
+		}
+
+		std::lock_guard<std::mutex> lock(streamer->mutex);
+		streamer->finished.push_back(request);
+	}
+}
+
+void startTextureStreamer(texture_streamer& streamer, uint32 numberOfWorkers)
+{
+	streamer.quit = false;
+	for (uint32 i = 0; i < numberOfWorkers; ++i)
+		streamer.workers.push_back(std::thread(textureStreamingWorker, &streamer));
+}
+
+void stopTextureStreamer(texture_streamer& streamer)
+{
+	{
+		std::lock_guard<std::mutex> lock(streamer.mutex);
+		streamer.quit = true;
+	}
+	streamer.condition.notify_all();
+
+	for (std::thread& worker : streamer.workers)
+		worker.join();
+	streamer.workers.clear();
+
+	for (texture_stream_request* request : streamer.pending)
+		delete request;
+	for (texture_stream_request* request : streamer.finished)
+		delete request;
+	streamer.pending.clear();
+	streamer.finished.clear();
+}
+
+void submitTextureRequest(texture_streamer& streamer, texture_stream_request* request)
+{
+	{
+		std::lock_guard<std::mutex> lock(streamer.mutex);
+		streamer.pending.push_back(request);
+	}
+	streamer.condition.notify_one();
+}
+
+void popFinishedTextureRequests(texture_streamer& streamer, std::vector<texture_stream_request*>& requests)
+{
+	requests.clear();
+	std::lock_guard<std::mutex> lock(streamer.mutex);
+	requests.swap(streamer.finished);
+}
+
+uint32 getResidentTailLevel(uint32 width, uint32 height, uint32 numberOfLevels)
+{
+	uint32 level = 0;
+	while (level + 1 < numberOfLevels && max(width >> level, height >> level) > TEXTURE_STREAMING_RESIDENT_SIZE)
+		++level;
+	return level;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "common.h"
+#include "texture_compression.h"
+
+// levels up to this size are loaded with the scene and always stay resident. everything above is streamed
+#define TEXTURE_STREAMING_RESIDENT_SIZE 64
+
+// gpu memory for the streamed levels of all textures, the always resident tails are not counted
+#define TEXTURE_STREAMING_BUDGET (64ull * 1024 * 1024)
+
+#define TEXTURE_STREAMING_WORKERS 2
+
+// levels [firstLevel, endLevel) of every layer of one texture array, read from the cached ktx files. the worker
+// writes them to staging memory, layer by layer with the levels of a layer one after the other, tightly packed
+struct texture_stream_request
+{
+	uint32 arrayIndex;
+	uint32 firstLevel, endLevel;
+	std::vector<std::string> files;		// one per layer
+
+	uint8* staging;
+	uint64 stagingOffset;				// of staging in the staging buffer
+	uint64 stagingSize;
+
+	bool succeeded;						// set by the worker
+};
+
+// reads requested levels on worker threads. the gl side is done by the renderer, which owns the context, so the
+// workers never touch gl objects, only mapped memory
+struct texture_streamer
+{
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable condition;
+	std::deque<texture_stream_request*> pending;
+	std::vector<texture_stream_request*> finished;
+	bool quit = false;
+};
+
+void startTextureStreamer(texture_streamer& streamer, uint32 numberOfWorkers = TEXTURE_STREAMING_WORKERS);
+
+// waits for the requests being read, drops the others
+void stopTextureStreamer(texture_streamer& streamer);
+
+// the streamer owns the request until it is returned by popFinishedTextureRequests
+void submitTextureRequest(texture_streamer& streamer, texture_stream_request* request);
+void popFinishedTextureRequests(texture_streamer& streamer, std::vector<texture_stream_request*>& requests);
+
+// the finest level that is always resident, e.g. 4 for a 1024x1024 texture
+uint32 getResidentTailLevel(uint32 width, uint32 height, uint32 numberOfLevels);
@@ -0,0 +1,138 @@
+#include "upload_ring.h"
+
+#include <cstring>
+
+
+static const GLbitfield ringMapFlags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+static void allocateRingBuffer(opengl_upload_ring& ring, uint64 frameSize)
+{
+	ring.frameSize = frameSize;
+	ring.offset = 0;
+
+	glGenBuffers(1, &ring.buffer);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, ring.buffer);
+	glBufferStorage(GL_COPY_WRITE_BUFFER, frameSize * UPLOAD_RING_FRAMES, NULL, ringMapFlags);
+	ring.mapped = (uint8*)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, frameSize * UPLOAD_RING_FRAMES, ringMapFlags);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+static void waitForFence(GLsync fence)
+{
+	// the first wait flushes, so the fence is guaranteed to be signaled eventually
+	GLbitfield flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+	while (glClientWaitSync(fence, flags, 1000000) == GL_TIMEOUT_EXPIRED)
+		flags = 0;
+}
+
+void createUploadRing(opengl_upload_ring& ring, uint64 frameSize)
+{
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &ring.uniformAlignment);
+	allocateRingBuffer(ring, frameSize);
+	ring.frame = 0;
+}
+
+void deleteUploadRing(opengl_upload_ring& ring)
+{
+	for (uint32 i = 0; i < UPLOAD_RING_FRAMES; ++i)
+	{
+		if (ring.fences[i])
+			glDeleteSync(ring.fences[i]);
+		ring.fences[i] = 0;
+	}
+	for (upload_ring_retired_buffer& retired : ring.retiredBuffers)
+	{
+		if (retired.fence)
+			glDeleteSync(retired.fence);
+		glDeleteBuffers(1, &retired.buffer);
+	}
+	ring.retiredBuffers.clear();
+
+	// deleting the buffer unmaps it
+	glDeleteBuffers(1, &ring.buffer);
+	ring.buffer = 0;
+	ring.mapped = 0;
+}
+
+void beginUploadFrame(opengl_upload_ring& ring)
+{
+	ring.frame = (ring.frame + 1) % UPLOAD_RING_FRAMES;
+	ring.offset = 0;
+	ring.uploadedBytes = 0;
+
+	GLsync& fence = ring.fences[ring.frame];
+	if (fence)
+	{
+		waitForFence(fence);
+		glDeleteSync(fence);
+		fence = 0;
+	}
+
+	for (uint32 i = 0; i < ring.retiredBuffers.size();)
+	{
+		upload_ring_retired_buffer& retired = ring.retiredBuffers[i];
+		if (retired.fence && glClientWaitSync(retired.fence, 0, 0) != GL_TIMEOUT_EXPIRED)
+		{
+			glDeleteSync(retired.fence);
+			glDeleteBuffers(1, &retired.buffer);
+			retired = ring.retiredBuffers.back();
+			ring.retiredBuffers.pop_back();
+		}
+		else
+		{
+			++i;
+		}
+	}
+}
+
+void endUploadFrame(opengl_upload_ring& ring)
+{
+	ring.fences[ring.frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	for (upload_ring_retired_buffer& retired : ring.retiredBuffers)
+	{
+		if (!retired.fence)
+			retired.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	}
+	if (ring.uploadedBytes > ring.peakUploadedBytes)
+		ring.peakUploadedBytes = ring.uploadedBytes;
+}
+
+upload_allocation allocateUpload(opengl_upload_ring& ring, uint64 size, uint64 alignment)
+{
+	uint64 offset = (ring.offset + alignment - 1) / alignment * alignment;
+	if (offset + size > ring.frameSize)
+	{
+		// the gpu may still read the old buffer, so it is kept until the fence of this frame. the new one is not used
+		// by any frame yet, so its fences start out empty
+		upload_ring_retired_buffer retired = { ring.buffer, 0 };
+		ring.retiredBuffers.push_back(retired);
+		for (uint32 i = 0; i < UPLOAD_RING_FRAMES; ++i)
+		{
+			if (ring.fences[i])
+				glDeleteSync(ring.fences[i]);
+			ring.fences[i] = 0;
+		}
+
+		uint64 frameSize = ring.frameSize * 2;
+		while (frameSize < size)
+			frameSize *= 2;
+		allocateRingBuffer(ring, frameSize);
+		offset = 0;
+	}
+
+	upload_allocation result;
+	result.buffer = ring.buffer;
+	result.offset = ring.frame * ring.frameSize + offset;
+	result.data = ring.mapped + result.offset;
+
+	ring.offset = offset + size;
+	ring.uploadedBytes += size;
+	return result;
+}
+
+upload_allocation uploadUniforms(opengl_upload_ring& ring, const void* data, uint64 size)
+{
+	upload_allocation result = allocateUpload(ring, size, (uint64)ring.uniformAlignment);
+	memcpy(result.data, data, size);
+	return result;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <vector>
+
+#include "common.h"
+
+#include <glew/glew.h>
+
+// the cpu writes one frame ahead of the gpu, plus one frame the driver may have queued
+#define UPLOAD_RING_FRAMES 3
+
+// initial size of the region of one frame, it grows if a frame needs more
+#define UPLOAD_RING_FRAME_SIZE (1024 * 1024)
+
+// a range written by the cpu this frame. the buffer is part of it because the ring may grow mid frame, earlier
+// allocations of the frame stay in the old buffer
+struct upload_allocation
+{
+	uint8* data;
+	GLuint buffer;
+	uint64 offset;
+};
+
+struct upload_ring_retired_buffer
+{
+	GLuint buffer;
+	GLsync fence;	// 0 until the end of the frame it was retired in
+};
+
+// a persistently and coherently mapped buffer, split into one region per frame in flight. a region is only written
+// again after the fence of the frame which last used it has passed, so neither the driver nor the cpu ever has to
+// copy or wait implicitly
+struct opengl_upload_ring
+{
+	GLuint buffer = 0;
+	uint8* mapped = 0;
+	uint64 frameSize = 0;
+	uint32 frame = 0;			// region written this frame
+	uint64 offset = 0;			// in the region
+	GLsync fences[UPLOAD_RING_FRAMES] = {};
+
+	GLint uniformAlignment = 256;
+
+	// buffers which were outgrown, deleted once the gpu is done with them
+	std::vector<upload_ring_retired_buffer> retiredBuffers;
+
+	uint64 uploadedBytes = 0;	// this frame
+	uint64 peakUploadedBytes = 0;
+};
+
+void createUploadRing(opengl_upload_ring& ring, uint64 frameSize = UPLOAD_RING_FRAME_SIZE);
+void deleteUploadRing(opengl_upload_ring& ring);
+
+// waits until the gpu is done with the region of the frame before the last one, which is reused now
+void beginUploadFrame(opengl_upload_ring& ring);
+void endUploadFrame(opengl_upload_ring& ring);
+
+upload_allocation allocateUpload(opengl_upload_ring& ring, uint64 size, uint64 alignment = 16);
+
+// for uniform blocks, offsets have to be multiples of GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT
+upload_allocation uploadUniforms(opengl_upload_ring& ring, const void* data, uint64 size);